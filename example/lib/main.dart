@@ -29,6 +29,9 @@ class TextureReproPage extends StatefulWidget {
 }
 
 class _TextureReproPageState extends State<TextureReproPage> {
+  static const double _previewWidth = 320;
+  static const double _previewHeight = 240;
+
   int? _textureId;
   bool _isInitialized = false;
   bool _cameraEnabled = true;
@@ -43,6 +46,17 @@ class _TextureReproPageState extends State<TextureReproPage> {
   Future<void> _initializeTexture() async {
     try {
       final textureId = await FlTextureRepro.initialize();
+      if (mounted) {
+        // Only decode and upload as many pixels as the preview shows.
+        final ratio = MediaQuery.devicePixelRatioOf(context);
+        await FlTextureRepro.setDisplaySize(
+          textureId,
+          width: (_previewWidth * ratio).round(),
+          height: (_previewHeight * ratio).round(),
+        );
+      }
+      // The pipeline starts in the background; surface its errors here.
+      await FlTextureRepro.whenReady(textureId);
       if (mounted) {
         setState(() {
           _textureId = textureId;
@@ -55,7 +69,16 @@ class _TextureReproPageState extends State<TextureReproPage> {
   }
 
   void _toggleCamera() {
-    // Just toggle visibility - don't restart pipeline to avoid crash
+    // Pause rather than restart the pipeline: the texture and caps stay
+    // intact and a hidden preview costs no decoding or uploads.
+    final textureId = _textureId;
+    if (textureId != null) {
+      if (_cameraEnabled) {
+        FlTextureRepro.pause(textureId);
+      } else {
+        FlTextureRepro.resume(textureId);
+      }
+    }
     setState(() {
       _cameraEnabled = !_cameraEnabled;
     });
@@ -63,7 +86,10 @@ class _TextureReproPageState extends State<TextureReproPage> {
 
   @override
   void dispose() {
-    FlTextureRepro.dispose();
+    final textureId = _textureId;
+    if (textureId != null) {
+      FlTextureRepro.dispose(textureId);
+    }
     super.dispose();
   }
 
@@ -147,8 +173,8 @@ class _TextureReproPageState extends State<TextureReproPage> {
                         border: Border.all(color: Colors.grey, width: 2),
                       ),
                       child: SizedBox(
-                        width: 320,
-                        height: 240,
+                        width: _previewWidth,
+                        height: _previewHeight,
                         child: _cameraEnabled && _isInitialized && _textureId != null
                             ? Texture(textureId: _textureId!)
                             : Center(
@@ -1,16 +1,510 @@
+import 'dart:async';
+import 'dart:typed_data';
+
 import 'package:flutter/services.dart';
 
+/// How camera frames are handed from GStreamer to the GL texture.
+enum FlTextureReproUploadMode {
+  /// Copy each frame into a plugin-owned buffer before uploading.
+  copy('copy'),
+
+  /// Hold the latest GStreamer sample and upload from its memory directly.
+  zeroCopy('zero-copy');
+
+  const FlTextureReproUploadMode(this.value);
+
+  final String value;
+}
+
+/// Pixel format delivered by the pipeline and uploaded to the GPU.
+enum FlTextureReproPixelFormat {
+  /// Converted to RGBA on the CPU.
+  rgba('rgba'),
+
+  /// Uploaded as Y + interleaved UV planes and converted by a GL shader.
+  nv12('nv12'),
+
+  /// Uploaded as Y, U and V planes and converted by a GL shader.
+  i420('i420');
+
+  const FlTextureReproPixelFormat(this.value);
+
+  final String value;
+}
+
+/// How far [FlTextureRepro.initialize] takes the pipeline.
+enum FlTextureReproPreload {
+  /// Start streaming right away.
+  none(null),
+
+  /// Load plugins and open the device, then wait for [FlTextureRepro.play].
+  ready('ready'),
+
+  /// Like [ready], and also configure the elements for streaming.
+  paused('paused');
+
+  const FlTextureReproPreload(this.value);
+
+  final String? value;
+}
+
+/// What happened to a texture's pipeline.
+enum FlTextureReproPipelineEventType { ready, preloaded, error }
+
+/// Reported on [FlTextureRepro.pipelineEvents] whenever a pipeline start
+/// begun by [FlTextureRepro.initialize] or [FlTextureRepro.play] finishes.
+class FlTextureReproPipelineEvent {
+  FlTextureReproPipelineEvent._(Map<Object?, Object?> message)
+      : textureId = message['textureId'] as int,
+        type = FlTextureReproPipelineEventType.values.byName(
+          message['event'] as String,
+        ),
+        message = message['message'] as String?;
+
+  final int textureId;
+  final FlTextureReproPipelineEventType type;
+
+  /// Error description for [FlTextureReproPipelineEventType.error].
+  final String? message;
+}
+
+/// Codec and container used by [FlTextureRepro.startRecording].
+enum FlTextureReproRecordingCodec {
+  /// H.264 in MP4.
+  h264('h264'),
+
+  /// VP8 in WebM.
+  vp8('vp8'),
+
+  /// Motion JPEG in AVI. With the MJPEG camera the JPEG frames are written
+  /// as they arrive, without decoding or re-encoding.
+  mjpeg('mjpeg');
+
+  const FlTextureReproRecordingCodec(this.value);
+
+  final String value;
+}
+
+/// Pixel format of frames delivered by a frame tap.
+enum FlTextureReproTapFormat {
+  /// 4 bytes per pixel, one plane.
+  rgba('rgba'),
+
+  /// Luma only, one plane.
+  gray('gray'),
+
+  /// Y plane followed by interleaved UV at half resolution.
+  nv12('nv12'),
+
+  /// Y, U and V planes, chroma at half resolution.
+  i420('i420');
+
+  const FlTextureReproTapFormat(this.value);
+
+  final String value;
+}
+
+/// A frame delivered by a frame tap.
+class FlTextureReproFrame {
+  FlTextureReproFrame._(Map<Object?, Object?> message)
+      : textureId = message['textureId'] as int,
+        width = message['width'] as int,
+        height = message['height'] as int,
+        format = FlTextureReproTapFormat.values
+            .firstWhere((format) => format.value == message['format']),
+        strides = (message['strides'] as List<Object?>).cast<int>(),
+        offsets = (message['offsets'] as List<Object?>).cast<int>(),
+        ptsUs = message['ptsUs'] as int,
+        bytes = message['bytes'] as Uint8List;
+
+  final int textureId;
+  final int width;
+  final int height;
+  final FlTextureReproTapFormat format;
+
+  /// Bytes per row and start of each plane in [bytes].
+  final List<int> strides;
+  final List<int> offsets;
+
+  /// Presentation timestamp in microseconds, or -1 if unknown.
+  final int ptsUs;
+  final Uint8List bytes;
+}
+
 class FlTextureRepro {
   static const MethodChannel _channel = MethodChannel('fl_texture_repro');
+  static const BasicMessageChannel<Object?> _framesChannel =
+      BasicMessageChannel('fl_texture_repro/frames', StandardMessageCodec());
 
-  /// Initialize the texture plugin and return the texture ID
-  static Future<int> initialize() async {
-    final int textureId = await _channel.invokeMethod('initialize');
+  static const BasicMessageChannel<Object?> _eventsChannel =
+      BasicMessageChannel('fl_texture_repro/events', StandardMessageCodec());
+
+  static final Map<int, Future<void> Function(FlTextureReproFrame)>
+      _frameHandlers = {};
+
+  static final StreamController<FlTextureReproPipelineEvent> _events =
+      StreamController.broadcast();
+  static final Map<int, FlTextureReproPipelineEventType> _lastEvents = {};
+  static bool _listeningForEvents = false;
+
+  static void _listenForEvents() {
+    if (_listeningForEvents) {
+      return;
+    }
+    _listeningForEvents = true;
+    _eventsChannel.setMessageHandler((message) async {
+      final event =
+          FlTextureReproPipelineEvent._(message! as Map<Object?, Object?>);
+      _lastEvents[event.textureId] = event.type;
+      _events.add(event);
+      return null;
+    });
+  }
+
+  /// Pipeline start results for every texture.
+  static Stream<FlTextureReproPipelineEvent> get pipelineEvents {
+    _listenForEvents();
+    return _events.stream;
+  }
+
+  /// Completes once the pipeline of [textureId] is streaming; throws a
+  /// [PlatformException] if it failed to start.
+  static Future<void> whenReady(int textureId) async {
+    _listenForEvents();
+    var type = _lastEvents[textureId];
+    while (type != FlTextureReproPipelineEventType.ready) {
+      if (type == FlTextureReproPipelineEventType.error) {
+        throw PlatformException(
+          code: 'PIPELINE_ERROR',
+          message: 'Failed to start GStreamer pipeline',
+        );
+      }
+      final event =
+          await pipelineEvents.firstWhere((e) => e.textureId == textureId);
+      if (event.type == FlTextureReproPipelineEventType.error) {
+        throw PlatformException(code: 'PIPELINE_ERROR', message: event.message);
+      }
+      type = event.type;
+    }
+  }
+
+  /// Create a texture fed by its own pipeline and return the texture ID
+  ///
+  /// Each call opens another stream. [device] selects the v4l2 MJPEG camera;
+  /// [source] replaces it with any gst-launch description producing raw video
+  /// (e.g. `videotestsrc is-live=true`).
+  ///
+  /// [pboRingDepth] enables asynchronous uploads through a ring of 2-3 pixel
+  /// buffer objects; 0 uploads directly from client memory.
+  ///
+  /// [decodeWorkers] decodes the camera's MJPEG on that many threads
+  /// instead of one, for camera modes a single decoder cannot keep up with.
+  /// Frames stay in order; each extra worker can add up to one frame of
+  /// latency. 0 or 1 keeps a single decoder.
+  ///
+  /// [scaledDecode] decodes the camera's MJPEG at 1/8, 1/4 or 1/2 size
+  /// when that still covers the display size, which costs several times
+  /// less CPU than decoding 1920x1080 and scaling down. Stills and raw
+  /// recordings then get the decoded size. Takes precedence over
+  /// [decodeWorkers].
+  ///
+  /// [textureRingDepth] rotates each new frame through 2-3 GL textures, so
+  /// an upload never targets the texture the compositor may still be
+  /// sampling. Each texture is fenced when it is handed over and reused only
+  /// once the fence has signalled. 0 keeps a single texture.
+  ///
+  /// [pixelFormat] NV12/I420 skips the CPU color conversion and needs
+  /// GL 3.2 or GLES 3.0; it always uses zero-copy uploads.
+  ///
+  /// [glSharing] shares Flutter's GL context with GStreamer so frames arrive
+  /// as GL textures with no CPU copy or upload. It falls back to the normal
+  /// path automatically when sharing is not possible.
+  ///
+  /// [fusedConvert] replaces videoscale and videoconvert with a single
+  /// multi-threaded SIMD pass from the decoder's YUV to RGBA at the output
+  /// size. RGBA only; implies copy uploads.
+  ///
+  /// [partialUpdates] compares each frame with the previous one in 64x64
+  /// tiles and uploads only the tiles that changed, which suits mostly static
+  /// feeds. [partialUpdateThreshold] (0-255) is the largest per-channel
+  /// difference still treated as unchanged; raise it to ignore sensor noise.
+  /// RGBA only; implies copy uploads.
+  ///
+  /// [restoreGlState] puts back the GL bindings the upload changes (texture
+  /// unit and binding, unpack alignment, row length and buffer) before
+  /// returning to Flutter. Off by default so the texture keeps reproducing
+  /// the state leak described in the README.
+  ///
+  /// [threadCpus] pins the pipeline's streaming threads (capture, decode,
+  /// convert and the frame callback) to a CPU list like `'2-5,7'`, keeping
+  /// them off the cores Flutter's UI and raster threads use.
+  /// [threadNice] sets their nice value and [threadRtPriority] (1-99) runs
+  /// them under SCHED_FIFO; raising priority needs CAP_SYS_NICE or an
+  /// RLIMIT_RTPRIO allowance. What the threads actually got is reported by
+  /// [getStats].
+  ///
+  /// The texture ID is returned right away; the pipeline starts on a worker
+  /// thread and reports on [pipelineEvents] (see also [whenReady]). With
+  /// [preload] it stops at READY or PAUSED and reports `preloaded`; [play]
+  /// then starts streaming with the device already open.
+  static Future<int> initialize({
+    String? device,
+    String? source,
+    FlTextureReproUploadMode uploadMode = FlTextureReproUploadMode.zeroCopy,
+    FlTextureReproPixelFormat pixelFormat = FlTextureReproPixelFormat.rgba,
+    int pboRingDepth = 0,
+    int textureRingDepth = 0,
+    int decodeWorkers = 0,
+    bool scaledDecode = false,
+    bool glSharing = false,
+    bool fusedConvert = false,
+    bool partialUpdates = false,
+    int partialUpdateThreshold = 0,
+    bool restoreGlState = false,
+    String? threadCpus,
+    int threadNice = 0,
+    int threadRtPriority = 0,
+    FlTextureReproPreload preload = FlTextureReproPreload.none,
+  }) async {
+    _listenForEvents();
+    final int textureId = await _channel.invokeMethod('initialize', {
+      if (device != null) 'device': device,
+      if (source != null) 'source': source,
+      'uploadMode': uploadMode.value,
+      'pixelFormat': pixelFormat.value,
+      'pboRingDepth': pboRingDepth,
+      'textureRingDepth': textureRingDepth,
+      'decodeWorkers': decodeWorkers,
+      'scaledDecode': scaledDecode,
+      'glSharing': glSharing,
+      'fusedConvert': fusedConvert,
+      'partialUpdates': partialUpdates,
+      'partialUpdateThreshold': partialUpdateThreshold,
+      'restoreGlState': restoreGlState,
+      if (threadCpus != null) 'threadCpus': threadCpus,
+      'threadNice': threadNice,
+      'threadRtPriority': threadRtPriority,
+      if (preload.value != null) 'preload': preload.value,
+    });
+    return textureId;
+  }
+
+  /// Create another texture showing the camera of [sourceTextureId] and
+  /// return its texture ID.
+  ///
+  /// The view adds a branch to the source's pipeline rather than opening
+  /// the device again, so the frames are decoded once for the source and all
+  /// its views. Each view is scaled to its own [setDisplaySize] and takes
+  /// the upload options of [initialize]. A [pause]d view drops its frames
+  /// before any work is done on them; the pipeline itself only pauses once
+  /// the source and every view are paused. [dispose] a view like any
+  /// texture; recording and stills go through the source.
+  static Future<int> createView(
+    int sourceTextureId, {
+    FlTextureReproUploadMode uploadMode = FlTextureReproUploadMode.zeroCopy,
+    FlTextureReproPixelFormat pixelFormat = FlTextureReproPixelFormat.rgba,
+    int pboRingDepth = 0,
+    int textureRingDepth = 0,
+    bool fusedConvert = false,
+    bool partialUpdates = false,
+    int partialUpdateThreshold = 0,
+    bool restoreGlState = false,
+  }) async {
+    final int textureId = await _channel.invokeMethod('createView', {
+      'sourceId': sourceTextureId,
+      'uploadMode': uploadMode.value,
+      'pixelFormat': pixelFormat.value,
+      'pboRingDepth': pboRingDepth,
+      'textureRingDepth': textureRingDepth,
+      'fusedConvert': fusedConvert,
+      'partialUpdates': partialUpdates,
+      'partialUpdateThreshold': partialUpdateThreshold,
+      'restoreGlState': restoreGlState,
+    });
     return textureId;
   }
 
-  /// Dispose the texture
-  static Future<void> dispose() async {
-    await _channel.invokeMethod('dispose');
+  /// Start streaming a texture created with [FlTextureReproPreload], or
+  /// resume a paused one. The result is reported on [pipelineEvents].
+  static Future<void> play(int textureId) async {
+    _lastEvents.remove(textureId);
+    await _channel.invokeMethod('play', {'textureId': textureId});
+  }
+
+  /// Pause the pipeline of [textureId], e.g. while its texture is hidden.
+  ///
+  /// The source stops delivering frames, so nothing is decoded, converted
+  /// or uploaded; the texture keeps showing its last frame and the device
+  /// stays configured. While views of the same source (see [createView])
+  /// are still showing, only this texture's frames stop.
+  static Future<void> pause(int textureId) async {
+    await _channel.invokeMethod('pause', {'textureId': textureId});
+  }
+
+  /// Resume a pipeline stopped with [pause]. No renegotiation is needed, so
+  /// frames arrive again immediately.
+  static Future<void> resume(int textureId) async {
+    await _channel.invokeMethod('resume', {'textureId': textureId});
+  }
+
+  /// Dispose the texture with [textureId], or every texture if omitted.
+  /// Disposing a source also disposes its views (see [createView]).
+  static Future<void> dispose([int? textureId]) async {
+    if (textureId != null) {
+      _lastEvents.remove(textureId);
+    } else {
+      _lastEvents.clear();
+    }
+    await _channel.invokeMethod('dispose', {
+      if (textureId != null) 'textureId': textureId,
+    });
+  }
+
+  /// Scale frames of [textureId] to the size it is shown at, in physical
+  /// pixels (logical size times the device pixel ratio).
+  ///
+  /// The running pipeline renegotiates without restarting, so only the
+  /// pixels actually displayed are converted and uploaded. Until this is
+  /// called frames are 640x480.
+  static Future<void> setDisplaySize(
+    int textureId, {
+    required int width,
+    required int height,
+  }) async {
+    await _channel.invokeMethod('setDisplaySize', {
+      'textureId': textureId,
+      'width': width,
+      'height': height,
+    });
+  }
+
+  /// Deliver frames of [textureId] to [onFrame] for analysis, at most
+  /// [maxFps] per second (0: every frame), scaled to [width] x [height]
+  /// (0: the size frames are decoded at) and converted to [format].
+  ///
+  /// Frames come from the pipeline already feeding the texture; conversion
+  /// happens on a worker thread. The next frame is only delivered once the
+  /// future returned by [onFrame] completes, so a slow handler drops frames
+  /// rather than queueing them. Calling this again replaces the previous
+  /// subscription.
+  static Future<void> startFrameTap(
+    int textureId, {
+    double maxFps = 0,
+    int width = 0,
+    int height = 0,
+    FlTextureReproTapFormat format = FlTextureReproTapFormat.rgba,
+    required Future<void> Function(FlTextureReproFrame frame) onFrame,
+  }) async {
+    if (_frameHandlers.isEmpty) {
+      _framesChannel.setMessageHandler(_handleFrame);
+    }
+    _frameHandlers[textureId] = onFrame;
+    await _channel.invokeMethod('startFrameTap', {
+      'textureId': textureId,
+      'maxFps': maxFps,
+      'width': width,
+      'height': height,
+      'format': format.value,
+    });
+  }
+
+  /// Stop delivering frames of [textureId].
+  static Future<void> stopFrameTap(int textureId) async {
+    await _channel.invokeMethod('stopFrameTap', {'textureId': textureId});
+    _frameHandlers.remove(textureId);
+    if (_frameHandlers.isEmpty) {
+      _framesChannel.setMessageHandler(null);
+    }
+  }
+
+  // Replying completes the hand-off and lets the plugin tap the next frame.
+  static Future<Object?> _handleFrame(Object? message) async {
+    final frame = FlTextureReproFrame._(message! as Map<Object?, Object?>);
+    final handler = _frameHandlers[frame.textureId];
+    if (handler != null) {
+      await handler(frame);
+    }
+    return null;
+  }
+
+  /// Start writing the stream of [textureId] to [path].
+  ///
+  /// Recording runs on a branch of the existing pipeline behind a leaky
+  /// queue, so a slow encoder or disk drops recorded frames rather than
+  /// stalling the preview. Frames are recorded at the source resolution.
+  static Future<void> startRecording(
+    int textureId,
+    String path, {
+    FlTextureReproRecordingCodec codec = FlTextureReproRecordingCodec.h264,
+  }) async {
+    await _channel.invokeMethod('startRecording', {
+      'textureId': textureId,
+      'path': path,
+      'codec': codec.value,
+    });
+  }
+
+  /// Stop recording [textureId] and return the path once the file is
+  /// complete.
+  static Future<String> stopRecording(int textureId) async {
+    final String path = await _channel.invokeMethod('stopRecording', {
+      'textureId': textureId,
+    });
+    return path;
+  }
+
+  /// Capture the next frame of [textureId] at the source resolution as JPEG.
+  ///
+  /// The frame is taken before it is scaled for the preview. With the MJPEG
+  /// camera it is the camera's own JPEG; other sources are encoded on a
+  /// worker thread. The preview keeps running meanwhile.
+  static Future<Uint8List> captureStill(int textureId) async {
+    final Uint8List jpeg = await _channel.invokeMethod('captureStill', {
+      'textureId': textureId,
+    });
+    return jpeg;
+  }
+
+  /// Like [captureStill], but writes the JPEG to [path] and returns it.
+  static Future<String> captureStillToFile(int textureId, String path) async {
+    final String result = await _channel.invokeMethod('captureStill', {
+      'textureId': textureId,
+      'path': path,
+    });
+    return result;
+  }
+
+  /// Performance counters for [textureId]: frames received, uploaded and
+  /// dropped, populate calls without a new frame, bytes copied, PBO and
+  /// texture ring usage, tiles uploaded and skipped by partial updates, frames delivered
+  /// to and dropped for the frame tap, and `uploadTimeUs` /
+  /// `captureLatencyUs` maps with `count`, `mean`, `p50`, `p90`, `p99` and
+  /// `max` in microseconds. With a thread policy, `streamThreadsPlaced` and
+  /// `streamThreadsRefused` count streaming thread starts, and
+  /// `placedThreads` lists every thread placed right now (streaming threads
+  /// and decode or convert workers) as maps with `role`, `tid`, `cpus`,
+  /// `policy`, `priority`, `nice` and `refused`.
+  static Future<Map<String, Object?>> getStats(int textureId) async {
+    final Map<Object?, Object?>? stats = await _channel
+        .invokeMethod<Map<Object?, Object?>>('getStats', {
+      'textureId': textureId,
+    });
+    return stats?.cast<String, Object?>() ?? const {};
+  }
+
+  /// Start or stop recording a timeline of every frame's stages (sample
+  /// arrival, buffer map, copy, frame-available notification, populate's
+  /// frame acquire and GL upload) for all textures. Starting clears the
+  /// previous recording; only the most recent spans are kept.
+  static Future<void> setTracing(bool enabled) async {
+    await _channel.invokeMethod('setTracing', {'enabled': enabled});
+  }
+
+  /// Write the recorded timeline to [path] as Chrome trace-event JSON, which
+  /// opens in Perfetto (ui.perfetto.dev). Returns the number of spans.
+  static Future<int> dumpTrace(String path) async {
+    final int? spans =
+        await _channel.invokeMethod<int>('dumpTrace', {'path': path});
+    return spans ?? 0;
   }
 }
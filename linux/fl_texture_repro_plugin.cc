@@ -2,349 +2,644 @@
 
 #include <flutter_linux/flutter_linux.h>
 #include <gtk/gtk.h>
-#include <epoxy/gl.h>
-#include <gst/gst.h>
-#include <gst/app/gstappsink.h>
-#include <gst/video/video.h>
 
 #include <cstring>
 
+#include "frame_trace.h"
+#include "gst_gl_texture.h"
+
 // ============================================================================
-// GStreamer + FlTextureGL implementation to reproduce rendering artifact issue
-// Uses videotestsrc instead of camera to allow testing without hardware
+// Plugin implementation
 // ============================================================================
 
-// Forward declarations
-G_DECLARE_FINAL_TYPE(GstGLTexture, gst_gl_texture, GST, GL_TEXTURE, FlTextureGL)
+#define FL_TEXTURE_REPRO_PLUGIN(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj), fl_texture_repro_plugin_get_type(), \
+                              FlTextureReproPlugin))
+
+struct _FlTextureReproPlugin {
+  GObject parent_instance;
+  FlTextureRegistrar* texture_registrar;
+
+  // "fl_texture_repro/frames": frame tap messages to Dart
+  FlBasicMessageChannel* frames_channel;
 
-struct _GstGLTexture {
-  FlTextureGL parent_instance;
+  // "fl_texture_repro/events": pipeline state events to Dart
+  FlBasicMessageChannel* events_channel;
 
-  // OpenGL
-  GLuint texture_id;
-  gboolean texture_initialized;
+  // Texture ID (int64_t*) -> GstGLTexture*, both owned. Main thread only.
+  GHashTable* textures;
 
-  // GStreamer
-  GstElement* pipeline;
-  GstElement* appsink;
+  // Frame timeline shared by all textures, recording only while enabled by
+  // "setTracing". Outlives the textures.
+  FrameTrace* trace;
 
-  // Frame data
-  uint8_t* frame_buffer;
-  uint32_t width;
-  uint32_t height;
-  GMutex mutex;
-  gboolean has_new_frame;
+  // Set by the first texture that gets a frame while no dispatch is queued.
+  // One main-context source then serves every texture with a pending frame.
+  gint dispatch_pending;
 };
 
-G_DEFINE_TYPE(GstGLTexture, gst_gl_texture, fl_texture_gl_get_type())
+G_DEFINE_TYPE(FlTextureReproPlugin, fl_texture_repro_plugin, g_object_get_type())
 
-// GStreamer new sample callback
-static GstFlowReturn on_new_sample(GstAppSink* appsink, gpointer user_data) {
-  GstGLTexture* self = GST_GL_TEXTURE(user_data);
+// Main-context callback that marks every texture that got a frame since the
+// last dispatch.
+static gboolean frame_dispatch_cb(gpointer user_data) {
+  FlTextureReproPlugin* self = FL_TEXTURE_REPRO_PLUGIN(user_data);
 
-  GstSample* sample = gst_app_sink_pull_sample(appsink);
-  if (sample == nullptr) {
-    return GST_FLOW_OK;
+  // Clear before scanning so a frame arriving now queues a new dispatch.
+  g_atomic_int_set(&self->dispatch_pending, 0);
+
+  if (self->textures == nullptr) {
+    return G_SOURCE_REMOVE;
   }
 
-  GstBuffer* buffer = gst_sample_get_buffer(sample);
-  GstCaps* caps = gst_sample_get_caps(sample);
+  GHashTableIter iter;
+  gpointer value;
+  g_hash_table_iter_init(&iter, self->textures);
+  while (g_hash_table_iter_next(&iter, nullptr, &value)) {
+    GstGLTexture* texture = GST_GL_TEXTURE(value);
+    if (gst_gl_texture_take_frame_pending(texture)) {
+      gint64 trace_start = frame_trace_begin(self->trace);
+      fl_texture_registrar_mark_texture_frame_available(
+          self->texture_registrar, FL_TEXTURE(texture));
+      if (trace_start != 0) {
+        frame_trace_end(self->trace, "mark_frame_available", trace_start,
+                        fl_texture_get_id(FL_TEXTURE(texture)));
+      }
+    }
+  }
+
+  return G_SOURCE_REMOVE;
+}
+
+// Streaming-thread callback shared by all textures.
+static void frame_available_cb(GstGLTexture* texture, gpointer user_data) {
+  FlTextureReproPlugin* self = FL_TEXTURE_REPRO_PLUGIN(user_data);
 
-  GstVideoInfo video_info;
-  if (!gst_video_info_from_caps(&video_info, caps)) {
-    gst_sample_unref(sample);
-    return GST_FLOW_OK;
+  if (g_atomic_int_compare_and_exchange(&self->dispatch_pending, 0, 1)) {
+    g_main_context_invoke_full(nullptr, G_PRIORITY_DEFAULT, frame_dispatch_cb,
+                               g_object_ref(self), g_object_unref);
   }
+}
 
-  GstMapInfo map;
-  if (gst_buffer_map(buffer, &map, GST_MAP_READ)) {
-    g_mutex_lock(&self->mutex);
+// Dart replies once it has handled a tapped frame, which lets the texture
+// tap the next one.
+static void frame_tap_reply_cb(GObject* object,
+                               GAsyncResult* result,
+                               gpointer user_data) {
+  g_autoptr(GstGLTexture) texture = GST_GL_TEXTURE(user_data);
+  g_autoptr(GError) error = nullptr;
+  g_autoptr(FlValue) reply = fl_basic_message_channel_send_finish(
+      FL_BASIC_MESSAGE_CHANNEL(object), result, &error);
+  if (error != nullptr) {
+    g_warning("Failed to deliver tapped frame: %s", error->message);
+  }
+  gst_gl_texture_frame_tap_done(texture);
+}
 
-    uint32_t new_width = GST_VIDEO_INFO_WIDTH(&video_info);
-    uint32_t new_height = GST_VIDEO_INFO_HEIGHT(&video_info);
-    size_t buffer_size = new_width * new_height * 4;  // RGBA
+// Main-thread callback shared by all textures with a frame tap.
+static void frame_tap_cb(GstGLTexture* texture,
+                         FlValue* frame,
+                         gpointer user_data) {
+  FlTextureReproPlugin* self = FL_TEXTURE_REPRO_PLUGIN(user_data);
 
-    // Reallocate if size changed
-    if (self->width != new_width || self->height != new_height) {
-      g_free(self->frame_buffer);
-      self->frame_buffer = (uint8_t*)g_malloc(buffer_size);
-      self->width = new_width;
-      self->height = new_height;
-    }
+  fl_value_set_string_take(frame, "textureId",
+                           fl_value_new_int(fl_texture_get_id(FL_TEXTURE(texture))));
+  fl_basic_message_channel_send(self->frames_channel, frame, nullptr,
+                                frame_tap_reply_cb, g_object_ref(texture));
+}
 
-    // Copy frame data
-    memcpy(self->frame_buffer, map.data, buffer_size);
-    self->has_new_frame = TRUE;
+// Returns the string stored under |key| in a map argument, or nullptr.
+static const gchar* lookup_string(FlValue* args, const gchar* key) {
+  if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+    return nullptr;
+  }
+  FlValue* value = fl_value_lookup_string(args, key);
+  if (value == nullptr || fl_value_get_type(value) != FL_VALUE_TYPE_STRING) {
+    return nullptr;
+  }
+  return fl_value_get_string(value);
+}
 
-    g_mutex_unlock(&self->mutex);
-    gst_buffer_unmap(buffer, &map);
+// Returns the integer stored under |key| in a map argument, or
+// |default_value|.
+static int64_t lookup_int(FlValue* args, const gchar* key,
+                          int64_t default_value) {
+  if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+    return default_value;
+  }
+  FlValue* value = fl_value_lookup_string(args, key);
+  if (value == nullptr || fl_value_get_type(value) != FL_VALUE_TYPE_INT) {
+    return default_value;
   }
+  return fl_value_get_int(value);
+}
 
-  gst_sample_unref(sample);
-  return GST_FLOW_OK;
+// Returns the boolean stored under |key| in a map argument, or
+// |default_value|.
+static gboolean lookup_bool(FlValue* args, const gchar* key,
+                            gboolean default_value) {
+  if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+    return default_value;
+  }
+  FlValue* value = fl_value_lookup_string(args, key);
+  if (value == nullptr || fl_value_get_type(value) != FL_VALUE_TYPE_BOOL) {
+    return default_value;
+  }
+  return fl_value_get_bool(value);
 }
 
-// Populate callback - called by Flutter to get texture
-static gboolean gst_gl_texture_populate(FlTextureGL* texture,
-                                        uint32_t* target,
-                                        uint32_t* name,
-                                        uint32_t* width,
-                                        uint32_t* height,
-                                        GError** error) {
-  GstGLTexture* self = GST_GL_TEXTURE(texture);
+// Reads the optional "initialize" arguments:
+//   {"source": gst-launch description, "device": "/dev/videoN",
+//    "uploadMode": "copy" | "zero-copy", "pboRingDepth": 0 | 2..3,
+//    "pixelFormat": "rgba" | "nv12" | "i420", "glSharing": bool}
+static void parse_texture_options(FlValue* args, GstGLTextureOptions* options) {
+  gst_gl_texture_options_init(options);
 
-  g_mutex_lock(&self->mutex);
+  const gchar* source = lookup_string(args, "source");
+  if (source != nullptr && source[0] != '\0') {
+    options->source = source;
+  }
+  const gchar* device = lookup_string(args, "device");
+  if (device != nullptr && device[0] != '\0') {
+    options->device = device;
+  }
+  const gchar* mode = lookup_string(args, "uploadMode");
+  if (mode != nullptr && strcmp(mode, "copy") == 0) {
+    options->upload_mode = GST_GL_TEXTURE_UPLOAD_COPY;
+  }
+  const gchar* format = lookup_string(args, "pixelFormat");
+  if (format != nullptr && strcmp(format, "nv12") == 0) {
+    options->pixel_format = GST_GL_TEXTURE_FORMAT_NV12;
+  } else if (format != nullptr && strcmp(format, "i420") == 0) {
+    options->pixel_format = GST_GL_TEXTURE_FORMAT_I420;
+  }
+  int64_t depth = lookup_int(args, "pboRingDepth", 0);
+  options->pbo_ring_depth = depth > 0 ? depth : 0;
+  int64_t ring = lookup_int(args, "textureRingDepth", 0);
+  options->texture_ring_depth = ring > 0 ? ring : 0;
+  int64_t workers = lookup_int(args, "decodeWorkers", 0);
+  options->decode_workers = workers > 0 ? workers : 0;
+  options->scaled_decode = lookup_bool(args, "scaledDecode", FALSE);
+  options->gl_sharing = lookup_bool(args, "glSharing", FALSE);
+  options->fused_convert = lookup_bool(args, "fusedConvert", FALSE);
+  options->partial_updates = lookup_bool(args, "partialUpdates", FALSE);
+  int64_t threshold = lookup_int(args, "partialUpdateThreshold", 0);
+  options->partial_update_threshold = CLAMP(threshold, 0, G_MAXUINT8);
+  options->restore_gl_state = lookup_bool(args, "restoreGlState", FALSE);
+  const gchar* cpus = lookup_string(args, "threadCpus");
+  if (cpus != nullptr && cpus[0] != '\0') {
+    options->thread_cpus = cpus;
+  }
+  int64_t nice = lookup_int(args, "threadNice", 0);
+  options->thread_nice = CLAMP(nice, -20, 19);
+  int64_t rt_priority = lookup_int(args, "threadRtPriority", 0);
+  options->thread_rt_priority = CLAMP(rt_priority, 0, 99);
+}
+
+// Stops the pipeline of |texture| and unregisters it from Flutter. The caller
+// still owns the reference.
+static void fl_texture_repro_plugin_release_texture(FlTextureReproPlugin* self,
+                                                    GstGLTexture* texture) {
+  gst_gl_texture_stop_pipeline(texture);
+  gst_gl_texture_set_frame_callback(texture, nullptr, nullptr);
+  gst_gl_texture_set_frame_tap(texture, nullptr, nullptr, nullptr);
+  fl_texture_registrar_unregister_texture(self->texture_registrar,
+                                          FL_TEXTURE(texture));
+}
 
-  if (self->frame_buffer == nullptr || self->width == 0 || self->height == 0) {
-    g_mutex_unlock(&self->mutex);
-    return FALSE;
+// Reports the outcome of an asynchronous pipeline start to Dart:
+//   {"textureId": int, "event": "ready" | "preloaded" | "error",
+//    "message": error text}
+static void pipeline_started_cb(GstGLTexture* texture,
+                                const GError* error,
+                                gpointer user_data) {
+  g_autoptr(FlTextureReproPlugin) self = FL_TEXTURE_REPRO_PLUGIN(user_data);
+
+  // Disposed while starting: Dart no longer knows the ID.
+  int64_t texture_id = fl_texture_get_id(FL_TEXTURE(texture));
+  if (g_hash_table_lookup(self->textures, &texture_id) != texture) {
+    return;
+  }
+
+  g_autoptr(FlValue) event = fl_value_new_map();
+  fl_value_set_string_take(event, "textureId", fl_value_new_int(texture_id));
+  if (error != nullptr) {
+    fl_value_set_string_take(event, "event", fl_value_new_string("error"));
+    fl_value_set_string_take(event, "message",
+                             fl_value_new_string(error->message));
+  } else {
+    gboolean playing = gst_gl_texture_get_pipeline_state(texture) ==
+                       GST_STATE_PLAYING;
+    fl_value_set_string_take(
+        event, "event", fl_value_new_string(playing ? "ready" : "preloaded"));
   }
+  fl_basic_message_channel_send(self->events_channel, event, nullptr, nullptr,
+                                nullptr);
+}
 
-  // Create texture if not initialized
-  if (!self->texture_initialized) {
-    glGenTextures(1, &self->texture_id);
-    self->texture_initialized = TRUE;
+static FlMethodResponse* handle_initialize(FlTextureReproPlugin* self,
+                                          FlValue* args) {
+  GstGLTextureOptions options;
+  parse_texture_options(args, &options);
+  options.trace = self->trace;
+
+  // "preload": "ready" | "paused" stops short of PLAYING until "play".
+  GstState state = GST_STATE_PLAYING;
+  const gchar* preload = lookup_string(args, "preload");
+  if (g_strcmp0(preload, "ready") == 0) {
+    state = GST_STATE_READY;
+  } else if (g_strcmp0(preload, "paused") == 0) {
+    state = GST_STATE_PAUSED;
   }
 
-  // Bind texture - NOTE: We intentionally do NOT save/restore GL state
-  // This is to reproduce the bug where GL state pollution causes artifacts
-  glBindTexture(GL_TEXTURE_2D, self->texture_id);
+  // Create texture
+  GstGLTexture* texture = gst_gl_texture_new(&options);
 
-  // Upload frame data to texture
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA,
-               self->width, self->height, 0,
-               GL_RGBA, GL_UNSIGNED_BYTE, self->frame_buffer);
+  // Register with Flutter
+  gboolean registered = fl_texture_registrar_register_texture(
+      self->texture_registrar, FL_TEXTURE(texture));
 
-  // Set texture parameters - these also modify GL state
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  if (!registered) {
+    g_object_unref(texture);
+    return FL_METHOD_RESPONSE(
+        fl_method_error_response_new("TEXTURE_ERROR", "Failed to register texture", nullptr));
+  }
 
-  self->has_new_frame = FALSE;
+  int64_t texture_id = fl_texture_get_id(FL_TEXTURE(texture));
 
-  *target = GL_TEXTURE_2D;
-  *name = self->texture_id;
-  *width = self->width;
-  *height = self->height;
+  // New samples notify Flutter through the shared dispatch from here on
+  gst_gl_texture_set_frame_callback(texture, frame_available_cb, self);
 
-  g_mutex_unlock(&self->mutex);
+  g_hash_table_insert(self->textures,
+                      g_memdup2(&texture_id, sizeof(texture_id)), texture);
 
-  // NOTE: We do NOT unbind or restore previous texture binding here.
-  // This is intentional to reproduce the issue where Skia's GL state
-  // is corrupted by external texture operations.
+  // Start the GStreamer pipeline without blocking the UI; Dart hears about
+  // the outcome on the events channel.
+  gst_gl_texture_start_pipeline_async(texture, state, pipeline_started_cb,
+                                      g_object_ref(self));
 
-  return TRUE;
+  g_autoptr(FlValue) result = fl_value_new_int(texture_id);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
 }
 
-static gboolean gst_gl_texture_start_pipeline(GstGLTexture* self) {
-  // Initialize GStreamer if needed
-  if (!gst_is_initialized()) {
-    gst_init(nullptr, nullptr);
+static FlMethodResponse* handle_dispose(FlTextureReproPlugin* self,
+                                       FlValue* args) {
+  // Without a texture ID every texture is disposed.
+  int64_t texture_id = lookup_int(args, "textureId", -1);
+  GstGLTexture* target = nullptr;
+  if (texture_id != -1) {
+    target = static_cast<GstGLTexture*>(
+        g_hash_table_lookup(self->textures, &texture_id));
+    if (target == nullptr) {
+      return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+    }
   }
 
-  // Create pipeline with v4l2src for real camera
-  // Using Insta360 X5 connected via USB (supports 1920x1080 @ 30fps MJPEG)
-  const char* pipeline_str =
-      "v4l2src device=/dev/video0 ! "
-      "image/jpeg,width=1920,height=1080,framerate=30/1 ! "
-      "jpegdec ! "
-      "videoscale ! "
-      "video/x-raw,width=640,height=480 ! "
-      "videoconvert ! "
-      "video/x-raw,format=RGBA ! "
-      "appsink name=sink emit-signals=true max-buffers=2 drop=true";
+  // A source takes its views with it: they would otherwise stay registered,
+  // keeping the source alive with nothing left to show.
+  GHashTableIter iter;
+  gpointer value;
+  g_hash_table_iter_init(&iter, self->textures);
+  while (g_hash_table_iter_next(&iter, nullptr, &value)) {
+    GstGLTexture* texture = GST_GL_TEXTURE(value);
+    if (target != nullptr && texture != target &&
+        gst_gl_texture_get_view_source(texture) != target) {
+      continue;
+    }
+    fl_texture_repro_plugin_release_texture(self, texture);
+    g_hash_table_iter_remove(&iter);
+  }
 
-  GError* error = nullptr;
-  self->pipeline = gst_parse_launch(pipeline_str, &error);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
 
-  if (error != nullptr) {
-    g_warning("Failed to create pipeline: %s", error->message);
-    g_error_free(error);
-    return FALSE;
-  }
-
-  // Get appsink and configure callbacks
-  self->appsink = gst_bin_get_by_name(GST_BIN(self->pipeline), "sink");
-  if (self->appsink == nullptr) {
-    g_warning("Failed to get appsink");
-    gst_object_unref(self->pipeline);
-    self->pipeline = nullptr;
-    return FALSE;
-  }
-
-  // Set up callbacks
-  GstAppSinkCallbacks callbacks = {
-      nullptr,  // eos
-      nullptr,  // new_preroll
-      on_new_sample,  // new_sample
-  };
-  gst_app_sink_set_callbacks(GST_APP_SINK(self->appsink), &callbacks, self, nullptr);
-
-  // Start pipeline
-  GstStateChangeReturn ret = gst_element_set_state(self->pipeline, GST_STATE_PLAYING);
-  if (ret == GST_STATE_CHANGE_FAILURE) {
-    g_warning("Failed to start pipeline");
-    gst_object_unref(self->appsink);
-    gst_object_unref(self->pipeline);
-    self->appsink = nullptr;
-    self->pipeline = nullptr;
-    return FALSE;
-  }
-
-  g_print("GStreamer pipeline started (v4l2src /dev/video0 640x480 @ 30fps)\n");
-  return TRUE;
-}
-
-static void gst_gl_texture_stop_pipeline(GstGLTexture* self) {
-  if (self->pipeline != nullptr) {
-    gst_element_set_state(self->pipeline, GST_STATE_NULL);
-
-    if (self->appsink != nullptr) {
-      gst_object_unref(self->appsink);
-      self->appsink = nullptr;
-    }
+// Returns the texture named by the "textureId" argument, or nullptr.
+static GstGLTexture* lookup_texture(FlTextureReproPlugin* self, FlValue* args) {
+  int64_t texture_id = lookup_int(args, "textureId", -1);
+  return static_cast<GstGLTexture*>(
+      g_hash_table_lookup(self->textures, &texture_id));
+}
 
-    gst_object_unref(self->pipeline);
-    self->pipeline = nullptr;
+static FlMethodResponse* invalid_texture_response() {
+  return FL_METHOD_RESPONSE(fl_method_error_response_new(
+      "INVALID_TEXTURE", "Unknown texture ID", nullptr));
+}
 
-    g_print("GStreamer pipeline stopped\n");
+// Creates a view of the texture named by "sourceId" (see
+// gst_gl_texture_new_view()) and returns its texture ID. Takes the same
+// options as "initialize" for its own scaling and upload.
+static FlMethodResponse* handle_create_view(FlTextureReproPlugin* self,
+                                           FlValue* args) {
+  int64_t source_id = lookup_int(args, "sourceId", -1);
+  GstGLTexture* source = static_cast<GstGLTexture*>(
+      g_hash_table_lookup(self->textures, &source_id));
+  if (source == nullptr) {
+    return invalid_texture_response();
   }
-}
 
-static void gst_gl_texture_dispose(GObject* object) {
-  GstGLTexture* self = GST_GL_TEXTURE(object);
+  GstGLTextureOptions options;
+  parse_texture_options(args, &options);
+  options.trace = self->trace;
+  GstGLTexture* texture = gst_gl_texture_new_view(source, &options);
 
-  gst_gl_texture_stop_pipeline(self);
+  if (!fl_texture_registrar_register_texture(self->texture_registrar,
+                                             FL_TEXTURE(texture))) {
+    g_object_unref(texture);
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "TEXTURE_ERROR", "Failed to register texture", nullptr));
+  }
 
-  g_mutex_lock(&self->mutex);
+  int64_t texture_id = fl_texture_get_id(FL_TEXTURE(texture));
+  gst_gl_texture_set_frame_callback(texture, frame_available_cb, self);
+  if (!gst_gl_texture_start_pipeline(texture)) {
+    fl_texture_repro_plugin_release_texture(self, texture);
+    g_object_unref(texture);
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "PIPELINE_ERROR", "Failed to attach view", nullptr));
+  }
+  g_hash_table_insert(self->textures,
+                      g_memdup2(&texture_id, sizeof(texture_id)), texture);
 
-  // Note: We don't call glDeleteTextures here because:
-  // 1. The GL context may not be current
-  // 2. Flutter's texture registrar will handle texture cleanup
-  // Just reset our tracking variables
-  self->texture_id = 0;
-  self->texture_initialized = FALSE;
+  g_autoptr(FlValue) result = fl_value_new_int(texture_id);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
 
-  g_free(self->frame_buffer);
-  self->frame_buffer = nullptr;
+static FlMethodResponse* handle_play(FlTextureReproPlugin* self,
+                                     FlValue* args) {
+  GstGLTexture* texture = lookup_texture(self, args);
+  if (texture == nullptr) {
+    return invalid_texture_response();
+  }
+
+  gst_gl_texture_start_pipeline_async(texture, GST_STATE_PLAYING,
+                                      pipeline_started_cb, g_object_ref(self));
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
 
-  g_mutex_unlock(&self->mutex);
-  g_mutex_clear(&self->mutex);
+static FlMethodResponse* handle_set_paused(FlTextureReproPlugin* self,
+                                           FlValue* args,
+                                           gboolean paused) {
+  GstGLTexture* texture = lookup_texture(self, args);
+  if (texture == nullptr) {
+    return invalid_texture_response();
+  }
 
-  G_OBJECT_CLASS(gst_gl_texture_parent_class)->dispose(object);
+  if (!gst_gl_texture_set_paused(texture, paused)) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "PIPELINE_ERROR", "Pipeline is not running", nullptr));
+  }
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
 }
 
-static void gst_gl_texture_class_init(GstGLTextureClass* klass) {
-  G_OBJECT_CLASS(klass)->dispose = gst_gl_texture_dispose;
-  FL_TEXTURE_GL_CLASS(klass)->populate = gst_gl_texture_populate;
+static FlMethodResponse* handle_get_stats(FlTextureReproPlugin* self,
+                                          FlValue* args) {
+  GstGLTexture* texture = lookup_texture(self, args);
+  if (texture == nullptr) {
+    return invalid_texture_response();
+  }
+
+  g_autoptr(FlValue) result = gst_gl_texture_get_stats(texture);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
 }
 
-static void gst_gl_texture_init(GstGLTexture* self) {
-  self->texture_id = 0;
-  self->texture_initialized = FALSE;
-  self->pipeline = nullptr;
-  self->appsink = nullptr;
-  self->frame_buffer = nullptr;
-  self->width = 0;
-  self->height = 0;
-  self->has_new_frame = FALSE;
-  g_mutex_init(&self->mutex);
+// Starts or stops recording the frame timeline. Starting clears it.
+static FlMethodResponse* handle_set_tracing(FlTextureReproPlugin* self,
+                                            FlValue* args) {
+  frame_trace_set_enabled(self->trace, lookup_bool(args, "enabled", FALSE));
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
 }
 
-static GstGLTexture* gst_gl_texture_new() {
-  return GST_GL_TEXTURE(g_object_new(gst_gl_texture_get_type(), nullptr));
+// Writes the frame timeline to "path"; returns the number of spans.
+static FlMethodResponse* handle_dump_trace(FlTextureReproPlugin* self,
+                                           FlValue* args) {
+  const gchar* path = lookup_string(args, "path");
+  if (path == nullptr || path[0] == '\0') {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "INVALID_ARGUMENT", "path is required", nullptr));
+  }
+
+  g_autoptr(GError) error = nullptr;
+  gint64 spans = frame_trace_dump(self->trace, path, &error);
+  if (spans < 0) {
+    return FL_METHOD_RESPONSE(
+        fl_method_error_response_new("TRACE_ERROR", error->message, nullptr));
+  }
+  g_autoptr(FlValue) result = fl_value_new_int(spans);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
 }
 
-// ============================================================================
-// Plugin implementation
-// ============================================================================
+static FlMethodResponse* handle_set_display_size(FlTextureReproPlugin* self,
+                                                 FlValue* args) {
+  GstGLTexture* texture = lookup_texture(self, args);
+  if (texture == nullptr) {
+    return invalid_texture_response();
+  }
 
-#define FL_TEXTURE_REPRO_PLUGIN(obj) \
-  (G_TYPE_CHECK_INSTANCE_CAST((obj), fl_texture_repro_plugin_get_type(), \
-                              FlTextureReproPlugin))
+  int64_t width = lookup_int(args, "width", 0);
+  int64_t height = lookup_int(args, "height", 0);
+  if (width <= 0 || height <= 0) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "INVALID_ARGUMENT", "width and height must be positive", nullptr));
+  }
 
-struct _FlTextureReproPlugin {
-  GObject parent_instance;
-  FlTextureRegistrar* texture_registrar;
-  GstGLTexture* texture;
-  int64_t texture_id;
-  guint timer_id;
-};
+  gst_gl_texture_set_output_size(texture, width, height);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
 
-G_DEFINE_TYPE(FlTextureReproPlugin, fl_texture_repro_plugin, g_object_get_type())
+// Reads the "startFrameTap" arguments:
+//   {"textureId": int, "maxFps": double (0: every frame), "width": int,
+//    "height": int (0: decoded size), "format": "rgba" | "gray" | "i420" |
+//    "nv12"}
+static FlMethodResponse* handle_start_frame_tap(FlTextureReproPlugin* self,
+                                                FlValue* args) {
+  GstGLTexture* texture = lookup_texture(self, args);
+  if (texture == nullptr) {
+    return invalid_texture_response();
+  }
 
-// Timer callback to notify Flutter of new frames
-static gboolean update_texture_callback(gpointer user_data) {
-  FlTextureReproPlugin* self = FL_TEXTURE_REPRO_PLUGIN(user_data);
+  FrameTapConfig config;
+  config.max_fps = 0;
+  FlValue* max_fps = fl_value_lookup_string(args, "maxFps");
+  if (max_fps != nullptr && fl_value_get_type(max_fps) == FL_VALUE_TYPE_FLOAT) {
+    config.max_fps = fl_value_get_float(max_fps);
+  }
+  config.width = lookup_int(args, "width", 0);
+  config.height = lookup_int(args, "height", 0);
+  const gchar* format = lookup_string(args, "format");
+  config.format = frame_tap_parse_format(format != nullptr ? format : "rgba");
+  if (config.format == GST_VIDEO_FORMAT_UNKNOWN || config.max_fps < 0 ||
+      config.width < 0 || config.height < 0 ||
+      config.width > FRAME_TAP_MAX_SIZE || config.height > FRAME_TAP_MAX_SIZE) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "INVALID_ARGUMENT", "Unsupported frame tap configuration", nullptr));
+  }
+
+  gst_gl_texture_set_frame_tap(texture, &config, frame_tap_cb, self);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
 
-  if (self->texture != nullptr && self->texture->has_new_frame) {
-    fl_texture_registrar_mark_texture_frame_available(
-        self->texture_registrar, FL_TEXTURE(self->texture));
+static FlMethodResponse* handle_stop_frame_tap(FlTextureReproPlugin* self,
+                                               FlValue* args) {
+  GstGLTexture* texture = lookup_texture(self, args);
+  if (texture == nullptr) {
+    return invalid_texture_response();
   }
 
-  return G_SOURCE_CONTINUE;
+  gst_gl_texture_set_frame_tap(texture, nullptr, nullptr, nullptr);
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
 }
 
-static void fl_texture_repro_plugin_handle_method_call(
-    FlTextureReproPlugin* self,
-    FlMethodCall* method_call) {
-  g_autoptr(FlMethodResponse) response = nullptr;
-  const gchar* method = fl_method_call_get_name(method_call);
+// Reads the "startRecording" arguments:
+//   {"textureId": int, "path": file to write,
+//    "codec": "h264" | "vp8" | "mjpeg"}
+static FlMethodResponse* handle_start_recording(FlTextureReproPlugin* self,
+                                                FlValue* args) {
+  GstGLTexture* texture = lookup_texture(self, args);
+  if (texture == nullptr) {
+    return invalid_texture_response();
+  }
 
-  if (strcmp(method, "initialize") == 0) {
-    // Create texture
-    self->texture = gst_gl_texture_new();
-
-    // Register with Flutter
-    gboolean registered = fl_texture_registrar_register_texture(
-        self->texture_registrar, FL_TEXTURE(self->texture));
-
-    if (!registered) {
-      g_object_unref(self->texture);
-      self->texture = nullptr;
-      response = FL_METHOD_RESPONSE(
-          fl_method_error_response_new("TEXTURE_ERROR", "Failed to register texture", nullptr));
-      fl_method_call_respond(method_call, response, nullptr);
-      return;
-    }
+  const gchar* path = lookup_string(args, "path");
+  if (path == nullptr || path[0] == '\0') {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "INVALID_ARGUMENT", "path is required", nullptr));
+  }
+  const gchar* codec = lookup_string(args, "codec");
 
-    self->texture_id = fl_texture_get_id(FL_TEXTURE(self->texture));
-
-    // Start GStreamer pipeline
-    if (!gst_gl_texture_start_pipeline(self->texture)) {
-      fl_texture_registrar_unregister_texture(
-          self->texture_registrar, FL_TEXTURE(self->texture));
-      g_object_unref(self->texture);
-      self->texture = nullptr;
-      response = FL_METHOD_RESPONSE(
-          fl_method_error_response_new("PIPELINE_ERROR", "Failed to start GStreamer pipeline", nullptr));
-      fl_method_call_respond(method_call, response, nullptr);
-      return;
-    }
+  g_autoptr(GError) error = nullptr;
+  if (!gst_gl_texture_start_recording(
+          texture, path, codec != nullptr ? codec : "h264", &error)) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "RECORDING_ERROR", error->message, nullptr));
+  }
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
+// Answers the "stopRecording" call held in |user_data| with the path.
+static void recording_done_cb(const gchar* path,
+                              const GError* error,
+                              gpointer user_data) {
+  g_autoptr(FlMethodCall) method_call = FL_METHOD_CALL(user_data);
+  g_autoptr(FlMethodResponse) response = nullptr;
+  if (error != nullptr) {
+    response = FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "RECORDING_ERROR", error->message, nullptr));
+  } else {
+    g_autoptr(FlValue) result = fl_value_new_string(path);
+    response = FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+  }
+  fl_method_call_respond(method_call, response, nullptr);
+}
 
-    // Start timer to check for new frames (~60Hz to ensure we catch all frames)
-    self->timer_id = g_timeout_add(16, update_texture_callback, self);
+// Responds once the file is finalized, which may take a moment while the
+// encoder drains.
+static void handle_stop_recording(FlTextureReproPlugin* self,
+                                  FlMethodCall* method_call) {
+  FlValue* args = fl_method_call_get_args(method_call);
+  GstGLTexture* texture = lookup_texture(self, args);
+  if (texture == nullptr) {
+    g_autoptr(FlMethodResponse) response = invalid_texture_response();
+    fl_method_call_respond(method_call, response, nullptr);
+    return;
+  }
 
-    g_autoptr(FlValue) result = fl_value_new_int(self->texture_id);
+  if (!gst_gl_texture_stop_recording(texture, recording_done_cb,
+                                     g_object_ref(method_call))) {
+    g_object_unref(method_call);
+    g_autoptr(FlMethodResponse) response =
+        FL_METHOD_RESPONSE(fl_method_error_response_new(
+            "NOT_RECORDING", "No recording in progress", nullptr));
+    fl_method_call_respond(method_call, response, nullptr);
+  }
+}
+
+// Answers the "captureStill" call held in |user_data|: the JPEG bytes, or
+// the path if the call named one.
+static void still_captured_cb(GBytes* jpeg,
+                              const GError* error,
+                              gpointer user_data) {
+  g_autoptr(FlMethodCall) method_call = FL_METHOD_CALL(user_data);
+  g_autoptr(FlMethodResponse) response = nullptr;
+  if (error != nullptr) {
+    response = FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "CAPTURE_ERROR", error->message, nullptr));
+  } else {
+    const gchar* path =
+        lookup_string(fl_method_call_get_args(method_call), "path");
+    gsize size = 0;
+    const uint8_t* data =
+        static_cast<const uint8_t*>(g_bytes_get_data(jpeg, &size));
+    g_autoptr(FlValue) result = path != nullptr
+                                    ? fl_value_new_string(path)
+                                    : fl_value_new_uint8_list(data, size);
     response = FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+  }
+  fl_method_call_respond(method_call, response, nullptr);
+}
 
-  } else if (strcmp(method, "dispose") == 0) {
-    if (self->timer_id != 0) {
-      g_source_remove(self->timer_id);
-      self->timer_id = 0;
-    }
+// Reads the "captureStill" arguments:
+//   {"textureId": int, "path": optional file to write the JPEG to}
+// and responds once the next full-resolution frame has been captured.
+static void handle_capture_still(FlTextureReproPlugin* self,
+                                 FlMethodCall* method_call) {
+  FlValue* args = fl_method_call_get_args(method_call);
+  GstGLTexture* texture = lookup_texture(self, args);
+  if (texture == nullptr) {
+    g_autoptr(FlMethodResponse) response = invalid_texture_response();
+    fl_method_call_respond(method_call, response, nullptr);
+    return;
+  }
 
-    if (self->texture != nullptr) {
-      gst_gl_texture_stop_pipeline(self->texture);
-      fl_texture_registrar_unregister_texture(
-          self->texture_registrar, FL_TEXTURE(self->texture));
-      g_object_unref(self->texture);
-      self->texture = nullptr;
-    }
+  if (!gst_gl_texture_capture_still(texture, lookup_string(args, "path"),
+                                    still_captured_cb,
+                                    g_object_ref(method_call))) {
+    g_object_unref(method_call);
+    g_autoptr(FlMethodResponse) response =
+        FL_METHOD_RESPONSE(fl_method_error_response_new(
+            "PIPELINE_ERROR", "Pipeline is not running", nullptr));
+    fl_method_call_respond(method_call, response, nullptr);
+  }
+}
 
-    response = FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+static void fl_texture_repro_plugin_handle_method_call(
+    FlTextureReproPlugin* self,
+    FlMethodCall* method_call) {
+  g_autoptr(FlMethodResponse) response = nullptr;
+  const gchar* method = fl_method_call_get_name(method_call);
+  FlValue* args = fl_method_call_get_args(method_call);
 
+  if (strcmp(method, "initialize") == 0) {
+    response = handle_initialize(self, args);
+  } else if (strcmp(method, "createView") == 0) {
+    response = handle_create_view(self, args);
+  } else if (strcmp(method, "dispose") == 0) {
+    response = handle_dispose(self, args);
+  } else if (strcmp(method, "play") == 0) {
+    response = handle_play(self, args);
+  } else if (strcmp(method, "pause") == 0) {
+    response = handle_set_paused(self, args, TRUE);
+  } else if (strcmp(method, "resume") == 0) {
+    response = handle_set_paused(self, args, FALSE);
+  } else if (strcmp(method, "getStats") == 0) {
+    response = handle_get_stats(self, args);
+  } else if (strcmp(method, "setDisplaySize") == 0) {
+    response = handle_set_display_size(self, args);
+  } else if (strcmp(method, "setTracing") == 0) {
+    response = handle_set_tracing(self, args);
+  } else if (strcmp(method, "dumpTrace") == 0) {
+    response = handle_dump_trace(self, args);
+  } else if (strcmp(method, "startFrameTap") == 0) {
+    response = handle_start_frame_tap(self, args);
+  } else if (strcmp(method, "stopFrameTap") == 0) {
+    response = handle_stop_frame_tap(self, args);
+  } else if (strcmp(method, "startRecording") == 0) {
+    response = handle_start_recording(self, args);
+  } else if (strcmp(method, "stopRecording") == 0) {
+    handle_stop_recording(self, method_call);
+    return;
+  } else if (strcmp(method, "captureStill") == 0) {
+    handle_capture_still(self, method_call);
+    return;
   } else {
     response = FL_METHOD_RESPONSE(fl_method_not_implemented_response_new());
   }
@@ -355,29 +650,48 @@ static void fl_texture_repro_plugin_handle_method_call(
 static void fl_texture_repro_plugin_dispose(GObject* object) {
   FlTextureReproPlugin* self = FL_TEXTURE_REPRO_PLUGIN(object);
 
-  if (self->timer_id != 0) {
-    g_source_remove(self->timer_id);
-    self->timer_id = 0;
-  }
-
-  if (self->texture != nullptr) {
-    gst_gl_texture_stop_pipeline(self->texture);
-    g_object_unref(self->texture);
-    self->texture = nullptr;
+  if (self->textures != nullptr) {
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, self->textures);
+    while (g_hash_table_iter_next(&iter, nullptr, &value)) {
+      gst_gl_texture_stop_pipeline(GST_GL_TEXTURE(value));
+      gst_gl_texture_set_frame_callback(GST_GL_TEXTURE(value), nullptr,
+                                        nullptr);
+      gst_gl_texture_set_frame_tap(GST_GL_TEXTURE(value), nullptr, nullptr,
+                                   nullptr);
+    }
+    g_clear_pointer(&self->textures, g_hash_table_unref);
   }
+  g_clear_object(&self->frames_channel);
+  g_clear_object(&self->events_channel);
 
   G_OBJECT_CLASS(fl_texture_repro_plugin_parent_class)->dispose(object);
 }
 
+// The trace goes last, once dispose has stopped every pipeline recording
+// into it.
+static void fl_texture_repro_plugin_finalize(GObject* object) {
+  FlTextureReproPlugin* self = FL_TEXTURE_REPRO_PLUGIN(object);
+
+  frame_trace_free(self->trace);
+
+  G_OBJECT_CLASS(fl_texture_repro_plugin_parent_class)->finalize(object);
+}
+
 static void fl_texture_repro_plugin_class_init(FlTextureReproPluginClass* klass) {
   G_OBJECT_CLASS(klass)->dispose = fl_texture_repro_plugin_dispose;
+  G_OBJECT_CLASS(klass)->finalize = fl_texture_repro_plugin_finalize;
 }
 
 static void fl_texture_repro_plugin_init(FlTextureReproPlugin* self) {
   self->texture_registrar = nullptr;
-  self->texture = nullptr;
-  self->texture_id = -1;
-  self->timer_id = 0;
+  self->frames_channel = nullptr;
+  self->events_channel = nullptr;
+  self->textures = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free,
+                                         g_object_unref);
+  self->trace = frame_trace_new(FRAME_TRACE_DEFAULT_CAPACITY);
+  self->dispatch_pending = 0;
 }
 
 static void method_call_cb(FlMethodChannel* channel, FlMethodCall* method_call,
@@ -402,5 +716,16 @@ void fl_texture_repro_plugin_register_with_registrar(FlPluginRegistrar* registra
                                             g_object_ref(plugin),
                                             g_object_unref);
 
+  // Tapped frames and pipeline events go out on their own channels so they
+  // never queue behind method calls.
+  g_autoptr(FlStandardMessageCodec) message_codec =
+      fl_standard_message_codec_new();
+  plugin->frames_channel = fl_basic_message_channel_new(
+      fl_plugin_registrar_get_messenger(registrar), "fl_texture_repro/frames",
+      FL_MESSAGE_CODEC(message_codec));
+  plugin->events_channel = fl_basic_message_channel_new(
+      fl_plugin_registrar_get_messenger(registrar), "fl_texture_repro/events",
+      FL_MESSAGE_CODEC(message_codec));
+
   g_object_unref(plugin);
 }
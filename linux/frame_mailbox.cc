@@ -0,0 +1,39 @@
+#include "frame_mailbox.h"
+
+#define FRAME_MAILBOX_FRESH 4u
+#define FRAME_MAILBOX_INDEX_MASK 3u
+
+void frame_mailbox_init(FrameMailbox* mailbox) {
+  mailbox->back = 0;
+  mailbox->middle.store(1, std::memory_order_relaxed);
+  mailbox->front = 2;
+}
+
+gboolean frame_mailbox_publish(FrameMailbox* mailbox) {
+  // Release makes the slot contents visible to the consumer that acquires
+  // it; acquire makes the consumer's last reads of the returned slot happen
+  // before we overwrite it.
+  guint previous = mailbox->middle.exchange(
+      mailbox->back | FRAME_MAILBOX_FRESH, std::memory_order_acq_rel);
+  mailbox->back = previous & FRAME_MAILBOX_INDEX_MASK;
+  return (previous & FRAME_MAILBOX_FRESH) != 0;
+}
+
+gboolean frame_mailbox_acquire(FrameMailbox* mailbox) {
+  if ((mailbox->middle.load(std::memory_order_relaxed) &
+       FRAME_MAILBOX_FRESH) == 0) {
+    return FALSE;
+  }
+
+  // Only the producer can change |middle| in between, and it only ever
+  // stores fresh slots, so the exchange always yields a fresh frame.
+  guint previous =
+      mailbox->middle.exchange(mailbox->front, std::memory_order_acq_rel);
+  mailbox->front = previous & FRAME_MAILBOX_INDEX_MASK;
+  return TRUE;
+}
+
+gboolean frame_mailbox_has_new_frame(const FrameMailbox* mailbox) {
+  return (mailbox->middle.load(std::memory_order_relaxed) &
+          FRAME_MAILBOX_FRESH) != 0;
+}
@@ -0,0 +1,54 @@
+#ifndef FL_TEXTURE_REPRO_FRAME_MAILBOX_H_
+#define FL_TEXTURE_REPRO_FRAME_MAILBOX_H_
+
+#include <glib.h>
+
+#include <atomic>
+
+// Latest-frame-wins triple buffer between one producer (the GStreamer
+// streaming thread) and one consumer (Flutter's raster thread).
+//
+// The caller keeps FRAME_MAILBOX_SLOTS frame slots; the mailbox only hands
+// out slot indices. At any time the producer owns one slot (back), the
+// consumer owns one (front) and the third is parked in |middle|. Publishing
+// and acquiring are single atomic exchanges, so neither side ever waits for
+// the other: the producer overwrites a parked frame the consumer has not
+// taken yet, and the consumer keeps its current frame when nothing new has
+// been published.
+#define FRAME_MAILBOX_SLOTS 3
+
+typedef struct {
+  // Index of the parked slot, plus FRAME_MAILBOX_FRESH if it holds a frame
+  // published since the consumer last acquired.
+  std::atomic<guint> middle;
+  guint back;   // Producer only
+  guint front;  // Consumer only
+} FrameMailbox;
+
+void frame_mailbox_init(FrameMailbox* mailbox);
+
+// Slot the producer may fill. Stays the same until frame_mailbox_publish().
+static inline guint frame_mailbox_back(const FrameMailbox* mailbox) {
+  return mailbox->back;
+}
+
+// Hands the filled back slot to the consumer and takes the parked slot as
+// the new back slot. Returns TRUE if the parked slot held a frame the
+// consumer never acquired, i.e. a frame was dropped.
+gboolean frame_mailbox_publish(FrameMailbox* mailbox);
+
+// Slot the consumer may read. Stays the same until the next successful
+// frame_mailbox_acquire().
+static inline guint frame_mailbox_front(const FrameMailbox* mailbox) {
+  return mailbox->front;
+}
+
+// Takes the latest published frame as the new front slot. Returns FALSE,
+// leaving the front slot unchanged, if nothing was published since the last
+// acquire.
+gboolean frame_mailbox_acquire(FrameMailbox* mailbox);
+
+// Whether a frame was published since the last acquire. Any thread.
+gboolean frame_mailbox_has_new_frame(const FrameMailbox* mailbox);
+
+#endif  // FL_TEXTURE_REPRO_FRAME_MAILBOX_H_
@@ -0,0 +1,153 @@
+#include "frame_tap.h"
+
+struct _FrameTapConverter {
+  GstVideoConverter* converter;
+  GstVideoInfo in_info;   // Formats the converter was created for
+  GstVideoInfo out_info;
+  guint8* scratch;        // Converted frame, out_info.size bytes
+};
+
+GstVideoFormat frame_tap_parse_format(const gchar* name) {
+  if (g_strcmp0(name, "rgba") == 0) {
+    return GST_VIDEO_FORMAT_RGBA;
+  } else if (g_strcmp0(name, "gray") == 0) {
+    return GST_VIDEO_FORMAT_GRAY8;
+  } else if (g_strcmp0(name, "i420") == 0) {
+    return GST_VIDEO_FORMAT_I420;
+  } else if (g_strcmp0(name, "nv12") == 0) {
+    return GST_VIDEO_FORMAT_NV12;
+  }
+  return GST_VIDEO_FORMAT_UNKNOWN;
+}
+
+static const gchar* format_name(GstVideoFormat format) {
+  switch (format) {
+    case GST_VIDEO_FORMAT_RGBA:
+      return "rgba";
+    case GST_VIDEO_FORMAT_GRAY8:
+      return "gray";
+    case GST_VIDEO_FORMAT_I420:
+      return "i420";
+    case GST_VIDEO_FORMAT_NV12:
+      return "nv12";
+    default:
+      return "unknown";
+  }
+}
+
+FrameTapConverter* frame_tap_converter_new() {
+  FrameTapConverter* self = g_new0(FrameTapConverter, 1);
+  gst_video_info_init(&self->in_info);
+  gst_video_info_init(&self->out_info);
+  return self;
+}
+
+void frame_tap_converter_free(FrameTapConverter* self) {
+  g_clear_pointer(&self->converter, gst_video_converter_free);
+  g_free(self->scratch);
+  g_free(self);
+}
+
+// Builds the message for a frame laid out as |info| in |data|.
+static FlValue* new_frame_message(const GstVideoInfo* info,
+                                  const guint8* data,
+                                  gsize size,
+                                  GstClockTime pts) {
+  FlValue* message = fl_value_new_map();
+  fl_value_set_string_take(message, "width",
+                           fl_value_new_int(GST_VIDEO_INFO_WIDTH(info)));
+  fl_value_set_string_take(message, "height",
+                           fl_value_new_int(GST_VIDEO_INFO_HEIGHT(info)));
+  fl_value_set_string_take(
+      message, "format",
+      fl_value_new_string(format_name(GST_VIDEO_INFO_FORMAT(info))));
+
+  FlValue* strides = fl_value_new_list();
+  FlValue* offsets = fl_value_new_list();
+  for (guint i = 0; i < GST_VIDEO_INFO_N_PLANES(info); i++) {
+    fl_value_append_take(strides,
+                         fl_value_new_int(GST_VIDEO_INFO_PLANE_STRIDE(info, i)));
+    fl_value_append_take(offsets,
+                         fl_value_new_int(GST_VIDEO_INFO_PLANE_OFFSET(info, i)));
+  }
+  fl_value_set_string_take(message, "strides", strides);
+  fl_value_set_string_take(message, "offsets", offsets);
+
+  fl_value_set_string_take(
+      message, "ptsUs",
+      fl_value_new_int(GST_CLOCK_TIME_IS_VALID(pts) ? pts / GST_USECOND : -1));
+  fl_value_set_string_take(message, "bytes",
+                           fl_value_new_uint8_list(data, size));
+  return message;
+}
+
+FlValue* frame_tap_converter_process(FrameTapConverter* self,
+                                     const FrameTapConfig* config,
+                                     GstSample* sample) {
+  GstVideoInfo in_info;
+  if (!gst_video_info_from_caps(&in_info, gst_sample_get_caps(sample))) {
+    return nullptr;
+  }
+  GstBuffer* buffer = gst_sample_get_buffer(sample);
+
+  gint width = config->width > 0 ? config->width : GST_VIDEO_INFO_WIDTH(&in_info);
+  gint height =
+      config->height > 0 ? config->height : GST_VIDEO_INFO_HEIGHT(&in_info);
+  GstVideoInfo out_info;
+  gst_video_info_set_format(&out_info, config->format, width, height);
+  // Between YUV formats keep the source matrix and range, so the planes are
+  // only resampled.
+  if (!GST_VIDEO_INFO_IS_RGB(&in_info) && !GST_VIDEO_INFO_IS_RGB(&out_info)) {
+    out_info.colorimetry = in_info.colorimetry;
+  }
+
+  // Already what the subscriber wants: a single copy into the message.
+  if (GST_VIDEO_INFO_FORMAT(&in_info) == config->format &&
+      GST_VIDEO_INFO_WIDTH(&in_info) == width &&
+      GST_VIDEO_INFO_HEIGHT(&in_info) == height) {
+    GstMapInfo map;
+    if (!gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+      return nullptr;
+    }
+    FlValue* message = new_frame_message(&in_info, map.data, map.size,
+                                         GST_BUFFER_PTS(buffer));
+    gst_buffer_unmap(buffer, &map);
+    return message;
+  }
+
+  if (self->converter == nullptr ||
+      !gst_video_info_is_equal(&self->in_info, &in_info) ||
+      !gst_video_info_is_equal(&self->out_info, &out_info)) {
+    g_clear_pointer(&self->converter, gst_video_converter_free);
+    self->converter = gst_video_converter_new(&in_info, &out_info, nullptr);
+    if (self->converter == nullptr) {
+      return nullptr;
+    }
+    self->in_info = in_info;
+    self->out_info = out_info;
+    g_free(self->scratch);
+    self->scratch = static_cast<guint8*>(g_malloc(out_info.size));
+  }
+
+  GstVideoFrame in_frame;
+  if (!gst_video_frame_map(&in_frame, &in_info, buffer, GST_MAP_READ)) {
+    return nullptr;
+  }
+  GstBuffer* out_buffer = gst_buffer_new_wrapped_full(
+      static_cast<GstMemoryFlags>(0), self->scratch, out_info.size, 0,
+      out_info.size, nullptr, nullptr);
+  GstVideoFrame out_frame;
+  if (!gst_video_frame_map(&out_frame, &out_info, out_buffer, GST_MAP_WRITE)) {
+    gst_video_frame_unmap(&in_frame);
+    gst_buffer_unref(out_buffer);
+    return nullptr;
+  }
+
+  gst_video_converter_frame(self->converter, &in_frame, &out_frame);
+  gst_video_frame_unmap(&out_frame);
+  gst_video_frame_unmap(&in_frame);
+  gst_buffer_unref(out_buffer);
+
+  return new_frame_message(&out_info, self->scratch, out_info.size,
+                           GST_BUFFER_PTS(buffer));
+}
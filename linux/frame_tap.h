@@ -0,0 +1,43 @@
+#ifndef FL_TEXTURE_REPRO_FRAME_TAP_H_
+#define FL_TEXTURE_REPRO_FRAME_TAP_H_
+
+#include <flutter_linux/flutter_linux.h>
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+
+// Largest width or height a frame tap may ask for
+#define FRAME_TAP_MAX_SIZE 4096
+
+// What a frame tap subscriber asked for.
+typedef struct {
+  gdouble max_fps;        // 0 for every frame
+  gint width;             // 0 to keep the decoded size
+  gint height;
+  GstVideoFormat format;  // RGBA, GRAY8, I420 or NV12
+} FrameTapConfig;
+
+// Maps the "format" argument ("rgba", "gray", "i420", "nv12") to a video
+// format, or GST_VIDEO_FORMAT_UNKNOWN if it is not supported.
+GstVideoFormat frame_tap_parse_format(const gchar* name);
+
+// Converts tapped samples into frame messages. Keeps the GstVideoConverter
+// and output buffer between frames; not thread safe, but may move between
+// threads as long as calls do not overlap.
+typedef struct _FrameTapConverter FrameTapConverter;
+
+FrameTapConverter* frame_tap_converter_new();
+
+void frame_tap_converter_free(FrameTapConverter* converter);
+
+// Returns a new map with "width", "height", "format", "strides",
+// "offsets", "ptsUs" and "bytes" for |sample| converted as |config| asks,
+// or nullptr if the sample cannot be read. Samples already in the requested
+// format and size are copied straight from the mapped buffer.
+FlValue* frame_tap_converter_process(FrameTapConverter* converter,
+                                     const FrameTapConfig* config,
+                                     GstSample* sample);
+
+G_END_DECLS
+
+#endif  // FL_TEXTURE_REPRO_FRAME_TAP_H_
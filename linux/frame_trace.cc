@@ -0,0 +1,158 @@
+#include "frame_trace.h"
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+
+// A slot is guarded like a seqlock: |seq| is 0 while a writer fills it and
+// the event's index + 1 once it is complete, so a dump running concurrently
+// can tell a torn read from a whole one.
+typedef struct {
+  std::atomic<uint64_t> seq;
+  std::atomic<const gchar*> name;
+  std::atomic<gint64> start;
+  std::atomic<gint64> duration;
+  std::atomic<gint64> arg;
+  std::atomic<gint> tid;
+} FrameTraceEvent;
+
+struct _FrameTrace {
+  std::atomic<gboolean> enabled;
+  std::atomic<uint64_t> next;  // Index of the next event to record
+  guint capacity;              // Power of two
+  FrameTraceEvent* events;
+};
+
+// Kernel thread ID of the caller, which is what /proc and Perfetto use.
+static gint current_tid() {
+  static thread_local gint tid = 0;
+  if (tid == 0) {
+    tid = syscall(SYS_gettid);
+  }
+  return tid;
+}
+
+FrameTrace* frame_trace_new(guint capacity) {
+  FrameTrace* trace = new FrameTrace();
+  trace->enabled.store(FALSE, std::memory_order_relaxed);
+  trace->next.store(0, std::memory_order_relaxed);
+  trace->capacity = 1;
+  while (trace->capacity < capacity) {
+    trace->capacity <<= 1;
+  }
+  trace->events = new FrameTraceEvent[trace->capacity]();
+  return trace;
+}
+
+void frame_trace_free(FrameTrace* trace) {
+  delete[] trace->events;
+  delete trace;
+}
+
+void frame_trace_set_enabled(FrameTrace* trace, gboolean enabled) {
+  if (enabled && !trace->enabled.load(std::memory_order_relaxed)) {
+    // Spans recorded right now by a thread that has not seen the reset may
+    // survive it; that only adds a stray span to the next dump.
+    for (guint i = 0; i < trace->capacity; i++) {
+      trace->events[i].seq.store(0, std::memory_order_relaxed);
+    }
+    trace->next.store(0, std::memory_order_relaxed);
+  }
+  trace->enabled.store(enabled, std::memory_order_release);
+}
+
+gint64 frame_trace_begin(FrameTrace* trace) {
+  if (trace == nullptr || !trace->enabled.load(std::memory_order_relaxed)) {
+    return 0;
+  }
+  return g_get_monotonic_time();
+}
+
+void frame_trace_end(FrameTrace* trace,
+                     const gchar* name,
+                     gint64 start,
+                     gint64 arg) {
+  if (start == 0) {
+    return;
+  }
+  gint64 now = g_get_monotonic_time();
+  uint64_t index = trace->next.fetch_add(1, std::memory_order_relaxed);
+  FrameTraceEvent* event = &trace->events[index & (trace->capacity - 1)];
+
+  event->seq.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  event->name.store(name, std::memory_order_relaxed);
+  event->start.store(start, std::memory_order_relaxed);
+  event->duration.store(now - start, std::memory_order_relaxed);
+  event->arg.store(arg, std::memory_order_relaxed);
+  event->tid.store(current_tid(), std::memory_order_relaxed);
+  event->seq.store(index + 1, std::memory_order_release);
+}
+
+// Appends a thread_name metadata event so the timeline shows GStreamer's
+// thread names instead of bare IDs.
+static void append_thread_name(GString* out, gint pid, gint tid) {
+  g_autofree gchar* path = g_strdup_printf("/proc/self/task/%d/comm", tid);
+  g_autofree gchar* name = nullptr;
+  if (!g_file_get_contents(path, &name, nullptr, nullptr)) {
+    return;
+  }
+  g_strchomp(name);
+  g_autofree gchar* escaped = g_strescape(name, nullptr);
+  g_string_append_printf(out,
+                         ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+                         "\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                         pid, tid, escaped);
+}
+
+gint64 frame_trace_dump(FrameTrace* trace, const gchar* path, GError** error) {
+  gint pid = getpid();
+  uint64_t end = trace->next.load(std::memory_order_acquire);
+  uint64_t begin = end > trace->capacity ? end - trace->capacity : 0;
+
+  g_autoptr(GString) out = g_string_new("{\"traceEvents\":[");
+  g_autoptr(GHashTable) tids = g_hash_table_new(g_direct_hash, g_direct_equal);
+  gint64 written = 0;
+  for (uint64_t index = begin; index < end; index++) {
+    FrameTraceEvent* event = &trace->events[index & (trace->capacity - 1)];
+    uint64_t seq = event->seq.load(std::memory_order_acquire);
+    const gchar* name = event->name.load(std::memory_order_relaxed);
+    gint64 start = event->start.load(std::memory_order_relaxed);
+    gint64 duration = event->duration.load(std::memory_order_relaxed);
+    gint64 arg = event->arg.load(std::memory_order_relaxed);
+    gint tid = event->tid.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    // Still being written, or already overwritten by a newer span.
+    if (seq != index + 1 ||
+        event->seq.load(std::memory_order_relaxed) != seq) {
+      continue;
+    }
+
+    g_string_append_printf(
+        out,
+        "%s\n{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"X\","
+        "\"ts\":%" G_GINT64_FORMAT ",\"dur\":%" G_GINT64_FORMAT
+        ",\"pid\":%d,\"tid\":%d,\"args\":{\"texture\":%" G_GINT64_FORMAT
+        "}}",
+        written > 0 ? "," : "", name, start, duration, pid, tid, arg);
+    g_hash_table_add(tids, GINT_TO_POINTER(tid));
+    written++;
+  }
+
+  if (written > 0) {
+    GHashTableIter iter;
+    gpointer tid;
+    g_hash_table_iter_init(&iter, tids);
+    while (g_hash_table_iter_next(&iter, &tid, nullptr)) {
+      append_thread_name(out, pid, GPOINTER_TO_INT(tid));
+    }
+  }
+  g_string_append(out, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+  if (!g_file_set_contents(path, out->str, out->len, error)) {
+    return -1;
+  }
+  return written;
+}
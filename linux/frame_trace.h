@@ -0,0 +1,47 @@
+#ifndef FL_TEXTURE_REPRO_FRAME_TRACE_H_
+#define FL_TEXTURE_REPRO_FRAME_TRACE_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+// Timeline of the stages a frame goes through, for finding which one was
+// slow when the preview janks. Spans are recorded into a ring allocated up
+// front: recording claims a slot with one atomic add and never blocks or
+// allocates, so any thread can record, and once the ring is full the oldest
+// spans are overwritten. While disabled, frame_trace_begin() costs a single
+// relaxed load and nothing is recorded.
+//
+// frame_trace_dump() writes the ring as Chrome trace-event JSON, which
+// Perfetto (ui.perfetto.dev) and chrome://tracing open directly.
+typedef struct _FrameTrace FrameTrace;
+
+// Number of spans kept by default
+#define FRAME_TRACE_DEFAULT_CAPACITY 8192
+
+// |capacity| is rounded up to a power of two. Starts disabled.
+FrameTrace* frame_trace_new(guint capacity);
+
+void frame_trace_free(FrameTrace* trace);
+
+// Starting clears the spans recorded before.
+void frame_trace_set_enabled(FrameTrace* trace, gboolean enabled);
+
+// Returns the start time of a span, or 0 if |trace| is nullptr or disabled.
+gint64 frame_trace_begin(FrameTrace* trace);
+
+// Records the span |name| from |start| (as returned by frame_trace_begin())
+// to now on the calling thread. |name| must be a static string. |arg| is
+// shown with the span, e.g. the texture ID. Does nothing if |start| is 0.
+void frame_trace_end(FrameTrace* trace,
+                     const gchar* name,
+                     gint64 start,
+                     gint64 arg);
+
+// Writes the recorded spans to |path|. Returns the number of spans written,
+// or -1 with |error| set.
+gint64 frame_trace_dump(FrameTrace* trace, const gchar* path, GError** error);
+
+G_END_DECLS
+
+#endif  // FL_TEXTURE_REPRO_FRAME_TRACE_H_
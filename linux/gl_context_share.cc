@@ -0,0 +1,101 @@
+// epoxy must come before anything that may pull in the system GL headers.
+#include <epoxy/egl.h>
+
+#include "gl_context_share.h"
+
+#if GST_GL_HAVE_PLATFORM_EGL
+#include <gst/gl/egl/gstgldisplay_egl.h>
+#endif
+
+#if GST_GL_HAVE_PLATFORM_GLX && GST_GL_HAVE_WINDOW_X11
+#include <epoxy/glx.h>
+#include <gst/gl/x11/gstgldisplay_x11.h>
+#endif
+
+gboolean gl_context_share_wrap_current(GstGLDisplay** display,
+                                       GstGLContext** context) {
+  GstGLPlatform platform = GST_GL_PLATFORM_NONE;
+  guintptr handle = 0;
+  GstGLDisplay* gl_display = nullptr;
+
+#if GST_GL_HAVE_PLATFORM_EGL
+  handle = gst_gl_context_get_current_gl_context(GST_GL_PLATFORM_EGL);
+  if (handle != 0) {
+    platform = GST_GL_PLATFORM_EGL;
+    gl_display = GST_GL_DISPLAY(
+        gst_gl_display_egl_new_with_egl_display(eglGetCurrentDisplay()));
+  }
+#endif
+
+#if GST_GL_HAVE_PLATFORM_GLX && GST_GL_HAVE_WINDOW_X11
+  if (handle == 0) {
+    handle = gst_gl_context_get_current_gl_context(GST_GL_PLATFORM_GLX);
+    if (handle != 0) {
+      platform = GST_GL_PLATFORM_GLX;
+      gl_display = GST_GL_DISPLAY(
+          gst_gl_display_x11_new_with_display(glXGetCurrentDisplay()));
+    }
+  }
+#endif
+
+  if (handle == 0 || gl_display == nullptr) {
+    g_warning("GL sharing: no current EGL or GLX context to share");
+    if (gl_display != nullptr) {
+      gst_object_unref(gl_display);
+    }
+    return FALSE;
+  }
+
+  guint major = 0, minor = 0;
+  GstGLAPI api = gst_gl_context_get_current_gl_api(platform, &major, &minor);
+  GstGLContext* gl_context =
+      gst_gl_context_new_wrapped(gl_display, handle, platform, api);
+  if (gl_context == nullptr) {
+    g_warning("GL sharing: failed to wrap the current GL context");
+    gst_object_unref(gl_display);
+    return FALSE;
+  }
+
+  // Wrapped contexts have no GL thread of their own: activating binds it to
+  // this thread so gst_gl_sync_meta_wait() etc. run here directly.
+  GError* error = nullptr;
+  if (!gst_gl_context_activate(gl_context, TRUE) ||
+      !gst_gl_context_fill_info(gl_context, &error)) {
+    g_warning("GL sharing: failed to query the wrapped context: %s",
+              error != nullptr ? error->message : "activation failed");
+    g_clear_error(&error);
+    gst_object_unref(gl_context);
+    gst_object_unref(gl_display);
+    return FALSE;
+  }
+
+  *display = gl_display;
+  *context = gl_context;
+  return TRUE;
+}
+
+gboolean gl_context_share_handle_need_context(GstMessage* message,
+                                              GstGLDisplay* display,
+                                              GstGLContext* context) {
+  const gchar* context_type = nullptr;
+  if (!gst_message_parse_context_type(message, &context_type)) {
+    return FALSE;
+  }
+
+  GstContext* gst_context = nullptr;
+  if (g_strcmp0(context_type, GST_GL_DISPLAY_CONTEXT_TYPE) == 0) {
+    gst_context = gst_context_new(GST_GL_DISPLAY_CONTEXT_TYPE, TRUE);
+    gst_context_set_gl_display(gst_context, display);
+  } else if (g_strcmp0(context_type, "gst.gl.app_context") == 0) {
+    gst_context = gst_context_new("gst.gl.app_context", TRUE);
+    GstStructure* structure = gst_context_writable_structure(gst_context);
+    gst_structure_set(structure, "context", GST_TYPE_GL_CONTEXT, context,
+                      nullptr);
+  } else {
+    return FALSE;
+  }
+
+  gst_element_set_context(GST_ELEMENT(GST_MESSAGE_SRC(message)), gst_context);
+  gst_context_unref(gst_context);
+  return TRUE;
+}
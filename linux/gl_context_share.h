@@ -0,0 +1,24 @@
+#ifndef FL_TEXTURE_REPRO_GL_CONTEXT_SHARE_H_
+#define FL_TEXTURE_REPRO_GL_CONTEXT_SHARE_H_
+
+#include <gst/gl/gl.h>
+
+G_BEGIN_DECLS
+
+// Wraps the GL context current on the calling thread (Flutter's raster
+// context when called from populate) so GStreamer's GL elements can create a
+// context sharing textures with it. Tries EGL first, then GLX. On success the
+// wrapped context is activated on the calling thread and both out parameters
+// hold new references.
+gboolean gl_context_share_wrap_current(GstGLDisplay** display,
+                                       GstGLContext** context);
+
+// Answers a GST_MESSAGE_NEED_CONTEXT for the GL display or the application
+// context with |display| / |context|. Returns TRUE if the message was handled.
+gboolean gl_context_share_handle_need_context(GstMessage* message,
+                                              GstGLDisplay* display,
+                                              GstGLContext* context);
+
+G_END_DECLS
+
+#endif  // FL_TEXTURE_REPRO_GL_CONTEXT_SHARE_H_
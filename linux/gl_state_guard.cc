@@ -0,0 +1,352 @@
+#include "gl_state_guard.h"
+
+#include <cstring>
+
+// glGet names of the items, in GlStateGuardItem order. The capabilities
+// are read with glGetIntegerv too, which GL and GLES both allow.
+static const GLenum kQueries[GL_STATE_GUARD_N_ITEMS] = {
+    GL_ACTIVE_TEXTURE,
+    GL_UNPACK_ALIGNMENT,
+    GL_UNPACK_ROW_LENGTH,
+    GL_PIXEL_UNPACK_BUFFER_BINDING,
+    GL_DRAW_FRAMEBUFFER_BINDING,
+    GL_READ_FRAMEBUFFER_BINDING,
+    GL_CURRENT_PROGRAM,
+    GL_VERTEX_ARRAY_BINDING,
+    GL_BLEND,
+    GL_SCISSOR_TEST,
+    GL_DEPTH_TEST,
+    GL_STENCIL_TEST,
+    GL_CULL_FACE,
+};
+
+static guint64 slot_bit(guint slot) {
+  return G_GUINT64_CONSTANT(1) << slot;
+}
+
+static const guint64 kTextureSlots =
+    ((G_GUINT64_CONSTANT(1) << GL_STATE_GUARD_TEXTURE_UNITS) - 1)
+    << GL_STATE_GUARD_N_ITEMS;
+
+static void apply(GlStateGuardItem item, GLint value) {
+  switch (item) {
+    case GL_STATE_GUARD_ACTIVE_TEXTURE:
+      glActiveTexture(value);
+      break;
+    case GL_STATE_GUARD_UNPACK_ALIGNMENT:
+      glPixelStorei(GL_UNPACK_ALIGNMENT, value);
+      break;
+    case GL_STATE_GUARD_UNPACK_ROW_LENGTH:
+      glPixelStorei(GL_UNPACK_ROW_LENGTH, value);
+      break;
+    case GL_STATE_GUARD_PIXEL_UNPACK_BUFFER:
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, value);
+      break;
+    case GL_STATE_GUARD_DRAW_FRAMEBUFFER:
+      glBindFramebuffer(GL_DRAW_FRAMEBUFFER, value);
+      break;
+    case GL_STATE_GUARD_READ_FRAMEBUFFER:
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, value);
+      break;
+    case GL_STATE_GUARD_PROGRAM:
+      glUseProgram(value);
+      break;
+    case GL_STATE_GUARD_VERTEX_ARRAY:
+      glBindVertexArray(value);
+      break;
+    case GL_STATE_GUARD_BLEND:
+    case GL_STATE_GUARD_SCISSOR_TEST:
+    case GL_STATE_GUARD_DEPTH_TEST:
+    case GL_STATE_GUARD_STENCIL_TEST:
+    case GL_STATE_GUARD_CULL_FACE:
+      if (value) {
+        glEnable(kQueries[item]);
+      } else {
+        glDisable(kQueries[item]);
+      }
+      break;
+    default:
+      g_assert_not_reached();
+  }
+}
+
+static gboolean tracking(const GlStateGuard* guard) {
+  return guard->enabled || guard->in_pass;
+}
+
+// Makes sure the shadow has |slot|. Texture slots are only read for the
+// active unit.
+static void read(GlStateGuard* guard, guint slot) {
+  if (guard->shadow.mask & slot_bit(slot)) {
+    return;
+  }
+  glGetIntegerv(slot < GL_STATE_GUARD_N_ITEMS ? kQueries[slot]
+                                              : GL_TEXTURE_BINDING_2D,
+                &guard->shadow.values[slot]);
+  guard->shadow.mask |= slot_bit(slot);
+}
+
+// Keeps the value |slot| has before its first change in the scope and in
+// the pass.
+static void save(GlStateGuard* guard, guint slot) {
+  guint64 bit = slot_bit(slot);
+  if (guard->enabled && !(guard->scope.mask & bit)) {
+    guard->scope.values[slot] = guard->shadow.values[slot];
+    guard->scope.mask |= bit;
+  }
+  if (guard->in_pass && !(guard->pass.mask & bit)) {
+    guard->pass.values[slot] = guard->shadow.values[slot];
+    guard->pass.mask |= bit;
+  }
+}
+
+// Sets |item| to |value| unless the shadow says it already is.
+static void set(GlStateGuard* guard, GlStateGuardItem item, GLint value) {
+  if (!tracking(guard)) {
+    apply(item, value);
+    guard->shadow.mask &= ~slot_bit(item);
+    return;
+  }
+
+  read(guard, item);
+  save(guard, item);
+  if (guard->shadow.values[item] != value) {
+    apply(item, value);
+    guard->shadow.values[item] = value;
+  }
+}
+
+// Puts back the slots in |saved| that differ from the shadow. Texture
+// bindings go back on their own units, then the active unit is put back
+// to what it was before, or to its saved value if it is saved too.
+static void restore(GlStateGuard* guard, GlStateGuardValues* saved) {
+  GLint* active = &guard->shadow.values[GL_STATE_GUARD_ACTIVE_TEXTURE];
+  GLint active_before = *active;
+  gboolean switched = FALSE;
+  for (guint unit = 0; unit < GL_STATE_GUARD_TEXTURE_UNITS; unit++) {
+    guint slot = GL_STATE_GUARD_N_ITEMS + unit;
+    if (!(saved->mask & slot_bit(slot)) ||
+        guard->shadow.values[slot] == saved->values[slot]) {
+      continue;
+    }
+    if (*active != static_cast<GLint>(GL_TEXTURE0 + unit)) {
+      glActiveTexture(GL_TEXTURE0 + unit);
+      *active = GL_TEXTURE0 + unit;
+      switched = TRUE;
+    }
+    glBindTexture(GL_TEXTURE_2D, saved->values[slot]);
+    guard->shadow.values[slot] = saved->values[slot];
+  }
+
+  for (guint i = 0; i < GL_STATE_GUARD_N_ITEMS; i++) {
+    if (i == GL_STATE_GUARD_ACTIVE_TEXTURE ||
+        !(saved->mask & slot_bit(i)) ||
+        guard->shadow.values[i] == saved->values[i]) {
+      continue;
+    }
+    apply(static_cast<GlStateGuardItem>(i), saved->values[i]);
+    guard->shadow.values[i] = saved->values[i];
+  }
+
+  GLint active_target = active_before;
+  if (saved->mask & slot_bit(GL_STATE_GUARD_ACTIVE_TEXTURE)) {
+    active_target = saved->values[GL_STATE_GUARD_ACTIVE_TEXTURE];
+    switched = TRUE;
+  }
+  if (switched && *active != active_target) {
+    glActiveTexture(active_target);
+    *active = active_target;
+  }
+
+  if (saved->has_viewport &&
+      memcmp(guard->shadow.viewport, saved->viewport,
+             sizeof(saved->viewport)) != 0) {
+    glViewport(saved->viewport[0], saved->viewport[1], saved->viewport[2],
+               saved->viewport[3]);
+    memcpy(guard->shadow.viewport, saved->viewport, sizeof(saved->viewport));
+  }
+
+  saved->mask = 0;
+  saved->has_viewport = FALSE;
+}
+
+void gl_state_guard_init(GlStateGuard* guard) {
+  guard->enabled = FALSE;
+  guard->in_pass = FALSE;
+  guard->shadow.mask = 0;
+  guard->shadow.has_viewport = FALSE;
+  guard->scope.mask = 0;
+  guard->scope.has_viewport = FALSE;
+  guard->pass.mask = 0;
+  guard->pass.has_viewport = FALSE;
+}
+
+// Forgets the shadow; the next change of each slot reads it from GL again.
+static void invalidate(GlStateGuard* guard) {
+  guard->shadow.mask = 0;
+  guard->shadow.has_viewport = FALSE;
+}
+
+void gl_state_guard_begin(GlStateGuard* guard, gboolean enabled) {
+  invalidate(guard);
+  guard->enabled = enabled;
+  guard->scope.mask = 0;
+  guard->scope.has_viewport = FALSE;
+  if (!enabled) {
+    return;
+  }
+
+  // What populate changes, as the renderer left it.
+  read(guard, GL_STATE_GUARD_ACTIVE_TEXTURE);
+  guint unit = guard->shadow.values[GL_STATE_GUARD_ACTIVE_TEXTURE] -
+               GL_TEXTURE0;
+  if (unit < GL_STATE_GUARD_TEXTURE_UNITS) {
+    read(guard, GL_STATE_GUARD_N_ITEMS + unit);
+  }
+  read(guard, GL_STATE_GUARD_UNPACK_ALIGNMENT);
+  read(guard, GL_STATE_GUARD_UNPACK_ROW_LENGTH);
+  read(guard, GL_STATE_GUARD_PIXEL_UNPACK_BUFFER);
+}
+
+void gl_state_guard_begin_pass(GlStateGuard* guard) {
+  // Outside an enabled scope the shadow may be stale by now: a disabled
+  // guard forwards without tracking.
+  if (!guard->enabled) {
+    invalidate(guard);
+  }
+  guard->in_pass = TRUE;
+  guard->pass.mask = 0;
+  guard->pass.has_viewport = FALSE;
+}
+
+void gl_state_guard_end_pass(GlStateGuard* guard) {
+  restore(guard, &guard->pass);
+  guard->in_pass = FALSE;
+}
+
+void gl_state_guard_active_texture(GlStateGuard* guard, GLenum unit) {
+  set(guard, GL_STATE_GUARD_ACTIVE_TEXTURE, unit);
+}
+
+void gl_state_guard_bind_texture(GlStateGuard* guard, GLuint texture) {
+  if (!tracking(guard)) {
+    glBindTexture(GL_TEXTURE_2D, texture);
+    // Without the active unit there is no telling which binding changed.
+    guard->shadow.mask &= ~kTextureSlots;
+    return;
+  }
+
+  read(guard, GL_STATE_GUARD_ACTIVE_TEXTURE);
+  guint unit = guard->shadow.values[GL_STATE_GUARD_ACTIVE_TEXTURE] -
+               GL_TEXTURE0;
+  if (unit >= GL_STATE_GUARD_TEXTURE_UNITS) {
+    glBindTexture(GL_TEXTURE_2D, texture);
+    return;
+  }
+
+  guint slot = GL_STATE_GUARD_N_ITEMS + unit;
+  read(guard, slot);
+  save(guard, slot);
+  if (guard->shadow.values[slot] != static_cast<GLint>(texture)) {
+    glBindTexture(GL_TEXTURE_2D, texture);
+    guard->shadow.values[slot] = texture;
+  }
+}
+
+void gl_state_guard_pixel_store(GlStateGuard* guard,
+                                GLenum pname,
+                                GLint value) {
+  set(guard,
+      pname == GL_UNPACK_ALIGNMENT ? GL_STATE_GUARD_UNPACK_ALIGNMENT
+                                   : GL_STATE_GUARD_UNPACK_ROW_LENGTH,
+      value);
+}
+
+void gl_state_guard_bind_unpack_buffer(GlStateGuard* guard, GLuint buffer) {
+  set(guard, GL_STATE_GUARD_PIXEL_UNPACK_BUFFER, buffer);
+}
+
+void gl_state_guard_bind_framebuffer(GlStateGuard* guard,
+                                     GLuint framebuffer) {
+  set(guard, GL_STATE_GUARD_DRAW_FRAMEBUFFER, framebuffer);
+  set(guard, GL_STATE_GUARD_READ_FRAMEBUFFER, framebuffer);
+}
+
+void gl_state_guard_use_program(GlStateGuard* guard, GLuint program) {
+  set(guard, GL_STATE_GUARD_PROGRAM, program);
+}
+
+void gl_state_guard_bind_vertex_array(GlStateGuard* guard, GLuint array) {
+  set(guard, GL_STATE_GUARD_VERTEX_ARRAY, array);
+}
+
+void gl_state_guard_viewport(GlStateGuard* guard,
+                             GLint x,
+                             GLint y,
+                             GLsizei width,
+                             GLsizei height) {
+  GLint viewport[4] = {x, y, width, height};
+  if (!tracking(guard)) {
+    glViewport(x, y, width, height);
+    guard->shadow.has_viewport = FALSE;
+    return;
+  }
+
+  if (!guard->shadow.has_viewport) {
+    glGetIntegerv(GL_VIEWPORT, guard->shadow.viewport);
+    guard->shadow.has_viewport = TRUE;
+  }
+  if (guard->enabled && !guard->scope.has_viewport) {
+    memcpy(guard->scope.viewport, guard->shadow.viewport, sizeof(viewport));
+    guard->scope.has_viewport = TRUE;
+  }
+  if (guard->in_pass && !guard->pass.has_viewport) {
+    memcpy(guard->pass.viewport, guard->shadow.viewport, sizeof(viewport));
+    guard->pass.has_viewport = TRUE;
+  }
+  if (memcmp(guard->shadow.viewport, viewport, sizeof(viewport)) != 0) {
+    glViewport(x, y, width, height);
+    memcpy(guard->shadow.viewport, viewport, sizeof(viewport));
+  }
+}
+
+void gl_state_guard_set_capability(GlStateGuard* guard,
+                                   GLenum capability,
+                                   gboolean enabled) {
+  for (guint i = GL_STATE_GUARD_BLEND; i < GL_STATE_GUARD_N_ITEMS; i++) {
+    if (kQueries[i] == capability) {
+      set(guard, static_cast<GlStateGuardItem>(i), enabled ? 1 : 0);
+      return;
+    }
+  }
+  g_assert_not_reached();
+}
+
+void gl_state_guard_reset_unpack(GlStateGuard* guard) {
+  set(guard, GL_STATE_GUARD_UNPACK_ALIGNMENT, 4);
+  set(guard, GL_STATE_GUARD_UNPACK_ROW_LENGTH, 0);
+  set(guard, GL_STATE_GUARD_PIXEL_UNPACK_BUFFER, 0);
+}
+
+// Deleting a texture unbinds it from every unit.
+static void forget_texture(GlStateGuardValues* values, GLuint texture) {
+  for (guint unit = 0; unit < GL_STATE_GUARD_TEXTURE_UNITS; unit++) {
+    guint slot = GL_STATE_GUARD_N_ITEMS + unit;
+    if ((values->mask & slot_bit(slot)) &&
+        values->values[slot] == static_cast<GLint>(texture)) {
+      values->values[slot] = 0;
+    }
+  }
+}
+
+void gl_state_guard_texture_deleted(GlStateGuard* guard, GLuint texture) {
+  forget_texture(&guard->shadow, texture);
+  forget_texture(&guard->scope, texture);
+  forget_texture(&guard->pass, texture);
+}
+
+void gl_state_guard_end(GlStateGuard* guard) {
+  if (guard->enabled) {
+    restore(guard, &guard->scope);
+  }
+}
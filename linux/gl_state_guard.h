@@ -0,0 +1,115 @@
+#ifndef FL_TEXTURE_REPRO_GL_STATE_GUARD_H_
+#define FL_TEXTURE_REPRO_GL_STATE_GUARD_H_
+
+#include <epoxy/gl.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+// State the plugin changes in Flutter's GL context. The GL_TEXTURE_2D
+// binding is tracked per unit, after these.
+typedef enum {
+  GL_STATE_GUARD_ACTIVE_TEXTURE,
+  GL_STATE_GUARD_UNPACK_ALIGNMENT,
+  GL_STATE_GUARD_UNPACK_ROW_LENGTH,
+  GL_STATE_GUARD_PIXEL_UNPACK_BUFFER,
+  GL_STATE_GUARD_DRAW_FRAMEBUFFER,
+  GL_STATE_GUARD_READ_FRAMEBUFFER,
+  GL_STATE_GUARD_PROGRAM,
+  GL_STATE_GUARD_VERTEX_ARRAY,
+  GL_STATE_GUARD_BLEND,
+  GL_STATE_GUARD_SCISSOR_TEST,
+  GL_STATE_GUARD_DEPTH_TEST,
+  GL_STATE_GUARD_STENCIL_TEST,
+  GL_STATE_GUARD_CULL_FACE,
+  GL_STATE_GUARD_N_ITEMS,
+} GlStateGuardItem;
+
+// Texture bindings are tracked on units 0-31; binds on higher units go
+// straight to GL and are not put back.
+#define GL_STATE_GUARD_TEXTURE_UNITS 32
+#define GL_STATE_GUARD_N_SLOTS \
+  (GL_STATE_GUARD_N_ITEMS + GL_STATE_GUARD_TEXTURE_UNITS)
+
+// Values of the slots whose bit is set in |mask|, plus the viewport.
+typedef struct {
+  guint64 mask;
+  GLint values[GL_STATE_GUARD_N_SLOTS];
+  gboolean has_viewport;
+  GLint viewport[4];
+} GlStateGuardValues;
+
+// Scoped save/restore of the state above. Changes go through the guard,
+// which keeps a shadow of the context for the length of a scope: the
+// renderer that owns the context rebinds freely between scopes, so the
+// shadow is dropped at every begin. An enabled scope reads the slots
+// populate changes up front; anything else, and every slot in a pass, is
+// read the first time it is touched. Redundant calls are then skipped and
+// the end only rebinds what actually differs.
+//
+// A disabled guard forwards every call to GL and puts nothing back, except
+// within a pass.
+typedef struct {
+  gboolean enabled;
+  gboolean in_pass;
+  GlStateGuardValues shadow;
+  GlStateGuardValues scope;  // Before the scope first changed them
+  GlStateGuardValues pass;   // Before the pass first changed them
+} GlStateGuard;
+
+// Starts with nothing known.
+void gl_state_guard_init(GlStateGuard* guard);
+
+void gl_state_guard_begin(GlStateGuard* guard, gboolean enabled);
+
+// Everything changed between these two is put back by
+// gl_state_guard_end_pass(), even in a disabled guard: for render passes
+// that would break Flutter's own drawing outright if they leaked. The pass
+// reads what it touches from GL afresh.
+void gl_state_guard_begin_pass(GlStateGuard* guard);
+
+void gl_state_guard_end_pass(GlStateGuard* guard);
+
+void gl_state_guard_active_texture(GlStateGuard* guard, GLenum unit);
+
+// Binds |texture| to GL_TEXTURE_2D on the active unit.
+void gl_state_guard_bind_texture(GlStateGuard* guard, GLuint texture);
+
+// GL_UNPACK_ALIGNMENT or GL_UNPACK_ROW_LENGTH
+void gl_state_guard_pixel_store(GlStateGuard* guard, GLenum pname, GLint value);
+
+void gl_state_guard_bind_unpack_buffer(GlStateGuard* guard, GLuint buffer);
+
+// Binds |framebuffer| for both drawing and reading.
+void gl_state_guard_bind_framebuffer(GlStateGuard* guard, GLuint framebuffer);
+
+void gl_state_guard_use_program(GlStateGuard* guard, GLuint program);
+
+void gl_state_guard_bind_vertex_array(GlStateGuard* guard, GLuint array);
+
+void gl_state_guard_viewport(GlStateGuard* guard,
+                             GLint x,
+                             GLint y,
+                             GLsizei width,
+                             GLsizei height);
+
+// GL_BLEND, GL_SCISSOR_TEST, GL_DEPTH_TEST, GL_STENCIL_TEST or
+// GL_CULL_FACE
+void gl_state_guard_set_capability(GlStateGuard* guard,
+                                   GLenum capability,
+                                   gboolean enabled);
+
+// Puts the unpack state back to the GL defaults for client-memory uploads:
+// alignment 4, no row length, no pixel unpack buffer. The context's owner
+// may have left a PBO bound or a row length set for its own uploads.
+void gl_state_guard_reset_unpack(GlStateGuard* guard);
+
+// Tells the guard |texture| was deleted, which resets any binding to it to 0.
+void gl_state_guard_texture_deleted(GlStateGuard* guard, GLuint texture);
+
+// Puts back every item the scope changed.
+void gl_state_guard_end(GlStateGuard* guard);
+
+G_END_DECLS
+
+#endif  // FL_TEXTURE_REPRO_GL_STATE_GUARD_H_
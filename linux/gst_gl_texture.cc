@@ -0,0 +1,2103 @@
+#include "gst_gl_texture.h"
+
+#include <epoxy/gl.h>
+#include <gst/gst.h>
+#include <gst/app/gstappsink.h>
+#include <gst/video/video.h>
+
+#include <cstring>
+
+#include "frame_mailbox.h"
+#include "gl_context_share.h"
+#include "gl_state_guard.h"
+#include "jpeg_decode_pool.h"
+#include "jpeg_scaled_decoder.h"
+#include "recording.h"
+#include "still_capture.h"
+#include "texture_stats.h"
+#include "thread_policy.h"
+#include "tile_diff.h"
+#include "yuv_cpu_converter.h"
+#include "yuv_gl_converter.h"
+
+// Default source: Insta360 X5 connected via USB (supports 1920x1080 @ 30fps
+// MJPEG). The first %s is the v4l2 device, the second the decoder. The tee
+// lets recordings take the JPEG frames as they are.
+#define GST_GL_TEXTURE_CAMERA_SOURCE                       \
+  "v4l2src device=%s ! "                                   \
+  "image/jpeg,width=1920,height=1080,framerate=30/1 ! "    \
+  "tee name=jpegtee ! %s"
+
+#define GST_GL_TEXTURE_DEFAULT_DEVICE "/dev/video0"
+
+// Size frames are scaled to before they reach the appsink until the owner
+// reports the display size.
+#define GST_GL_TEXTURE_DEFAULT_OUTPUT_WIDTH 640
+#define GST_GL_TEXTURE_DEFAULT_OUTPUT_HEIGHT 480
+
+// Limits for gst_gl_texture_set_output_size()
+#define GST_GL_TEXTURE_MIN_OUTPUT_SIZE 16
+#define GST_GL_TEXTURE_MAX_OUTPUT_SIZE 4096
+
+// Lowest rate accepted for the frame tap, so the interval fits a gint
+#define GST_GL_TEXTURE_MIN_TAP_FPS 0.1
+
+// One slot of the frame mailbox. Only the thread currently owning the slot
+// (see frame_mailbox.h) touches it.
+typedef struct {
+  GstSample* sample;  // GST_GL_TEXTURE_UPLOAD_ZERO_COPY only
+  uint8_t* pixels;    // GST_GL_TEXTURE_UPLOAD_COPY only, RGBA
+  GstVideoInfo video_info;
+  uint32_t width;
+  uint32_t height;
+  gint64 capture_time;  // Monotonic time (us) the frame was captured, or -1
+
+  // Partial updates: tiles changed since the frame published before this
+  // one. Only meaningful when tiles_valid is set.
+  guint64 sequence;
+  guint8* dirty_tiles;
+  guint n_tiles;
+  gboolean tiles_valid;
+} GstGLTextureFrame;
+
+// Progress of the GStreamer-GL shared-context mode.
+typedef enum {
+  GST_GL_TEXTURE_SHARING_OFF,      // Not requested, or given up on
+  GST_GL_TEXTURE_SHARING_UNTRIED,  // Waiting for populate to wrap the context
+  GST_GL_TEXTURE_SHARING_ACTIVE,   // Context wrapped, GL pipeline requested
+} GstGLTextureSharingState;
+
+// One texture populate uploads into.
+typedef struct {
+  GLuint id;        // 0 until created
+  uint32_t width;   // Size the storage was allocated for
+  uint32_t height;
+  guint64 sequence;  // Frame sequence uploaded last, 0 if unknown
+  // Fenced when populate moves on to the next texture of the ring; once it
+  // signals, the compositor is done sampling this one.
+  GLsync fence;
+} GstGLTextureSlot;
+
+struct _GstGLTexture {
+  FlTextureGL parent_instance;
+
+  // OpenGL. Frames are uploaded into textures[texture_index]; with a ring
+  // (texture_ring_depth > 1) the index moves on for every new frame.
+  GstGLTextureSlot textures[GST_GL_TEXTURE_MAX_TEXTURE_RING];
+  guint texture_ring_depth;
+  guint texture_index;
+  GLuint current_name;  // Texture showing the front frame, 0 if none
+  // Routes populate's state changes; restores them if restore_gl_state
+  gboolean restore_gl_state;
+  GlStateGuard gl_guard;
+
+  // Optional pixel-buffer-object upload ring (pbo_ring_depth == 0: disabled)
+  guint pbo_ring_depth;
+  GLuint pbos[GST_GL_TEXTURE_MAX_PBO_RING];
+  GLsync pbo_fences[GST_GL_TEXTURE_MAX_PBO_RING];
+  gsize pbo_sizes[GST_GL_TEXTURE_MAX_PBO_RING];
+  guint pbo_index;
+  gboolean pbo_initialized;
+
+  // NV12/I420 -> RGBA shader pass, created on the first planar frame
+  YuvGlConverter* yuv_converter;
+
+  // Fused scale + convert on the streaming thread, replacing videoscale !
+  // videoconvert (copy mode only)
+  YuvCpuConverter* cpu_converter;
+
+  // GStreamer-GL shared-context mode. The wrapped context is created on the
+  // raster thread and only read elsewhere once sharing_state is ACTIVE.
+  gint sharing_state;  // GstGLTextureSharingState
+  GstGLDisplay* gl_display;
+  GstGLContext* gl_context;  // Flutter's context, wrapped
+  gboolean gl_pipeline;      // Current pipeline ends in GLMemory
+  GstVideoFrame gl_frame;    // GLMemory frame Flutter is currently drawing
+  gboolean gl_frame_mapped;
+
+  // GStreamer. For the camera, source is described on the first build,
+  // once GStreamer is initialized.
+  gchar* source;
+  gchar* device;
+  guint decode_workers;
+  gboolean scaled_decode;
+  GstElement* pipeline;
+  GstElement* appsink;
+  GstElement* scale_caps;  // capsfilter after videoscale, nullptr if fused
+  GstElement* raw_tee;     // Decoded frames at source resolution, for
+                           // recordings and stills
+  GstElement* jpeg_tee;    // Camera JPEG frames, nullptr for other sources
+  GstElement* scaled_decoder;  // fltexturejpegscaledec, nullptr if unused
+  GstElement* valve;  // Drops this texture's frames while it is paused
+  GstState pipeline_state;  // State the pipeline was last brought to
+  // Set on the main thread while a worker builds or starts the pipeline;
+  // the pipeline fields above belong to the worker until it is cleared.
+  gboolean starting;
+  gboolean stop_requested;
+  GstGLTextureUploadMode upload_mode;
+  GstGLTexturePixelFormat pixel_format;
+
+  // Views. A view has no pipeline of its own: its elements live in a bin
+  // added to the source's pipeline and fed from the source's raw_tee. The
+  // source keeps PLAYING while it or any of its views is not paused. Main
+  // thread only.
+  GstGLTexture* view_source;  // Owned reference, nullptr unless a view
+  GList* views;               // Views of this texture, not owned
+  GstElement* branch;         // A view's bin, while attached
+  GstPad* tee_pad;            // Source raw_tee pad feeding |branch|
+  gboolean branch_paused;     // Set by gst_gl_texture_set_paused()
+
+  // Per-frame timeline, nullptr if not traced
+  FrameTrace* trace;
+
+  // Frame hand-off from the streaming thread to populate
+  FrameMailbox mailbox;
+  GstGLTextureFrame frames[FRAME_MAILBOX_SLOTS];
+  gint output_width;  // Atomic, read by the streaming thread
+  gint output_height;
+
+  // Partial updates (copy mode only). The reference is the streaming
+  // thread's model of the texture contents.
+  gboolean partial_updates;
+  guint8 partial_update_threshold;
+  guint8* tile_reference;
+  uint32_t reference_width;
+  uint32_t reference_height;
+  guint64 sequence;
+
+  // Frame tap. The streaming thread decides which frames to tap from the
+  // atomics alone; tap_mutex guards the config and converter, which the
+  // worker converting a tapped frame and the main thread share.
+  // tap_in_flight stays set from the moment a frame is taken until the
+  // owner reports it consumed; frames due meanwhile are dropped.
+  gint tap_enabled;
+  gint tap_interval_us;
+  gint tap_in_flight;
+  gint64 tap_last_time;  // Streaming thread only
+  GMutex tap_mutex;
+  FrameTapConfig tap_config;
+  FrameTapConverter* tap_converter;
+  GstGLTextureFrameTapCallback tap_callback;  // Main thread only
+  gpointer tap_callback_data;
+
+  // Recording branch on raw_tee or jpeg_tee. Changed on the main thread;
+  // the mutex lets the bus sync handler route the branch's messages.
+  GMutex recording_mutex;
+  Recording* recording;
+
+  // Thread placement, applied by each streaming thread as it starts and
+  // undone as it leaves, and by the workers of the decode and convert
+  // pools. The threads of views follow their source's policy and are
+  // listed in its placements.
+  ThreadPolicy thread_policy;
+  ThreadPlacements* placements;
+
+  // Lock-free counters, see gst_gl_texture_get_stats()
+  TextureStats stats;
+
+  // Frame-available notification. notify_pending coalesces wakeups from the
+  // streaming thread until the owner takes it.
+  GstGLTextureFrameCallback frame_callback;
+  gpointer frame_callback_data;
+  gint notify_pending;
+};
+
+G_DEFINE_TYPE(GstGLTexture, gst_gl_texture, fl_texture_gl_get_type())
+
+// Called from the streaming thread for every new frame. Only the first frame
+// since the owner last took the pending flag is announced; later ones are
+// coalesced into it.
+static void gst_gl_texture_queue_frame_available(GstGLTexture* self) {
+  if (g_atomic_int_compare_and_exchange(&self->notify_pending, 0, 1) &&
+      self->frame_callback != nullptr) {
+    self->frame_callback(self, self->frame_callback_data);
+  }
+}
+
+// Estimates when |sample| was captured, in g_get_monotonic_time() units,
+// from how long ago its PTS was on the pipeline clock. Returns -1 if the
+// sample has no usable timestamp.
+static gint64 gst_gl_texture_capture_time(GstElement* sink, GstSample* sample) {
+  GstBuffer* buffer = gst_sample_get_buffer(sample);
+  GstSegment* segment = gst_sample_get_segment(sample);
+  GstClockTime pts = GST_BUFFER_PTS(buffer);
+  if (!GST_CLOCK_TIME_IS_VALID(pts) || segment == nullptr) {
+    return -1;
+  }
+
+  GstClockTime running_time =
+      gst_segment_to_running_time(segment, GST_FORMAT_TIME, pts);
+  GstClock* clock = gst_element_get_clock(sink);
+  if (clock == nullptr || !GST_CLOCK_TIME_IS_VALID(running_time)) {
+    if (clock != nullptr) {
+      gst_object_unref(clock);
+    }
+    return -1;
+  }
+
+  GstClockTime now = gst_clock_get_time(clock);
+  GstClockTime base_time = gst_element_get_base_time(sink);
+  gst_object_unref(clock);
+
+  gint64 age = 0;
+  if (now > base_time + running_time) {
+    age = (now - base_time - running_time) / GST_USECOND;
+  }
+  return g_get_monotonic_time() - age;
+}
+
+// Records the span |name| that began at |start| in the frame trace.
+static void gst_gl_texture_trace(GstGLTexture* self,
+                                 const gchar* name,
+                                 gint64 start) {
+  if (start != 0) {
+    frame_trace_end(self->trace, name, start,
+                    fl_texture_get_id(FL_TEXTURE(self)));
+  }
+}
+
+// Publishes the filled back slot and announces it. The slot handed back in
+// exchange held a frame populate is done with; its sample is released right
+// away so the buffer can return to its pool.
+static void gst_gl_texture_publish_frame(GstGLTexture* self) {
+  if (frame_mailbox_publish(&self->mailbox)) {
+    texture_stats_add(&self->stats.frames_dropped, 1);
+  }
+
+  GstGLTextureFrame* back = &self->frames[frame_mailbox_back(&self->mailbox)];
+  if (back->sample != nullptr) {
+    gst_sample_unref(back->sample);
+    back->sample = nullptr;
+  }
+
+  gint64 trace_start = frame_trace_begin(self->trace);
+  gst_gl_texture_queue_frame_available(self);
+  gst_gl_texture_trace(self, "notify", trace_start);
+}
+
+// Marks the tiles of |slot| that changed since the last published frame.
+// Called on the streaming thread before the slot is published.
+static void gst_gl_texture_diff_tiles(GstGLTexture* self,
+                                      GstGLTextureFrame* slot) {
+  slot->sequence = ++self->sequence;
+
+  guint n_tiles =
+      tile_diff_columns(slot->width) * tile_diff_rows(slot->height);
+  if (slot->n_tiles != n_tiles) {
+    g_free(slot->dirty_tiles);
+    slot->dirty_tiles = static_cast<guint8*>(g_malloc(n_tiles));
+    slot->n_tiles = n_tiles;
+  }
+
+  // Nothing to compare against yet: the frame is uploaded in full.
+  if (self->tile_reference == nullptr || self->reference_width != slot->width ||
+      self->reference_height != slot->height) {
+    g_free(self->tile_reference);
+    self->tile_reference = static_cast<guint8*>(
+        g_memdup2(slot->pixels, slot->width * slot->height * 4));
+    self->reference_width = slot->width;
+    self->reference_height = slot->height;
+    slot->tiles_valid = FALSE;
+    return;
+  }
+
+  tile_diff_update(slot->pixels, self->tile_reference, slot->width,
+                   slot->height, self->partial_update_threshold,
+                   slot->dirty_tiles);
+  slot->tiles_valid = TRUE;
+}
+
+// Converts a tapped sample on a worker thread.
+static void gst_gl_texture_tap_thread(GTask* task,
+                                      gpointer source_object,
+                                      gpointer task_data,
+                                      GCancellable* cancellable) {
+  GstGLTexture* self = GST_GL_TEXTURE(source_object);
+  GstSample* sample = static_cast<GstSample*>(task_data);
+
+  g_mutex_lock(&self->tap_mutex);
+  FlValue* frame = nullptr;
+  if (g_atomic_int_get(&self->tap_enabled)) {
+    frame = frame_tap_converter_process(self->tap_converter, &self->tap_config,
+                                        sample);
+  }
+  g_mutex_unlock(&self->tap_mutex);
+
+  g_task_return_pointer(task, frame,
+                        reinterpret_cast<GDestroyNotify>(fl_value_unref));
+}
+
+// Hands a converted frame to the owner. Runs on the main thread: the task is
+// created on a streaming thread, which has no thread-default main context.
+static void gst_gl_texture_tap_ready(GObject* object,
+                                     GAsyncResult* result,
+                                     gpointer user_data) {
+  GstGLTexture* self = GST_GL_TEXTURE(object);
+  FlValue* frame = static_cast<FlValue*>(
+      g_task_propagate_pointer(G_TASK(result), nullptr));
+
+  // Stopped meanwhile, or the sample could not be converted.
+  if (frame == nullptr || self->tap_callback == nullptr) {
+    if (frame != nullptr) {
+      fl_value_unref(frame);
+    }
+    gst_gl_texture_frame_tap_done(self);
+    return;
+  }
+
+  texture_stats_add(&self->stats.tap_frames_delivered, 1);
+  self->tap_callback(self, frame, self->tap_callback_data);
+  fl_value_unref(frame);
+}
+
+// Takes |sample| for the frame tap if one is due and the previous one has
+// been consumed. Called on the streaming thread; the conversion runs on a
+// worker so the preview never waits for it.
+static void gst_gl_texture_maybe_tap(GstGLTexture* self, GstSample* sample) {
+  if (!g_atomic_int_get(&self->tap_enabled)) {
+    return;
+  }
+
+  gint64 now = g_get_monotonic_time();
+  if (now - self->tap_last_time < g_atomic_int_get(&self->tap_interval_us)) {
+    return;
+  }
+  // The interval restarts from the frame actually delivered, so the
+  // consumer gets the next frame as soon as it is ready again.
+  if (!g_atomic_int_compare_and_exchange(&self->tap_in_flight, 0, 1)) {
+    texture_stats_add(&self->stats.tap_frames_dropped, 1);
+    return;
+  }
+  self->tap_last_time = now;
+
+  GTask* task = g_task_new(self, nullptr, gst_gl_texture_tap_ready, nullptr);
+  g_task_set_task_data(task, gst_sample_ref(sample),
+                       reinterpret_cast<GDestroyNotify>(gst_sample_unref));
+  g_task_run_in_thread(task, gst_gl_texture_tap_thread);
+  g_object_unref(task);
+}
+
+// GStreamer new sample callback
+static GstFlowReturn on_new_sample(GstAppSink* appsink, gpointer user_data) {
+  GstGLTexture* self = GST_GL_TEXTURE(user_data);
+
+  gint64 trace_start = frame_trace_begin(self->trace);
+  GstSample* sample = gst_app_sink_pull_sample(appsink);
+  if (sample == nullptr) {
+    return GST_FLOW_OK;
+  }
+
+  GstBuffer* buffer = gst_sample_get_buffer(sample);
+  GstCaps* caps = gst_sample_get_caps(sample);
+
+  GstVideoInfo video_info;
+  if (!gst_video_info_from_caps(&video_info, caps)) {
+    gst_sample_unref(sample);
+    return GST_FLOW_OK;
+  }
+
+  uint32_t new_width = GST_VIDEO_INFO_WIDTH(&video_info);
+  uint32_t new_height = GST_VIDEO_INFO_HEIGHT(&video_info);
+  gst_gl_texture_trace(self, "sample", trace_start);
+  texture_stats_add(&self->stats.frames_received, 1);
+  gst_gl_texture_maybe_tap(self, sample);
+
+  // The back slot belongs to this thread until it is published, so it is
+  // filled without any lock while populate reads the front slot.
+  GstGLTextureFrame* slot = &self->frames[frame_mailbox_back(&self->mailbox)];
+  slot->video_info = video_info;
+  slot->capture_time =
+      gst_gl_texture_capture_time(GST_ELEMENT(appsink), sample);
+
+  if (self->upload_mode == GST_GL_TEXTURE_UPLOAD_ZERO_COPY) {
+    // Just hand over the sample; populate maps and uploads it directly.
+    slot->sample = sample;
+    slot->width = new_width;
+    slot->height = new_height;
+    gst_gl_texture_publish_frame(self);
+    return GST_FLOW_OK;
+  }
+
+  GstVideoFrame frame;
+  trace_start = frame_trace_begin(self->trace);
+  if (gst_video_frame_map(&frame, &video_info, buffer, GST_MAP_READ)) {
+    gst_gl_texture_trace(self, "map", trace_start);
+    // The fused converter scales while converting; otherwise the appsink
+    // already delivers RGBA at the output size.
+    if (self->cpu_converter != nullptr) {
+      new_width = g_atomic_int_get(&self->output_width);
+      new_height = g_atomic_int_get(&self->output_height);
+    }
+    size_t row_size = new_width * 4;  // RGBA
+    size_t buffer_size = row_size * new_height;
+
+    // Reallocate if size changed
+    if (slot->pixels == nullptr || slot->width != new_width ||
+        slot->height != new_height) {
+      g_free(slot->pixels);
+      slot->pixels = (uint8_t*)g_malloc(buffer_size);
+      slot->width = new_width;
+      slot->height = new_height;
+    }
+
+    // Copy frame data, dropping any row padding, or scale + convert it
+    // straight into the slot
+    trace_start = frame_trace_begin(self->trace);
+    const uint8_t* src = (const uint8_t*)GST_VIDEO_FRAME_PLANE_DATA(&frame, 0);
+    gint src_stride = GST_VIDEO_FRAME_PLANE_STRIDE(&frame, 0);
+    if (self->cpu_converter != nullptr) {
+      yuv_cpu_converter_convert(self->cpu_converter, &frame, slot->pixels,
+                                row_size, new_width, new_height);
+    } else if ((size_t)src_stride == row_size) {
+      memcpy(slot->pixels, src, buffer_size);
+    } else {
+      for (uint32_t y = 0; y < new_height; y++) {
+        memcpy(slot->pixels + y * row_size, src + y * src_stride, row_size);
+      }
+    }
+    texture_stats_add(&self->stats.bytes_copied, buffer_size);
+    gst_gl_texture_trace(self, "copy", trace_start);
+
+    gst_video_frame_unmap(&frame);
+    if (self->partial_updates) {
+      gst_gl_texture_diff_tiles(self, slot);
+    }
+    gst_gl_texture_publish_frame(self);
+  }
+
+  gst_sample_unref(sample);
+  return GST_FLOW_OK;
+}
+
+// Whether GL_UNPACK_ROW_LENGTH is available (desktop GL, GLES 3.0 or
+// EXT_unpack_subimage).
+static gboolean gst_gl_texture_has_unpack_row_length() {
+  return epoxy_is_desktop_gl() || epoxy_gl_version() >= 30 ||
+         epoxy_has_gl_extension("GL_EXT_unpack_subimage");
+}
+
+// Whether glTexStorage2D is available (GL 4.2, GLES 3.0 or the
+// ARB/EXT_texture_storage extensions).
+static gboolean gst_gl_texture_has_texture_storage() {
+  if (epoxy_is_desktop_gl()) {
+    return epoxy_gl_version() >= 42 ||
+           epoxy_has_gl_extension("GL_ARB_texture_storage");
+  }
+  return epoxy_gl_version() >= 30 ||
+         epoxy_has_gl_extension("GL_EXT_texture_storage");
+}
+
+// Makes sure |slot| exists with storage for width x height and leaves it
+// bound to GL_TEXTURE_2D. Storage and sampling parameters are only touched
+// when the texture is created or the frame size changes.
+static void gst_gl_texture_ensure_storage(GstGLTexture* self,
+                                          GstGLTextureSlot* slot,
+                                          uint32_t width,
+                                          uint32_t height) {
+  if (slot->id != 0 && slot->width == width && slot->height == height) {
+    gl_state_guard_bind_texture(&self->gl_guard, slot->id);
+    return;
+  }
+
+  // Immutable storage cannot be respecified, so a resize needs a new name.
+  if (slot->id != 0) {
+    glDeleteTextures(1, &slot->id);
+    gl_state_guard_texture_deleted(&self->gl_guard, slot->id);
+  }
+  glGenTextures(1, &slot->id);
+  slot->width = width;
+  slot->height = height;
+  slot->sequence = 0;
+
+  gl_state_guard_bind_texture(&self->gl_guard, slot->id);
+  if (gst_gl_texture_has_texture_storage()) {
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+  } else {
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  }
+
+  // Set texture parameters - these also modify GL state
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+// Whether fence sync objects are available (GL 3.2 or GLES 3.0).
+static gboolean gst_gl_texture_has_fence_sync() {
+  return epoxy_gl_version() >= (epoxy_is_desktop_gl() ? 32 : 30);
+}
+
+// Picks the texture the next frame goes into. The one returned last may
+// still be sampled by the compositor's draws, which are submitted by now, so
+// it is fenced and skipped; another texture is taken once its fence has
+// signalled. Only when the whole ring is in flight is the oldest texture
+// reused, leaving the driver to synchronize.
+static GstGLTextureSlot* gst_gl_texture_next_slot(GstGLTexture* self) {
+  guint depth = self->texture_ring_depth;
+  if (depth <= 1 || !gst_gl_texture_has_fence_sync()) {
+    return &self->textures[0];
+  }
+
+  GstGLTextureSlot* previous = &self->textures[self->texture_index];
+  if (previous->id != 0) {
+    if (previous->fence != nullptr) {
+      glDeleteSync(previous->fence);
+    }
+    previous->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+
+  guint next = (self->texture_index + 1) % depth;
+  for (guint i = 1; i < depth; i++) {
+    guint index = (self->texture_index + i) % depth;
+    GstGLTextureSlot* slot = &self->textures[index];
+    if (slot->fence == nullptr ||
+        glClientWaitSync(slot->fence, 0, 0) != GL_TIMEOUT_EXPIRED) {
+      next = index;
+      break;
+    }
+    if (i == depth - 1) {
+      texture_stats_add(&self->stats.texture_ring_full, 1);
+    }
+  }
+
+  GstGLTextureSlot* slot = &self->textures[next];
+  if (slot->fence != nullptr) {
+    glDeleteSync(slot->fence);
+    slot->fence = nullptr;
+  }
+  self->texture_index = next;
+  return slot;
+}
+
+// Whether PBO uploads with fences can be used (GL 3.2 or GLES 3.0).
+static gboolean gst_gl_texture_has_pbo_ring() {
+  return gst_gl_texture_has_fence_sync();
+}
+
+// Uploads RGBA pixels with the given row stride into the bound texture's
+// existing storage straight from client memory.
+static void gst_gl_texture_upload_pixels_direct(GstGLTexture* self,
+                                                const uint8_t* data,
+                                                gint stride,
+                                                uint32_t width,
+                                                uint32_t height) {
+  gint row_length = stride / 4;  // RGBA
+
+  if (row_length == (gint)width) {
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height,
+                    GL_RGBA, GL_UNSIGNED_BYTE, data);
+  } else if (gst_gl_texture_has_unpack_row_length()) {
+    gl_state_guard_pixel_store(&self->gl_guard, GL_UNPACK_ROW_LENGTH,
+                               row_length);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height,
+                    GL_RGBA, GL_UNSIGNED_BYTE, data);
+    gl_state_guard_pixel_store(&self->gl_guard, GL_UNPACK_ROW_LENGTH, 0);
+  } else {
+    // GLES 2.0 without EXT_unpack_subimage: upload row by row.
+    for (uint32_t y = 0; y < height; y++) {
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, width, 1,
+                      GL_RGBA, GL_UNSIGNED_BYTE, data + y * stride);
+    }
+  }
+}
+
+// Writes the frame into the next PBO of the ring and updates the bound
+// texture from it, so the transfer to the GPU runs asynchronously instead of
+// the driver consuming client memory before glTexSubImage2D returns.
+static void gst_gl_texture_upload_pixels_pbo(GstGLTexture* self,
+                                             const uint8_t* data,
+                                             gint stride,
+                                             uint32_t width,
+                                             uint32_t height) {
+  gsize row_size = width * 4;  // RGBA
+  gsize size = row_size * height;
+
+  if (!self->pbo_initialized) {
+    glGenBuffers(self->pbo_ring_depth, self->pbos);
+    self->pbo_initialized = TRUE;
+  }
+
+  guint index = self->pbo_index;
+  self->pbo_index = (index + 1) % self->pbo_ring_depth;
+
+  // If the GPU has not finished reading this PBO yet the ring is full. Let
+  // the driver orphan the old storage rather than waiting on it.
+  gboolean busy = FALSE;
+  if (self->pbo_fences[index] != nullptr) {
+    busy = glClientWaitSync(self->pbo_fences[index], 0, 0) ==
+           GL_TIMEOUT_EXPIRED;
+    glDeleteSync(self->pbo_fences[index]);
+    self->pbo_fences[index] = nullptr;
+  }
+  if (busy) {
+    texture_stats_add(&self->stats.pbo_ring_full, 1);
+  }
+
+  gl_state_guard_bind_unpack_buffer(&self->gl_guard, self->pbos[index]);
+  if (self->pbo_sizes[index] != size) {
+    // Each PBO is resized lazily as it comes around the ring.
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    self->pbo_sizes[index] = size;
+  }
+
+  GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+  if (!busy) {
+    access |= GL_MAP_UNSYNCHRONIZED_BIT;
+  }
+  uint8_t* dst =
+      (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, access);
+  if (dst == nullptr) {
+    gl_state_guard_bind_unpack_buffer(&self->gl_guard, 0);
+    gst_gl_texture_upload_pixels_direct(self, data, stride, width, height);
+    return;
+  }
+
+  if ((gsize)stride == row_size) {
+    memcpy(dst, data, size);
+  } else {
+    for (uint32_t y = 0; y < height; y++) {
+      memcpy(dst + y * row_size, data + y * stride, row_size);
+    }
+  }
+  texture_stats_add(&self->stats.bytes_copied, size);
+  glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+  // With a PBO bound the data pointer is an offset into the buffer.
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height,
+                  GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  self->pbo_fences[index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  texture_stats_add(&self->stats.pbo_uploads, 1);
+
+  // A PBO left bound would redirect Skia's own uploads, so always unbind it.
+  gl_state_guard_bind_unpack_buffer(&self->gl_guard, 0);
+}
+
+// Uploads only the dirty tiles of |frame| into |slot|, which must be bound
+// and hold the frame published right before it. Runs of adjacent dirty tiles
+// in a tile row become one glTexSubImage2D. Returns FALSE if a full upload is
+// needed instead.
+static gboolean gst_gl_texture_upload_tiles(GstGLTexture* self,
+                                            const GstGLTextureSlot* slot,
+                                            const GstGLTextureFrame* frame) {
+  if (!frame->tiles_valid || slot->sequence == 0 ||
+      frame->sequence != slot->sequence + 1 ||
+      !gst_gl_texture_has_unpack_row_length()) {
+    return FALSE;
+  }
+
+  guint columns = tile_diff_columns(frame->width);
+  guint rows = tile_diff_rows(frame->height);
+  guint uploaded = 0;
+
+  gl_state_guard_pixel_store(&self->gl_guard, GL_UNPACK_ROW_LENGTH,
+                             frame->width);
+  for (guint ty = 0; ty < rows; ty++) {
+    const guint8* row_dirty = frame->dirty_tiles + ty * columns;
+    guint y = ty * TILE_DIFF_SIZE;
+    guint h = MIN(TILE_DIFF_SIZE, frame->height - y);
+    for (guint tx = 0; tx < columns;) {
+      if (!row_dirty[tx]) {
+        tx++;
+        continue;
+      }
+      guint first = tx;
+      while (tx < columns && row_dirty[tx]) {
+        tx++;
+      }
+      guint x = first * TILE_DIFF_SIZE;
+      guint w = MIN(tx * TILE_DIFF_SIZE, frame->width) - x;
+      glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE,
+                      frame->pixels + (y * frame->width + x) * 4);
+      uploaded += tx - first;
+    }
+  }
+  gl_state_guard_pixel_store(&self->gl_guard, GL_UNPACK_ROW_LENGTH, 0);
+
+  texture_stats_add(&self->stats.tiles_uploaded, uploaded);
+  texture_stats_add(&self->stats.tiles_skipped, columns * rows - uploaded);
+  return TRUE;
+}
+
+// Uploads RGBA pixels into the bound texture, through the PBO ring when it is
+// enabled and supported.
+static void gst_gl_texture_upload_pixels(GstGLTexture* self,
+                                         const uint8_t* data,
+                                         gint stride,
+                                         uint32_t width,
+                                         uint32_t height) {
+  if (self->pbo_ring_depth > 0 && gst_gl_texture_has_pbo_ring()) {
+    gst_gl_texture_upload_pixels_pbo(self, data, stride, width, height);
+  } else {
+    gst_gl_texture_upload_pixels_direct(self, data, stride, width, height);
+  }
+}
+
+// Uploads a sample into |slot|, which must be bound, straight from the
+// mapped GstBuffer. RGBA is uploaded as is, honouring its stride; NV12/I420
+// planes are uploaded separately and converted into the texture on the GPU.
+static gboolean gst_gl_texture_upload_sample(GstGLTexture* self,
+                                             const GstGLTextureSlot* slot,
+                                             GstSample* sample,
+                                             GstVideoInfo* video_info) {
+  GstVideoFrame frame;
+  if (!gst_video_frame_map(&frame, video_info, gst_sample_get_buffer(sample),
+                           GST_MAP_READ)) {
+    return FALSE;
+  }
+
+  gboolean uploaded = TRUE;
+  if (GST_VIDEO_INFO_IS_YUV(video_info)) {
+    if (self->yuv_converter == nullptr) {
+      self->yuv_converter = yuv_gl_converter_new();
+    }
+    uploaded = yuv_gl_converter_convert(self->yuv_converter, &self->gl_guard,
+                                        &frame, slot->id);
+  } else {
+    gst_gl_texture_upload_pixels(
+        self, (const uint8_t*)GST_VIDEO_FRAME_PLANE_DATA(&frame, 0),
+        GST_VIDEO_FRAME_PLANE_STRIDE(&frame, 0),
+        GST_VIDEO_FRAME_WIDTH(&frame), GST_VIDEO_FRAME_HEIGHT(&frame));
+  }
+
+  gst_video_frame_unmap(&frame);
+  return uploaded;
+}
+
+static gboolean gst_gl_texture_restart_pipeline(GstGLTexture* self);
+static gboolean gst_gl_texture_update_flow(GstGLTexture* self);
+
+// Main-context callback that rebuilds the pipeline after the sharing mode
+// changed.
+static gboolean gst_gl_texture_restart_pipeline_cb(gpointer user_data) {
+  gst_gl_texture_restart_pipeline(GST_GL_TEXTURE(user_data));
+  return G_SOURCE_REMOVE;
+}
+
+static void gst_gl_texture_queue_restart_pipeline(GstGLTexture* self) {
+  g_main_context_invoke_full(nullptr, G_PRIORITY_DEFAULT,
+                             gst_gl_texture_restart_pipeline_cb,
+                             g_object_ref(self), g_object_unref);
+}
+
+// Gives up on GL sharing and goes back to the system-memory pipeline.
+static void gst_gl_texture_fall_back_from_sharing(GstGLTexture* self) {
+  g_atomic_int_set(&self->sharing_state, GST_GL_TEXTURE_SHARING_OFF);
+  gst_gl_texture_queue_restart_pipeline(self);
+}
+
+// Runs on the raster thread with Flutter's context current: wraps it for
+// GStreamer and asks the main thread to switch to the GLMemory pipeline.
+static void gst_gl_texture_try_share_context(GstGLTexture* self) {
+  if (gl_context_share_wrap_current(&self->gl_display, &self->gl_context)) {
+    g_atomic_int_set(&self->sharing_state, GST_GL_TEXTURE_SHARING_ACTIVE);
+    gst_gl_texture_queue_restart_pipeline(self);
+  } else {
+    g_warning("GL sharing unavailable, staying on system-memory upload");
+    g_atomic_int_set(&self->sharing_state, GST_GL_TEXTURE_SHARING_OFF);
+  }
+}
+
+static gboolean gst_gl_texture_sample_is_gl_memory(GstSample* sample) {
+  GstBuffer* buffer = gst_sample_get_buffer(sample);
+  return gst_buffer_n_memory(buffer) > 0 &&
+         gst_is_gl_memory(gst_buffer_peek_memory(buffer, 0));
+}
+
+// Makes a GLMemory sample the frame handed to Flutter: waits (on the GPU) for
+// GStreamer's rendering into it and keeps it mapped until the next frame
+// replaces it, so its texture stays valid while Flutter draws.
+static gboolean gst_gl_texture_take_gl_frame(GstGLTexture* self,
+                                             GstSample* sample,
+                                             GstVideoInfo* video_info) {
+  GstBuffer* buffer = gst_sample_get_buffer(sample);
+
+  GstGLSyncMeta* sync_meta = gst_buffer_get_gl_sync_meta(buffer);
+  if (sync_meta != nullptr) {
+    gst_gl_sync_meta_wait(sync_meta, self->gl_context);
+  }
+
+  GstVideoFrame frame;
+  if (!gst_video_frame_map(&frame, video_info, buffer,
+                           static_cast<GstMapFlags>(GST_MAP_READ | GST_MAP_GL))) {
+    return FALSE;
+  }
+
+  if (self->gl_frame_mapped) {
+    gst_video_frame_unmap(&self->gl_frame);
+  }
+  self->gl_frame = frame;
+  self->gl_frame_mapped = TRUE;
+  return TRUE;
+}
+
+// Accounts for one frame handed to Flutter by populate.
+static void gst_gl_texture_record_upload(GstGLTexture* self,
+                                         gboolean new_frame,
+                                         gint64 upload_start,
+                                         gint64 capture_time) {
+  gint64 now = g_get_monotonic_time();
+  texture_stats_add(&self->stats.frames_uploaded, 1);
+  texture_stats_histogram_record(&self->stats.upload_time, now - upload_start);
+  if (new_frame && capture_time >= 0) {
+    texture_stats_histogram_record(&self->stats.capture_latency,
+                                   now - capture_time);
+  }
+}
+
+// Binds |slot|, sized for |frame|, and uploads |frame| into it. All state
+// changes go through gl_guard.
+static gboolean gst_gl_texture_upload_frame(GstGLTexture* self,
+                                            GstGLTextureSlot* slot,
+                                            GstGLTextureFrame* frame) {
+  gst_gl_texture_ensure_storage(self, slot, frame->width, frame->height);
+
+  // Upload frame data into the existing storage
+  if (frame->sample != nullptr) {
+    return gst_gl_texture_upload_sample(self, slot, frame->sample,
+                                        &frame->video_info);
+  }
+  if (!gst_gl_texture_upload_tiles(self, slot, frame)) {
+    gst_gl_texture_upload_pixels(self, frame->pixels, frame->width * 4,
+                                 frame->width, frame->height);
+  }
+  return TRUE;
+}
+
+// Populate callback - called by Flutter to get texture
+static gboolean gst_gl_texture_populate(FlTextureGL* texture,
+                                        uint32_t* target,
+                                        uint32_t* name,
+                                        uint32_t* width,
+                                        uint32_t* height,
+                                        GError** error) {
+  GstGLTexture* self = GST_GL_TEXTURE(texture);
+
+  // Take the newest published frame, or keep drawing the current one. The
+  // front slot stays ours until the next acquire, so no lock is needed.
+  gint64 trace_start = frame_trace_begin(self->trace);
+  gboolean new_frame = frame_mailbox_acquire(&self->mailbox);
+  gst_gl_texture_trace(self, "acquire", trace_start);
+  GstGLTextureFrame* frame =
+      &self->frames[frame_mailbox_front(&self->mailbox)];
+  if ((frame->pixels == nullptr && frame->sample == nullptr) ||
+      frame->width == 0 || frame->height == 0) {
+    return FALSE;
+  }
+
+  // Flutter repaints for reasons of its own; without a new frame the texture
+  // already shows the front slot.
+  if (!new_frame) {
+    texture_stats_add(&self->stats.populates_without_new_frame, 1);
+    if (self->current_name != 0) {
+      *target = GL_TEXTURE_2D;
+      *name = self->current_name;
+      *width = frame->width;
+      *height = frame->height;
+      return TRUE;
+    }
+  }
+  self->current_name = 0;
+
+  gint64 upload_start = g_get_monotonic_time();
+
+  if (g_atomic_int_get(&self->sharing_state) ==
+      GST_GL_TEXTURE_SHARING_UNTRIED) {
+    gst_gl_texture_try_share_context(self);
+  }
+
+  // Frames from the shared-context pipeline already are textures.
+  if (frame->sample != nullptr &&
+      gst_gl_texture_sample_is_gl_memory(frame->sample)) {
+    if (!gst_gl_texture_take_gl_frame(self, frame->sample,
+                                      &frame->video_info)) {
+      return FALSE;
+    }
+    gst_gl_texture_record_upload(self, new_frame, upload_start,
+                                 frame->capture_time);
+    self->current_name =
+        *static_cast<guint*>(GST_VIDEO_FRAME_PLANE_DATA(&self->gl_frame, 0));
+    *target = GL_TEXTURE_2D;
+    *name = self->current_name;
+    *width = frame->width;
+    *height = frame->height;
+    return TRUE;
+  }
+
+  // Unless restore_gl_state is set the guard only forwards to GL, leaving
+  // the texture bound afterwards: the state pollution this plugin
+  // reproduces.
+  gl_state_guard_begin(&self->gl_guard, self->restore_gl_state);
+  if (self->restore_gl_state) {
+    gl_state_guard_reset_unpack(&self->gl_guard);
+  }
+  trace_start = frame_trace_begin(self->trace);
+  GstGLTextureSlot* slot = gst_gl_texture_next_slot(self);
+  gboolean uploaded = gst_gl_texture_upload_frame(self, slot, frame);
+  gl_state_guard_end(&self->gl_guard);
+  gst_gl_texture_trace(self, "upload", trace_start);
+  if (!uploaded) {
+    return FALSE;
+  }
+  gst_gl_texture_record_upload(self, new_frame, upload_start,
+                               frame->capture_time);
+  self->current_name = slot->id;
+  slot->sequence = frame->sequence;
+
+  *target = GL_TEXTURE_2D;
+  *name = slot->id;
+  *width = frame->width;
+  *height = frame->height;
+  return TRUE;
+}
+
+// Pads downstream GL elements ask whether the sink wants GstGLSyncMeta;
+// appsink does not answer that itself, so add it to every allocation query.
+static GstPadProbeReturn gst_gl_texture_allocation_probe(GstPad* pad,
+                                                         GstPadProbeInfo* info,
+                                                         gpointer user_data) {
+  GstQuery* query = GST_PAD_PROBE_INFO_QUERY(info);
+  if (GST_QUERY_TYPE(query) == GST_QUERY_ALLOCATION) {
+    gst_query_add_allocation_meta(query, GST_GL_SYNC_META_API_TYPE, nullptr);
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+// Stream-status ENTER is posted by the streaming thread itself before it
+// runs its loop, so the policy lands on the thread about to push buffers,
+// including those of recording and view branches added later. LEAVE is
+// posted by the thread on its way back into GStreamer's thread pool, which
+// may hand it to another pipeline, so it is put back as it was.
+static void gst_gl_texture_place_stream_thread(GstGLTexture* self,
+                                               GstMessage* message) {
+  if (thread_policy_is_default(&self->thread_policy)) {
+    return;
+  }
+  GstStreamStatusType type;
+  gst_message_parse_stream_status(message, &type, nullptr);
+  if (type == GST_STREAM_STATUS_TYPE_LEAVE) {
+    thread_placements_restore_thread(self->placements);
+    return;
+  }
+  if (type != GST_STREAM_STATUS_TYPE_ENTER) {
+    return;
+  }
+
+  ThreadPlacement placement;
+  gboolean applied = thread_placements_place(
+      self->placements, &self->thread_policy, "stream", self, &placement);
+  texture_stats_add(applied ? &self->stats.stream_threads_placed
+                            : &self->stats.stream_threads_refused,
+                    1);
+  if (!applied && self->stats.stream_threads_refused.load(
+                      std::memory_order_relaxed) == 1) {
+    g_warning("Streaming thread policy refused in part, running on CPUs "
+              "the kernel allows at %s priority %d, nice %d",
+              thread_policy_name(placement.policy), placement.priority,
+              placement.nice);
+  }
+}
+
+static GstBusSyncReply gst_gl_texture_bus_sync_cb(GstBus* bus,
+                                                  GstMessage* message,
+                                                  gpointer user_data) {
+  GstGLTexture* self = GST_GL_TEXTURE(user_data);
+
+  // Ahead of the recording routing, which claims its branch's messages.
+  if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_STREAM_STATUS) {
+    gst_gl_texture_place_stream_thread(self, message);
+  }
+
+  // A failing recording must not take the preview down with it.
+  g_mutex_lock(&self->recording_mutex);
+  gboolean recording_message =
+      self->recording != nullptr &&
+      recording_handle_message(self->recording, message);
+  g_mutex_unlock(&self->recording_mutex);
+  if (recording_message) {
+    if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_ERROR) {
+      gst_message_unref(message);
+      return GST_BUS_DROP;
+    }
+    return GST_BUS_PASS;
+  }
+
+  switch (GST_MESSAGE_TYPE(message)) {
+    case GST_MESSAGE_NEED_CONTEXT:
+      if (self->gl_pipeline &&
+          gl_context_share_handle_need_context(message, self->gl_display,
+                                               self->gl_context)) {
+        gst_message_unref(message);
+        return GST_BUS_DROP;
+      }
+      break;
+    case GST_MESSAGE_ERROR:
+      if (self->gl_pipeline) {
+        g_autoptr(GError) error = nullptr;
+        gst_message_parse_error(message, &error, nullptr);
+        g_warning("GL sharing pipeline failed (%s), falling back",
+                  error->message);
+        gst_gl_texture_fall_back_from_sharing(self);
+      }
+      break;
+    default:
+      break;
+  }
+
+  return GST_BUS_PASS;
+}
+
+// Drops the pipeline and the references to its elements. The pipeline must
+// be in the NULL state.
+static void gst_gl_texture_release_elements(GstGLTexture* self) {
+  g_clear_pointer(&self->appsink, gst_object_unref);
+  g_clear_pointer(&self->scale_caps, gst_object_unref);
+  g_clear_pointer(&self->raw_tee, gst_object_unref);
+  g_clear_pointer(&self->jpeg_tee, gst_object_unref);
+  g_clear_pointer(&self->scaled_decoder, gst_object_unref);
+  g_clear_pointer(&self->valve, gst_object_unref);
+  g_clear_pointer(&self->pipeline, gst_object_unref);
+}
+
+// Describes the elements between the raw tee and the appsink: scaling to
+// the output size and conversion to what populate uploads. Sets |format| to
+// a label for the log.
+static gchar* gst_gl_texture_convert_description(GstGLTexture* self,
+                                                 const gchar** format) {
+  // For NV12/I420 videoconvert is a passthrough whenever the decoder already
+  // produces that format; the conversion to RGBA happens in populate.
+  *format = "RGBA";
+  if (self->pixel_format == GST_GL_TEXTURE_FORMAT_NV12) {
+    *format = "NV12";
+  } else if (self->pixel_format == GST_GL_TEXTURE_FORMAT_I420) {
+    *format = "I420";
+  }
+
+  // The scale capsfilter is named so set_output_size can renegotiate it
+  // while the pipeline runs.
+  gint output_width = g_atomic_int_get(&self->output_width);
+  gint output_height = g_atomic_int_get(&self->output_height);
+  if (self->gl_pipeline) {
+    *format = "GLMemory";
+    return g_strdup_printf(
+        "videoscale ! "
+        "capsfilter name=scalecaps caps=video/x-raw,width=%d,height=%d ! "
+        "glupload ! glcolorconvert ! "
+        "video/x-raw(memory:GLMemory),format=RGBA,texture-target=2D",
+        output_width, output_height);
+  }
+  if (self->cpu_converter != nullptr) {
+    // Full-size YUV straight from the decoder; videoconvert is a passthrough
+    // unless the source produces something the converter can't read.
+    *format = "RGBA, fused convert";
+    return g_strdup("videoconvert ! " YUV_CPU_CONVERTER_CAPS);
+  }
+  return g_strdup_printf(
+      "videoscale ! "
+      "capsfilter name=scalecaps caps=video/x-raw,width=%d,height=%d ! "
+      "videoconvert ! video/x-raw,format=%s",
+      output_width, output_height, *format);
+}
+
+// Hooks the appsink up to on_new_sample.
+static void gst_gl_texture_connect_appsink(GstGLTexture* self) {
+  GstAppSinkCallbacks callbacks = {
+      nullptr,  // eos
+      nullptr,  // new_preroll
+      on_new_sample,  // new_sample
+  };
+  gst_app_sink_set_callbacks(GST_APP_SINK(self->appsink), &callbacks, self,
+                             nullptr);
+
+  if (self->gl_pipeline) {
+    g_autoptr(GstPad) sink_pad =
+        gst_element_get_static_pad(self->appsink, "sink");
+    gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_QUERY_DOWNSTREAM,
+                      gst_gl_texture_allocation_probe, nullptr, nullptr);
+  }
+}
+
+// Describes the camera source. Needs GStreamer initialized: registering
+// the decoders needs the registry, and a failed registration is remembered
+// for the whole process.
+static gchar* gst_gl_texture_camera_source(GstGLTexture* self) {
+  // Decoding 1080p MJPEG is the largest CPU cost on small boards.
+  g_autofree gchar* decoder = nullptr;
+  if (self->scaled_decode) {
+    if (jpeg_scaled_decoder_register()) {
+      decoder = g_strdup("fltexturejpegscaledec name=scaleddec");
+    } else {
+      g_warning("Failed to register the scaled decoder, ignoring "
+                "scaledDecode");
+    }
+  } else if (self->decode_workers > 1) {
+    if (jpeg_decode_pool_register()) {
+      decoder = g_strdup_printf(
+          "fltexturejpegpool name=decodepool workers=%u",
+          MIN(self->decode_workers, JPEG_DECODE_POOL_MAX_WORKERS));
+    } else {
+      g_warning("jpegdec not found, ignoring decodeWorkers");
+    }
+  }
+  return g_strdup_printf(GST_GL_TEXTURE_CAMERA_SOURCE, self->device,
+                         decoder != nullptr ? decoder : "jpegdec");
+}
+
+// Builds the pipeline and brings it to |state|. Safe to run on a worker
+// thread while the main thread leaves the pipeline fields alone (starting
+// is set).
+static gboolean gst_gl_texture_build_pipeline(GstGLTexture* self,
+                                              GstState state) {
+  // Initialize GStreamer if needed
+  if (!gst_is_initialized()) {
+    gst_init(nullptr, nullptr);
+  }
+  if (self->source == nullptr) {
+    self->source = gst_gl_texture_camera_source(self);
+  }
+
+  // Once Flutter's context is wrapped, GStreamer uploads and converts in a
+  // context sharing textures with it and the appsink receives GLMemory.
+  self->gl_pipeline = g_atomic_int_get(&self->sharing_state) ==
+                      GST_GL_TEXTURE_SHARING_ACTIVE;
+  const gchar* format = nullptr;
+  g_autofree gchar* convert_str =
+      gst_gl_texture_convert_description(self, &format);
+  gint output_width = g_atomic_int_get(&self->output_width);
+  gint output_height = g_atomic_int_get(&self->output_height);
+
+  g_autofree gchar* pipeline_str = g_strdup_printf(
+      "%s ! "
+      "tee name=rawtee ! "
+      "valve name=valve drop=%s ! "
+      "%s ! "
+      "appsink name=sink emit-signals=true max-buffers=2 drop=true",
+      self->source, self->branch_paused ? "true" : "false", convert_str);
+
+  GError* error = nullptr;
+  self->pipeline = gst_parse_launch(pipeline_str, &error);
+
+  if (error != nullptr) {
+    g_warning("Failed to create pipeline: %s", error->message);
+    g_error_free(error);
+    if (self->gl_pipeline) {
+      g_atomic_int_set(&self->sharing_state, GST_GL_TEXTURE_SHARING_OFF);
+      return gst_gl_texture_build_pipeline(self, state);
+    }
+    return FALSE;
+  }
+
+  // Get appsink and configure callbacks
+  self->appsink = gst_bin_get_by_name(GST_BIN(self->pipeline), "sink");
+  if (self->appsink == nullptr) {
+    g_warning("Failed to get appsink");
+    gst_object_unref(self->pipeline);
+    self->pipeline = nullptr;
+    return FALSE;
+  }
+
+  self->scale_caps = gst_bin_get_by_name(GST_BIN(self->pipeline), "scalecaps");
+  self->raw_tee = gst_bin_get_by_name(GST_BIN(self->pipeline), "rawtee");
+  self->jpeg_tee = gst_bin_get_by_name(GST_BIN(self->pipeline), "jpegtee");
+  self->valve = gst_bin_get_by_name(GST_BIN(self->pipeline), "valve");
+  self->scaled_decoder =
+      gst_bin_get_by_name(GST_BIN(self->pipeline), "scaleddec");
+  if (self->scaled_decoder != nullptr) {
+    g_object_set(self->scaled_decoder, "target-width", output_width,
+                 "target-height", output_height, nullptr);
+  }
+  g_autoptr(GstElement) decode_pool =
+      gst_bin_get_by_name(GST_BIN(self->pipeline), "decodepool");
+  if (decode_pool != nullptr) {
+    jpeg_decode_pool_set_thread_policy(JPEG_DECODE_POOL(decode_pool),
+                                       &self->thread_policy, self->placements);
+  }
+
+  gst_gl_texture_connect_appsink(self);
+
+  g_autoptr(GstBus) bus = gst_element_get_bus(self->pipeline);
+  gst_bus_set_sync_handler(bus, gst_gl_texture_bus_sync_cb, self, nullptr);
+
+  // Start pipeline
+  // Live sources answer PAUSED with NO_PREROLL, which is not a failure.
+  GstStateChangeReturn ret = gst_element_set_state(self->pipeline, state);
+  if (ret == GST_STATE_CHANGE_FAILURE) {
+    g_warning("Failed to start pipeline");
+    gst_element_set_state(self->pipeline, GST_STATE_NULL);
+    gst_gl_texture_release_elements(self);
+    if (self->gl_pipeline) {
+      g_atomic_int_set(&self->sharing_state, GST_GL_TEXTURE_SHARING_OFF);
+      return gst_gl_texture_build_pipeline(self, state);
+    }
+    return FALSE;
+  }
+
+  self->pipeline_state = state;
+  g_print("GStreamer pipeline %s (%s, %dx%d %s)\n",
+          state == GST_STATE_PLAYING ? "started" : "preloaded", self->source,
+          output_width, output_height, format);
+  return TRUE;
+}
+
+static void gst_gl_texture_detach_view(GstGLTexture* source,
+                                       GstGLTexture* view);
+
+// Adds |view|'s branch to the source's running pipeline. The valve comes
+// first so a paused view drops frames before its queue wakes a thread; the
+// leaky queue gives every view its own streaming thread, so a slow view
+// never holds up the source or the other views. The appsink does not
+// preroll, so joining a live pipeline leaves its state alone. Returns FALSE
+// only if the branch could not be added; with the source stopped there is
+// nothing to attach to yet.
+static gboolean gst_gl_texture_attach_view(GstGLTexture* source,
+                                           GstGLTexture* view) {
+  if (view->branch != nullptr || source->starting ||
+      source->pipeline == nullptr) {
+    return TRUE;
+  }
+
+  const gchar* format = nullptr;
+  g_autofree gchar* convert_str =
+      gst_gl_texture_convert_description(view, &format);
+  g_autofree gchar* description = g_strdup_printf(
+      "valve name=valve drop=%s ! "
+      "queue leaky=downstream max-size-buffers=1 max-size-bytes=0 "
+      "max-size-time=0 ! "
+      "%s ! "
+      "appsink name=sink emit-signals=true max-buffers=2 drop=true "
+      "async=false",
+      view->branch_paused ? "true" : "false", convert_str);
+  g_autoptr(GError) error = nullptr;
+  GstElement* bin = gst_parse_bin_from_description(description, TRUE, &error);
+  if (bin == nullptr) {
+    g_warning("Failed to create view: %s", error->message);
+    return FALSE;
+  }
+
+  view->branch = GST_ELEMENT(gst_object_ref_sink(bin));
+  view->appsink = gst_bin_get_by_name(GST_BIN(bin), "sink");
+  view->scale_caps = gst_bin_get_by_name(GST_BIN(bin), "scalecaps");
+  view->valve = gst_bin_get_by_name(GST_BIN(bin), "valve");
+  gst_gl_texture_connect_appsink(view);
+
+  gst_bin_add(GST_BIN(source->pipeline), bin);
+  view->tee_pad = gst_element_request_pad_simple(source->raw_tee, "src_%u");
+  g_autoptr(GstPad) sink_pad = gst_element_get_static_pad(bin, "sink");
+  if (!gst_element_sync_state_with_parent(bin) ||
+      gst_pad_link(view->tee_pad, sink_pad) != GST_PAD_LINK_OK) {
+    g_warning("Failed to attach view");
+    gst_gl_texture_detach_view(source, view);
+    return FALSE;
+  }
+  g_print("View attached (%dx%d %s)\n",
+          g_atomic_int_get(&view->output_width),
+          g_atomic_int_get(&view->output_height), format);
+  return TRUE;
+}
+
+// Takes |view|'s branch out of the source's pipeline. The view keeps its
+// last frame.
+static void gst_gl_texture_detach_view(GstGLTexture* source,
+                                       GstGLTexture* view) {
+  if (view->branch == nullptr) {
+    return;
+  }
+
+  // With the valve closed nothing new enters the branch; a push already
+  // under way is ignored by the tee once its pad is gone.
+  if (view->valve != nullptr) {
+    g_object_set(view->valve, "drop", TRUE, nullptr);
+  }
+  if (view->tee_pad != nullptr) {
+    gst_element_release_request_pad(source->raw_tee, view->tee_pad);
+    g_clear_pointer(&view->tee_pad, gst_object_unref);
+  }
+  gst_element_set_state(view->branch, GST_STATE_NULL);
+  gst_bin_remove(GST_BIN(source->pipeline), view->branch);
+
+  g_clear_pointer(&view->appsink, gst_object_unref);
+  g_clear_pointer(&view->scale_caps, gst_object_unref);
+  g_clear_pointer(&view->valve, gst_object_unref);
+  g_clear_pointer(&view->branch, gst_object_unref);
+}
+
+static void gst_gl_texture_attach_views(GstGLTexture* self) {
+  for (GList* l = self->views; l != nullptr; l = l->next) {
+    gst_gl_texture_attach_view(self, GST_GL_TEXTURE(l->data));
+  }
+}
+
+static void gst_gl_texture_detach_views(GstGLTexture* self) {
+  for (GList* l = self->views; l != nullptr; l = l->next) {
+    gst_gl_texture_detach_view(self, GST_GL_TEXTURE(l->data));
+  }
+}
+
+// Builds the pipeline if there is none yet, then brings it to |state|.
+// Runs on the main thread or the start worker, so on failure an existing
+// pipeline is left for the caller to stop on the main thread.
+static gboolean gst_gl_texture_bring_up(GstGLTexture* self, GstState state) {
+  if (self->pipeline == nullptr) {
+    return gst_gl_texture_build_pipeline(self, state);
+  }
+
+  if (gst_element_set_state(self->pipeline, state) ==
+      GST_STATE_CHANGE_FAILURE) {
+    g_warning("Failed to bring the pipeline to %s",
+              gst_element_state_get_name(state));
+    return FALSE;
+  }
+  self->pipeline_state = state;
+  g_print("GStreamer pipeline %s\n", gst_element_state_get_name(state));
+  return TRUE;
+}
+
+// Sets the capsfilter to the current output size, e.g. after a change that
+// arrived while the pipeline was being built.
+static void gst_gl_texture_apply_output_size(GstGLTexture* self) {
+  // The scaled decoder picks its IDCT size for the next frame and sends new
+  // caps if it changes. Views share their source's decoder, so it has to
+  // cover the largest of them.
+  GstGLTexture* source =
+      self->view_source != nullptr ? self->view_source : self;
+  if (source->scaled_decoder != nullptr) {
+    gint decode_width = g_atomic_int_get(&source->output_width);
+    gint decode_height = g_atomic_int_get(&source->output_height);
+    for (GList* l = source->views; l != nullptr; l = l->next) {
+      GstGLTexture* view = GST_GL_TEXTURE(l->data);
+      decode_width = MAX(decode_width, g_atomic_int_get(&view->output_width));
+      decode_height =
+          MAX(decode_height, g_atomic_int_get(&view->output_height));
+    }
+    g_object_set(source->scaled_decoder, "target-width", decode_width,
+                 "target-height", decode_height, nullptr);
+  }
+
+  if (self->scale_caps == nullptr) {
+    return;
+  }
+  g_autoptr(GstCaps) caps = gst_caps_new_simple(
+      "video/x-raw", "width", G_TYPE_INT,
+      g_atomic_int_get(&self->output_width), "height", G_TYPE_INT,
+      g_atomic_int_get(&self->output_height), nullptr);
+  g_object_set(self->scale_caps, "caps", caps, nullptr);
+}
+
+// Adds |view| to its source's views, attaching it if the source is running.
+// Returns FALSE if the branch could not be attached; the view stays listed
+// until it is stopped.
+static gboolean gst_gl_texture_add_view(GstGLTexture* view) {
+  GstGLTexture* source = view->view_source;
+  if (g_list_find(source->views, view) == nullptr) {
+    source->views = g_list_prepend(source->views, view);
+  }
+  if (!gst_gl_texture_attach_view(source, view)) {
+    return FALSE;
+  }
+  gst_gl_texture_apply_output_size(view);
+  return TRUE;
+}
+
+gboolean gst_gl_texture_start_pipeline(GstGLTexture* self) {
+  if (self->view_source != nullptr) {
+    if (!gst_gl_texture_add_view(self)) {
+      gst_gl_texture_stop_pipeline(self);
+      return FALSE;
+    }
+    return TRUE;
+  }
+  if (!gst_gl_texture_bring_up(self, GST_STATE_PLAYING)) {
+    gst_gl_texture_stop_pipeline(self);
+    return FALSE;
+  }
+  gst_gl_texture_attach_views(self);
+  gst_gl_texture_apply_output_size(self);
+  return TRUE;
+}
+
+typedef struct {
+  GstState state;
+  GstGLTextureStartCallback callback;
+  gpointer user_data;
+} GstGLTextureStartRequest;
+
+static void gst_gl_texture_start_thread(GTask* task,
+                                        gpointer source_object,
+                                        gpointer task_data,
+                                        GCancellable* cancellable) {
+  GstGLTexture* self = GST_GL_TEXTURE(source_object);
+  GstGLTextureStartRequest* request =
+      static_cast<GstGLTextureStartRequest*>(task_data);
+
+  if (gst_gl_texture_bring_up(self, request->state)) {
+    g_task_return_boolean(task, TRUE);
+  } else {
+    g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                            "Failed to start GStreamer pipeline");
+  }
+}
+
+// Back on the main thread: hands the pipeline fields back to it and catches
+// up with whatever was asked for while the worker had them.
+static void gst_gl_texture_start_ready(GObject* object,
+                                       GAsyncResult* result,
+                                       gpointer user_data) {
+  GstGLTexture* self = GST_GL_TEXTURE(object);
+  GstGLTextureStartRequest* request =
+      static_cast<GstGLTextureStartRequest*>(
+          g_task_get_task_data(G_TASK(result)));
+  self->starting = FALSE;
+
+  g_autoptr(GError) error = nullptr;
+  g_task_propagate_boolean(G_TASK(result), &error);
+  if (self->stop_requested) {
+    self->stop_requested = FALSE;
+    gst_gl_texture_stop_pipeline(self);
+    if (error == nullptr) {
+      error = g_error_new(G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                          "Pipeline stopped while starting");
+    }
+  } else if (error != nullptr) {
+    // Whatever the worker got up is torn down here, on the main thread.
+    gst_gl_texture_stop_pipeline(self);
+  } else if (!gst_gl_texture_restart_pipeline(self)) {
+    // A restart for a sharing change that arrived meanwhile attaches the
+    // views itself once it is up.
+    gst_gl_texture_attach_views(self);
+    gst_gl_texture_apply_output_size(self);
+    // Playing a paused texture opens its valve again.
+    if (request->state == GST_STATE_PLAYING &&
+        !gst_gl_texture_update_flow(self)) {
+      error = g_error_new(G_IO_ERROR, G_IO_ERROR_FAILED,
+                          "Failed to start GStreamer pipeline");
+    }
+  }
+
+  if (request->callback != nullptr) {
+    request->callback(self, error, request->user_data);
+  }
+}
+
+void gst_gl_texture_start_pipeline_async(GstGLTexture* self,
+                                         GstState state,
+                                         GstGLTextureStartCallback callback,
+                                         gpointer user_data) {
+  // A view only needs its branch; the source's own start reports the rest.
+  if (self->view_source != nullptr) {
+    if (state == GST_STATE_PLAYING) {
+      self->branch_paused = FALSE;
+    }
+    g_autoptr(GError) error = nullptr;
+    if (!gst_gl_texture_start_pipeline(self) ||
+        (self->branch != nullptr &&
+         !gst_gl_texture_update_flow(self->view_source))) {
+      error = g_error_new(G_IO_ERROR, G_IO_ERROR_FAILED,
+                          "Failed to attach view");
+    }
+    if (callback != nullptr) {
+      callback(self, error, user_data);
+    }
+    return;
+  }
+
+  if (self->starting) {
+    g_autoptr(GError) error = g_error_new(G_IO_ERROR, G_IO_ERROR_PENDING,
+                                          "Pipeline is already starting");
+    if (callback != nullptr) {
+      callback(self, error, user_data);
+    }
+    return;
+  }
+
+  // Playing undoes gst_gl_texture_set_paused(), or the camera would keep
+  // streaming into a closed valve.
+  if (state == GST_STATE_PLAYING) {
+    self->branch_paused = FALSE;
+  }
+
+  GstGLTextureStartRequest* request = g_new0(GstGLTextureStartRequest, 1);
+  request->state = state;
+  request->callback = callback;
+  request->user_data = user_data;
+
+  // The task keeps the texture alive until the worker is done with it.
+  self->starting = TRUE;
+  GTask* task = g_task_new(self, nullptr, gst_gl_texture_start_ready, nullptr);
+  g_task_set_task_data(task, request, g_free);
+  g_task_run_in_thread(task, gst_gl_texture_start_thread);
+  g_object_unref(task);
+}
+
+// Closes the valve of every paused branch and keeps the pipeline PLAYING
+// while any branch is not paused. Once all are, the pipeline goes to PAUSED
+// and the live source stops producing frames altogether.
+static gboolean gst_gl_texture_update_flow(GstGLTexture* self) {
+  gboolean active = !self->branch_paused;
+  g_object_set(self->valve, "drop", self->branch_paused, nullptr);
+  for (GList* l = self->views; l != nullptr; l = l->next) {
+    GstGLTexture* view = GST_GL_TEXTURE(l->data);
+    if (view->branch != nullptr) {
+      g_object_set(view->valve, "drop", view->branch_paused, nullptr);
+      active = active || !view->branch_paused;
+    }
+  }
+
+  GstState state = active ? GST_STATE_PLAYING : GST_STATE_PAUSED;
+  if (self->pipeline_state == state) {
+    return TRUE;
+  }
+  if (!gst_gl_texture_bring_up(self, state)) {
+    gst_gl_texture_stop_pipeline(self);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+gboolean gst_gl_texture_set_paused(GstGLTexture* self, gboolean paused) {
+  GstGLTexture* source =
+      self->view_source != nullptr ? self->view_source : self;
+  if (source->starting || source->pipeline == nullptr) {
+    return FALSE;
+  }
+
+  self->branch_paused = paused;
+  return gst_gl_texture_update_flow(source);
+}
+
+GstState gst_gl_texture_get_pipeline_state(GstGLTexture* self) {
+  if (self->view_source != nullptr) {
+    return self->branch != nullptr
+               ? gst_gl_texture_get_pipeline_state(self->view_source)
+               : GST_STATE_NULL;
+  }
+  return self->pipeline == nullptr ? GST_STATE_NULL : self->pipeline_state;
+}
+
+GstGLTexture* gst_gl_texture_get_view_source(GstGLTexture* self) {
+  return self->view_source;
+}
+
+GstCaps* gst_gl_texture_get_caps(GstGLTexture* self) {
+  if (self->starting || self->appsink == nullptr) {
+    return nullptr;
+  }
+  g_autoptr(GstPad) pad = gst_element_get_static_pad(self->appsink, "sink");
+  return gst_pad_get_current_caps(pad);
+}
+
+void gst_gl_texture_stop_pipeline(GstGLTexture* self) {
+  if (self->view_source != nullptr) {
+    GstGLTexture* source = self->view_source;
+    gst_gl_texture_detach_view(source, self);
+    source->views = g_list_remove(source->views, self);
+    return;
+  }
+
+  // The worker owns the pipeline; gst_gl_texture_start_ready() stops it.
+  if (self->starting) {
+    self->stop_requested = TRUE;
+    return;
+  }
+
+  if (self->pipeline != nullptr) {
+    // Let a running recording write its trailer while data still flows.
+    g_mutex_lock(&self->recording_mutex);
+    Recording* recording = self->recording;
+    self->recording = nullptr;
+    g_mutex_unlock(&self->recording_mutex);
+    if (recording != nullptr) {
+      recording_stop_sync(recording);
+    }
+
+    // The views stay listed and are attached again on the next start.
+    gst_gl_texture_detach_views(self);
+    gst_element_set_state(self->pipeline, GST_STATE_NULL);
+
+    g_autoptr(GstBus) bus = gst_element_get_bus(self->pipeline);
+    gst_bus_set_sync_handler(bus, nullptr, nullptr, nullptr);
+
+    gst_gl_texture_release_elements(self);
+
+    g_print("GStreamer pipeline stopped\n");
+  }
+}
+
+// Switches between the GLMemory and system-memory pipelines. Does nothing if
+// the pipeline was stopped in the meantime or already has the right kind.
+// The new pipeline is built and started on a worker like the first one, so
+// the device's state change never blocks the main thread. Returns TRUE if a
+// restart was started.
+static gboolean gst_gl_texture_restart_pipeline(GstGLTexture* self) {
+  gboolean want_gl = g_atomic_int_get(&self->sharing_state) ==
+                     GST_GL_TEXTURE_SHARING_ACTIVE;
+  if (self->starting || self->pipeline == nullptr ||
+      self->gl_pipeline == want_gl) {
+    return FALSE;
+  }
+
+  GstState state = self->pipeline_state;
+  gst_gl_texture_stop_pipeline(self);
+  gst_gl_texture_start_pipeline_async(self, state, nullptr, nullptr);
+  return TRUE;
+}
+
+static void gst_gl_texture_dispose(GObject* object) {
+  GstGLTexture* self = GST_GL_TEXTURE(object);
+
+  gst_gl_texture_stop_pipeline(self);
+  g_clear_object(&self->view_source);
+
+  // Note: We don't call glDeleteTextures here because:
+  // 1. The GL context may not be current
+  // 2. Flutter's texture registrar will handle texture cleanup
+  // Just reset our tracking variables
+  memset(self->textures, 0, sizeof(self->textures));
+  self->texture_index = 0;
+
+  // The PBOs and all fences belong to the same context, so they are
+  // abandoned the same way.
+  self->pbo_initialized = FALSE;
+
+  // The pipeline is stopped, so every slot is free to release.
+  for (guint i = 0; i < FRAME_MAILBOX_SLOTS; i++) {
+    GstGLTextureFrame* frame = &self->frames[i];
+    g_clear_pointer(&frame->pixels, g_free);
+    g_clear_pointer(&frame->dirty_tiles, g_free);
+    if (frame->sample != nullptr) {
+      gst_sample_unref(frame->sample);
+      frame->sample = nullptr;
+    }
+  }
+
+  if (self->gl_frame_mapped) {
+    gst_video_frame_unmap(&self->gl_frame);
+    self->gl_frame_mapped = FALSE;
+  }
+
+  if (self->gl_context != nullptr) {
+    gst_object_unref(self->gl_context);
+    self->gl_context = nullptr;
+  }
+  if (self->gl_display != nullptr) {
+    gst_object_unref(self->gl_display);
+    self->gl_display = nullptr;
+  }
+
+  G_OBJECT_CLASS(gst_gl_texture_parent_class)->dispose(object);
+}
+
+static void gst_gl_texture_finalize(GObject* object) {
+  GstGLTexture* self = GST_GL_TEXTURE(object);
+
+  g_free(self->source);
+  g_free(self->device);
+  g_list_free(self->views);
+  g_free(self->tile_reference);
+  g_clear_pointer(&self->yuv_converter, yuv_gl_converter_free);
+  g_clear_pointer(&self->cpu_converter, yuv_cpu_converter_free);
+  g_clear_pointer(&self->tap_converter, frame_tap_converter_free);
+  g_mutex_clear(&self->tap_mutex);
+  g_mutex_clear(&self->recording_mutex);
+  thread_placements_unref(self->placements);
+
+  G_OBJECT_CLASS(gst_gl_texture_parent_class)->finalize(object);
+}
+
+static void gst_gl_texture_class_init(GstGLTextureClass* klass) {
+  G_OBJECT_CLASS(klass)->dispose = gst_gl_texture_dispose;
+  G_OBJECT_CLASS(klass)->finalize = gst_gl_texture_finalize;
+  FL_TEXTURE_GL_CLASS(klass)->populate = gst_gl_texture_populate;
+}
+
+static void gst_gl_texture_init(GstGLTexture* self) {
+  memset(self->textures, 0, sizeof(self->textures));
+  self->texture_ring_depth = 1;
+  self->texture_index = 0;
+  self->current_name = 0;
+  self->pbo_ring_depth = 0;
+  memset(self->pbos, 0, sizeof(self->pbos));
+  memset(self->pbo_fences, 0, sizeof(self->pbo_fences));
+  memset(self->pbo_sizes, 0, sizeof(self->pbo_sizes));
+  self->pbo_index = 0;
+  self->pbo_initialized = FALSE;
+  self->yuv_converter = nullptr;
+  self->cpu_converter = nullptr;
+  self->sharing_state = GST_GL_TEXTURE_SHARING_OFF;
+  self->gl_display = nullptr;
+  self->gl_context = nullptr;
+  self->gl_pipeline = FALSE;
+  self->gl_frame_mapped = FALSE;
+  self->source = nullptr;
+  self->device = nullptr;
+  self->decode_workers = 0;
+  self->scaled_decode = FALSE;
+  self->pipeline = nullptr;
+  self->appsink = nullptr;
+  self->scale_caps = nullptr;
+  self->raw_tee = nullptr;
+  self->jpeg_tee = nullptr;
+  self->scaled_decoder = nullptr;
+  self->valve = nullptr;
+  self->pipeline_state = GST_STATE_NULL;
+  self->starting = FALSE;
+  self->stop_requested = FALSE;
+  self->upload_mode = GST_GL_TEXTURE_UPLOAD_ZERO_COPY;
+  self->pixel_format = GST_GL_TEXTURE_FORMAT_RGBA;
+  self->view_source = nullptr;
+  self->views = nullptr;
+  self->branch = nullptr;
+  self->tee_pad = nullptr;
+  self->branch_paused = FALSE;
+  frame_mailbox_init(&self->mailbox);
+  for (guint i = 0; i < FRAME_MAILBOX_SLOTS; i++) {
+    GstGLTextureFrame* frame = &self->frames[i];
+    frame->sample = nullptr;
+    frame->pixels = nullptr;
+    gst_video_info_init(&frame->video_info);
+    frame->width = 0;
+    frame->height = 0;
+    frame->capture_time = -1;
+    frame->sequence = 0;
+    frame->dirty_tiles = nullptr;
+    frame->n_tiles = 0;
+    frame->tiles_valid = FALSE;
+  }
+  self->restore_gl_state = FALSE;
+  gl_state_guard_init(&self->gl_guard);
+  self->trace = nullptr;
+  self->partial_updates = FALSE;
+  self->partial_update_threshold = 0;
+  self->tile_reference = nullptr;
+  self->reference_width = 0;
+  self->reference_height = 0;
+  self->sequence = 0;
+  self->output_width = GST_GL_TEXTURE_DEFAULT_OUTPUT_WIDTH;
+  self->output_height = GST_GL_TEXTURE_DEFAULT_OUTPUT_HEIGHT;
+  self->tap_enabled = FALSE;
+  self->tap_interval_us = 0;
+  self->tap_in_flight = 0;
+  self->tap_last_time = 0;
+  g_mutex_init(&self->tap_mutex);
+  memset(&self->tap_config, 0, sizeof(self->tap_config));
+  self->tap_converter = nullptr;
+  self->tap_callback = nullptr;
+  self->tap_callback_data = nullptr;
+  g_mutex_init(&self->recording_mutex);
+  self->recording = nullptr;
+  thread_policy_init(&self->thread_policy);
+  self->placements = thread_placements_new();
+  texture_stats_reset(&self->stats);
+  self->frame_callback = nullptr;
+  self->frame_callback_data = nullptr;
+  self->notify_pending = 0;
+}
+
+void gst_gl_texture_options_init(GstGLTextureOptions* options) {
+  options->source = nullptr;
+  options->device = GST_GL_TEXTURE_DEFAULT_DEVICE;
+  options->upload_mode = GST_GL_TEXTURE_UPLOAD_ZERO_COPY;
+  options->pixel_format = GST_GL_TEXTURE_FORMAT_RGBA;
+  options->pbo_ring_depth = 0;
+  options->decode_workers = 0;
+  options->scaled_decode = FALSE;
+  options->texture_ring_depth = 0;
+  options->gl_sharing = FALSE;
+  options->fused_convert = FALSE;
+  options->partial_updates = FALSE;
+  options->partial_update_threshold = 0;
+  options->restore_gl_state = FALSE;
+  options->thread_cpus = nullptr;
+  options->thread_nice = 0;
+  options->thread_rt_priority = 0;
+  options->trace = nullptr;
+}
+
+GstGLTexture* gst_gl_texture_new(const GstGLTextureOptions* options) {
+  GstGLTexture* self =
+      GST_GL_TEXTURE(g_object_new(gst_gl_texture_get_type(), nullptr));
+  if (options->source != nullptr) {
+    self->source = g_strdup(options->source);
+  } else {
+    self->device = g_strdup(options->device != nullptr
+                                ? options->device
+                                : GST_GL_TEXTURE_DEFAULT_DEVICE);
+    self->decode_workers = options->decode_workers;
+    self->scaled_decode = options->scaled_decode;
+  }
+  self->upload_mode = options->upload_mode;
+  self->pixel_format = options->pixel_format;
+  // Planes and GLMemory are only ever used from the sample itself.
+  if (self->pixel_format != GST_GL_TEXTURE_FORMAT_RGBA || options->gl_sharing) {
+    self->upload_mode = GST_GL_TEXTURE_UPLOAD_ZERO_COPY;
+  }
+  self->sharing_state = options->gl_sharing ? GST_GL_TEXTURE_SHARING_UNTRIED
+                                            : GST_GL_TEXTURE_SHARING_OFF;
+  // The fused converter writes into the frame slots, so it implies copy mode.
+  if (options->fused_convert) {
+    if (self->pixel_format == GST_GL_TEXTURE_FORMAT_RGBA &&
+        !options->gl_sharing) {
+      self->cpu_converter = yuv_cpu_converter_new();
+      self->upload_mode = GST_GL_TEXTURE_UPLOAD_COPY;
+    } else {
+      g_warning("fusedConvert needs RGBA without GL sharing, ignoring it");
+    }
+  }
+  // Tiles are diffed in the copied frames, so partial updates imply copy mode.
+  if (options->partial_updates) {
+    if (self->pixel_format == GST_GL_TEXTURE_FORMAT_RGBA &&
+        !options->gl_sharing) {
+      self->partial_updates = TRUE;
+      self->partial_update_threshold = MIN(options->partial_update_threshold,
+                                           G_MAXUINT8);
+      self->upload_mode = GST_GL_TEXTURE_UPLOAD_COPY;
+    } else {
+      g_warning("partialUpdates needs RGBA without GL sharing, ignoring it");
+    }
+  }
+  self->restore_gl_state = options->restore_gl_state;
+  if (options->thread_cpus != nullptr) {
+    self->thread_policy.has_cpus = thread_policy_parse_cpus(
+        options->thread_cpus, &self->thread_policy.cpus);
+    if (!self->thread_policy.has_cpus) {
+      g_warning("Invalid threadCpus \"%s\", ignoring it",
+                options->thread_cpus);
+    }
+  }
+  self->thread_policy.nice = CLAMP(options->thread_nice, -20, 19);
+  self->thread_policy.rt_priority = MIN(options->thread_rt_priority, 99);
+  if (self->cpu_converter != nullptr) {
+    yuv_cpu_converter_set_thread_policy(
+        self->cpu_converter, &self->thread_policy, self->placements);
+  }
+  self->trace = options->trace;
+  // A single PBO would serialize just like a client-memory upload.
+  self->pbo_ring_depth =
+      options->pbo_ring_depth == 0
+          ? 0
+          : CLAMP(options->pbo_ring_depth, 2, GST_GL_TEXTURE_MAX_PBO_RING);
+  self->texture_ring_depth = CLAMP(options->texture_ring_depth, 1,
+                                   GST_GL_TEXTURE_MAX_TEXTURE_RING);
+  return self;
+}
+
+GstGLTexture* gst_gl_texture_new_view(GstGLTexture* source,
+                                      const GstGLTextureOptions* options) {
+  // Views of a view hang off the same source.
+  if (source->view_source != nullptr) {
+    source = source->view_source;
+  }
+
+  GstGLTextureOptions view_options = *options;
+  view_options.source = "";
+  if (view_options.gl_sharing) {
+    g_warning("Views do not support glSharing, ignoring it");
+    view_options.gl_sharing = FALSE;
+  }
+  GstGLTexture* self = gst_gl_texture_new(&view_options);
+  g_clear_pointer(&self->source, g_free);
+  self->view_source = GST_GL_TEXTURE(g_object_ref(source));
+  if (self->cpu_converter != nullptr) {
+    yuv_cpu_converter_set_thread_policy(
+        self->cpu_converter, &source->thread_policy, source->placements);
+  }
+  return self;
+}
+
+void gst_gl_texture_set_frame_callback(GstGLTexture* self,
+                                       GstGLTextureFrameCallback callback,
+                                       gpointer user_data) {
+  self->frame_callback = callback;
+  self->frame_callback_data = user_data;
+}
+
+gboolean gst_gl_texture_take_frame_pending(GstGLTexture* self) {
+  return g_atomic_int_compare_and_exchange(&self->notify_pending, 1, 0);
+}
+
+void gst_gl_texture_set_output_size(GstGLTexture* self,
+                                    gint width,
+                                    gint height) {
+  // Even sizes keep 4:2:0 chroma planes whole.
+  width = CLAMP(width, GST_GL_TEXTURE_MIN_OUTPUT_SIZE,
+                GST_GL_TEXTURE_MAX_OUTPUT_SIZE) & ~1;
+  height = CLAMP(height, GST_GL_TEXTURE_MIN_OUTPUT_SIZE,
+                 GST_GL_TEXTURE_MAX_OUTPUT_SIZE) & ~1;
+  if (g_atomic_int_get(&self->output_width) == width &&
+      g_atomic_int_get(&self->output_height) == height) {
+    return;
+  }
+  g_atomic_int_set(&self->output_width, width);
+  g_atomic_int_set(&self->output_height, height);
+
+  // The fused converter picks the new size up with the next frame. Otherwise
+  // changing the capsfilter sends a reconfigure event upstream and
+  // videoscale renegotiates without the pipeline leaving PLAYING; the
+  // texture storage follows the size of the next sample. While the
+  // pipeline is starting the size is applied once it is up.
+  if (!self->starting) {
+    gst_gl_texture_apply_output_size(self);
+  }
+  g_debug("Output size set to %dx%d", width, height);
+}
+
+void gst_gl_texture_set_frame_tap(GstGLTexture* self,
+                                  const FrameTapConfig* config,
+                                  GstGLTextureFrameTapCallback callback,
+                                  gpointer user_data) {
+  g_mutex_lock(&self->tap_mutex);
+  if (config != nullptr) {
+    self->tap_config = *config;
+    if (self->tap_converter == nullptr) {
+      self->tap_converter = frame_tap_converter_new();
+    }
+    gint interval_us = 0;
+    if (config->max_fps > 0) {
+      interval_us = G_USEC_PER_SEC /
+                    MAX(config->max_fps, GST_GL_TEXTURE_MIN_TAP_FPS);
+    }
+    g_atomic_int_set(&self->tap_interval_us, interval_us);
+  }
+  self->tap_callback = config != nullptr ? callback : nullptr;
+  self->tap_callback_data = config != nullptr ? user_data : nullptr;
+  g_atomic_int_set(&self->tap_enabled, config != nullptr);
+  g_mutex_unlock(&self->tap_mutex);
+}
+
+void gst_gl_texture_frame_tap_done(GstGLTexture* self) {
+  g_atomic_int_set(&self->tap_in_flight, 0);
+}
+
+gboolean gst_gl_texture_start_recording(GstGLTexture* self,
+                                        const gchar* path,
+                                        const gchar* codec,
+                                        GError** error) {
+  if (self->starting || self->pipeline == nullptr) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_INITIALIZED,
+                "Pipeline is not running");
+    return FALSE;
+  }
+  if (self->recording != nullptr) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_BUSY, "Already recording");
+    return FALSE;
+  }
+
+  Recording* recording = recording_start(self->pipeline, self->raw_tee,
+                                         self->jpeg_tee, path, codec, error);
+  if (recording == nullptr) {
+    return FALSE;
+  }
+
+  g_mutex_lock(&self->recording_mutex);
+  self->recording = recording;
+  g_mutex_unlock(&self->recording_mutex);
+  return TRUE;
+}
+
+gboolean gst_gl_texture_stop_recording(GstGLTexture* self,
+                                       RecordingDoneCallback callback,
+                                       gpointer user_data) {
+  g_mutex_lock(&self->recording_mutex);
+  Recording* recording = self->recording;
+  self->recording = nullptr;
+  g_mutex_unlock(&self->recording_mutex);
+  if (recording == nullptr) {
+    return FALSE;
+  }
+
+  recording_stop(recording, callback, user_data);
+  return TRUE;
+}
+
+gboolean gst_gl_texture_capture_still(GstGLTexture* self,
+                                      const gchar* path,
+                                      StillCaptureCallback callback,
+                                      gpointer user_data) {
+  if (self->starting || self->pipeline == nullptr) {
+    return FALSE;
+  }
+
+  still_capture_next(self->jpeg_tee != nullptr ? self->jpeg_tee : self->raw_tee,
+                     path, callback, user_data);
+  return TRUE;
+}
+
+// Adds a histogram summary as a nested map under |key|.
+static void set_histogram(FlValue* map,
+                          const gchar* key,
+                          const TextureStatsHistogram* histogram) {
+  TextureStatsHistogramSnapshot snapshot;
+  texture_stats_histogram_snapshot(histogram, &snapshot);
+
+  FlValue* value = fl_value_new_map();
+  fl_value_set_string_take(value, "count", fl_value_new_int(snapshot.count));
+  fl_value_set_string_take(value, "mean", fl_value_new_float(snapshot.mean_us));
+  fl_value_set_string_take(value, "p50", fl_value_new_float(snapshot.p50_us));
+  fl_value_set_string_take(value, "p90", fl_value_new_float(snapshot.p90_us));
+  fl_value_set_string_take(value, "p99", fl_value_new_float(snapshot.p99_us));
+  fl_value_set_string_take(value, "max", fl_value_new_float(snapshot.max_us));
+  fl_value_set_string_take(map, key, value);
+}
+
+static void set_counter(FlValue* map,
+                        const gchar* key,
+                        const std::atomic<uint64_t>* counter) {
+  fl_value_set_string_take(
+      map, key, fl_value_new_int(counter->load(std::memory_order_relaxed)));
+}
+
+// Views report their source's threads, which also run their branches and
+// converters.
+static void gst_gl_texture_set_placement(FlValue* map, GstGLTexture* self) {
+  set_counter(map, "streamThreadsPlaced", &self->stats.stream_threads_placed);
+  set_counter(map, "streamThreadsRefused",
+              &self->stats.stream_threads_refused);
+
+  g_autoptr(GArray) entries = thread_placements_list(self->placements);
+  FlValue* threads = fl_value_new_list();
+  for (guint i = 0; i < entries->len; i++) {
+    const ThreadPlacementEntry* entry =
+        &g_array_index(entries, ThreadPlacementEntry, i);
+    g_autofree gchar* cpus =
+        thread_policy_format_cpus(&entry->placement.cpus);
+    FlValue* thread = fl_value_new_map();
+    fl_value_set_string_take(thread, "role",
+                             fl_value_new_string(entry->role));
+    fl_value_set_string_take(thread, "tid", fl_value_new_int(entry->tid));
+    fl_value_set_string_take(thread, "cpus", fl_value_new_string(cpus));
+    fl_value_set_string_take(
+        thread, "policy",
+        fl_value_new_string(thread_policy_name(entry->placement.policy)));
+    fl_value_set_string_take(thread, "priority",
+                             fl_value_new_int(entry->placement.priority));
+    fl_value_set_string_take(thread, "nice",
+                             fl_value_new_int(entry->placement.nice));
+    fl_value_set_string_take(thread, "refused",
+                             fl_value_new_bool(entry->refused));
+    fl_value_append_take(threads, thread);
+  }
+  fl_value_set_string_take(map, "placedThreads", threads);
+}
+
+FlValue* gst_gl_texture_get_stats(GstGLTexture* self) {
+  FlValue* map = fl_value_new_map();
+  set_counter(map, "framesReceived", &self->stats.frames_received);
+  set_counter(map, "framesUploaded", &self->stats.frames_uploaded);
+  set_counter(map, "framesDropped", &self->stats.frames_dropped);
+  set_counter(map, "populatesWithoutNewFrame",
+              &self->stats.populates_without_new_frame);
+  set_counter(map, "bytesCopied", &self->stats.bytes_copied);
+  set_counter(map, "pboUploads", &self->stats.pbo_uploads);
+  set_counter(map, "pboRingFull", &self->stats.pbo_ring_full);
+  set_counter(map, "textureRingFull", &self->stats.texture_ring_full);
+  set_counter(map, "tilesUploaded", &self->stats.tiles_uploaded);
+  set_counter(map, "tilesSkipped", &self->stats.tiles_skipped);
+  set_counter(map, "tapFramesDelivered", &self->stats.tap_frames_delivered);
+  set_counter(map, "tapFramesDropped", &self->stats.tap_frames_dropped);
+  gst_gl_texture_set_placement(map, self->view_source != nullptr
+                                        ? self->view_source
+                                        : self);
+  set_histogram(map, "uploadTimeUs", &self->stats.upload_time);
+  set_histogram(map, "captureLatencyUs", &self->stats.capture_latency);
+  return map;
+}
@@ -0,0 +1,252 @@
+#ifndef FL_TEXTURE_REPRO_GST_GL_TEXTURE_H_
+#define FL_TEXTURE_REPRO_GST_GL_TEXTURE_H_
+
+#include <flutter_linux/flutter_linux.h>
+
+#include "frame_tap.h"
+#include "frame_trace.h"
+#include "recording.h"
+#include "still_capture.h"
+
+G_BEGIN_DECLS
+
+// ============================================================================
+// GStreamer + FlTextureGL implementation to reproduce rendering artifact issue
+// Each GstGLTexture owns one pipeline and delivers its frames to Flutter.
+// ============================================================================
+
+G_DECLARE_FINAL_TYPE(GstGLTexture, gst_gl_texture, GST, GL_TEXTURE, FlTextureGL)
+
+// Upper bound for the "pboRingDepth" initialize argument.
+#define GST_GL_TEXTURE_MAX_PBO_RING 3
+
+// Upper bound for the "textureRingDepth" initialize argument.
+#define GST_GL_TEXTURE_MAX_TEXTURE_RING 3
+
+// How frames travel from the appsink to the GL texture.
+typedef enum {
+  // Copy every frame into frame_buffer on the streaming thread and upload
+  // from that copy (the original behaviour).
+  GST_GL_TEXTURE_UPLOAD_COPY,
+  // Keep a reference to the latest GstSample and upload straight from its
+  // mapped memory. The streaming thread never touches pixels.
+  GST_GL_TEXTURE_UPLOAD_ZERO_COPY,
+} GstGLTextureUploadMode;
+
+// Format negotiated at the appsink.
+typedef enum {
+  // Converted to RGBA on the CPU by videoconvert.
+  GST_GL_TEXTURE_FORMAT_RGBA,
+  // Uploaded as separate plane textures and converted to RGBA by a shader
+  // pass in populate. Needs GL 3.2 / GLES 3.0.
+  GST_GL_TEXTURE_FORMAT_NV12,
+  GST_GL_TEXTURE_FORMAT_I420,
+} GstGLTexturePixelFormat;
+
+// Construction options, filled from the "initialize" method call arguments.
+typedef struct {
+  // gst-launch description of the elements producing raw video, or nullptr
+  // for the MJPEG camera on |device|.
+  const gchar* source;
+  const gchar* device;
+  GstGLTextureUploadMode upload_mode;
+  GstGLTexturePixelFormat pixel_format;
+  // Number of pixel buffer objects used for uploads, 0 to upload directly.
+  guint pbo_ring_depth;
+  // Number of textures populate rotates through, so a frame is never
+  // uploaded into the texture the compositor may still be sampling. 0 or 1
+  // for a single texture. Needs GL 3.2 or GLES 3.0 for fences. Partial
+  // updates need the previous frame in the same texture, so with a ring
+  // every frame is uploaded whole.
+  guint texture_ring_depth;
+  // Decode the camera's MJPEG on this many threads with the
+  // fltexturejpegpool element instead of a single jpegdec. 0 or 1 keeps
+  // jpegdec. Only applies to the default camera source.
+  guint decode_workers;
+  // Decode the camera's MJPEG with libjpeg-turbo's scaled IDCT at the
+  // smallest of 1/8, 1/4, 1/2 or full size that still covers the output
+  // size, leaving videoscale only the rest. Recordings of raw frames and
+  // stills then get the decoded size rather than 1920x1080. Takes
+  // precedence over decode_workers. Only applies to the default camera
+  // source.
+  gboolean scaled_decode;
+  // Share Flutter's GL context with GStreamer so frames arrive as GLMemory
+  // textures. Starts on the system-memory pipeline and switches after the
+  // first populate; falls back automatically if sharing fails. Either
+  // switch rebuilds the pipeline on a worker thread, like the first start.
+  gboolean gl_sharing;
+  // Scale and convert to RGBA on the streaming thread in one SIMD pass split
+  // across worker threads, instead of videoscale ! videoconvert. RGBA only;
+  // implies GST_GL_TEXTURE_UPLOAD_COPY.
+  gboolean fused_convert;
+  // Compare each frame with the previous one in 64x64 tiles and upload only
+  // the tiles that changed. RGBA only; implies GST_GL_TEXTURE_UPLOAD_COPY.
+  gboolean partial_updates;
+  // Largest per-channel difference still treated as unchanged, to ride out
+  // sensor noise. 0 compares exactly.
+  guint partial_update_threshold;
+  // Put back the GL bindings populate changes (texture unit and binding,
+  // unpack alignment and row length, pixel unpack buffer) before returning
+  // to Flutter. Off by default so the state leak this plugin demonstrates
+  // still shows.
+  gboolean restore_gl_state;
+  // CPUs the pipeline's streaming threads (source, decoder, converters,
+  // on_new_sample) are pinned to, as a list like "2-5,7", or nullptr to
+  // leave them on any CPU.
+  const gchar* thread_cpus;
+  // Nice value for the streaming threads, 0 to leave it. Negative values
+  // need CAP_SYS_NICE.
+  gint thread_nice;
+  // SCHED_FIFO priority (1-99) for the streaming threads, 0 to keep
+  // SCHED_OTHER. Needs CAP_SYS_NICE or RLIMIT_RTPRIO; when refused the
+  // threads keep running as before and the stats say so.
+  guint thread_rt_priority;
+  // Where to record the stages of each frame, or nullptr. Not owned; must
+  // outlive the texture.
+  FrameTrace* trace;
+} GstGLTextureOptions;
+
+// Called on the streaming thread when a frame arrives and no notification is
+// pending yet for this texture. See gst_gl_texture_take_frame_pending().
+typedef void (*GstGLTextureFrameCallback)(GstGLTexture* texture,
+                                          gpointer user_data);
+
+// Called on the main thread with a tapped frame, a map as described in
+// frame_tap.h that the callee may ref. No further frame is tapped until
+// gst_gl_texture_frame_tap_done() is called, so a slow consumer makes frames
+// drop instead of queueing up.
+typedef void (*GstGLTextureFrameTapCallback)(GstGLTexture* texture,
+                                             FlValue* frame,
+                                             gpointer user_data);
+
+// Fills |options| with the defaults (camera on /dev/video0, zero-copy RGBA,
+// no PBO ring).
+void gst_gl_texture_options_init(GstGLTextureOptions* options);
+
+GstGLTexture* gst_gl_texture_new(const GstGLTextureOptions* options);
+
+// Creates a texture showing the same frames as |source| at its own output
+// size, without a pipeline of its own: starting it adds a branch to the
+// source's raw tee, so the camera is opened and decoded once however many
+// views there are. The view applies |options| to its own scaling, upload
+// and texture handling; the source-related options, the thread options
+// and gl_sharing are ignored, its branch runs under the source's thread
+// policy. A view follows its source through restarts, keeps |source|
+// alive and goes idle while the source is stopped. Recording and still
+// capture go through the source.
+GstGLTexture* gst_gl_texture_new_view(GstGLTexture* source,
+                                      const GstGLTextureOptions* options);
+
+// Source of a view, or nullptr if |texture| is not a view.
+GstGLTexture* gst_gl_texture_get_view_source(GstGLTexture* texture);
+
+// Sets the callback used to announce new frames. Must not be changed while
+// the pipeline is running.
+void gst_gl_texture_set_frame_callback(GstGLTexture* texture,
+                                       GstGLTextureFrameCallback callback,
+                                       gpointer user_data);
+
+// Clears the pending-notification flag set by a new frame. Returns TRUE if a
+// frame arrived since the last call, in which case the caller should mark the
+// texture frame available.
+gboolean gst_gl_texture_take_frame_pending(GstGLTexture* texture);
+
+// Sets the size frames are scaled to, normally the size the texture is
+// displayed at in physical pixels. Takes effect on the running pipeline
+// without restarting it. Must be called from the main thread.
+void gst_gl_texture_set_output_size(GstGLTexture* texture,
+                                    gint width,
+                                    gint height);
+
+// Starts delivering copies of the decoded frames to |callback|, converted
+// off the streaming thread as |config| asks, or stops if |config| is
+// nullptr. Must be called from the main thread.
+void gst_gl_texture_set_frame_tap(GstGLTexture* texture,
+                                  const FrameTapConfig* config,
+                                  GstGLTextureFrameTapCallback callback,
+                                  gpointer user_data);
+
+// Reports that the frame last passed to the frame tap callback has been
+// consumed. Safe to call from any thread.
+void gst_gl_texture_frame_tap_done(GstGLTexture* texture);
+
+// Starts writing the stream to |path| with |codec| (see recording.h) on a
+// branch of the running pipeline that never holds up the preview. Returns
+// FALSE and sets |error| if the pipeline is not running, a recording is
+// already in progress or the branch cannot be started. Main thread only.
+gboolean gst_gl_texture_start_recording(GstGLTexture* texture,
+                                        const gchar* path,
+                                        const gchar* codec,
+                                        GError** error);
+
+// Stops the current recording; |callback| runs on the main thread once the
+// file is finalized. Returns FALSE if nothing is being recorded. Stopping
+// the pipeline also ends the recording. Main thread only.
+gboolean gst_gl_texture_stop_recording(GstGLTexture* texture,
+                                       RecordingDoneCallback callback,
+                                       gpointer user_data);
+
+// Captures the next frame at source resolution, before it is scaled for the
+// preview: the camera's JPEG as it is, or a raw frame encoded to JPEG on a
+// worker thread. Written to |path| too unless it is nullptr. Returns FALSE
+// if the pipeline is not running. Main thread only.
+gboolean gst_gl_texture_capture_still(GstGLTexture* texture,
+                                      const gchar* path,
+                                      StillCaptureCallback callback,
+                                      gpointer user_data);
+
+// Returns a new map with the texture's performance counters: frame counts,
+// bytes copied, PBO ring usage, upload-time / capture-latency percentiles
+// in microseconds and where the streaming threads were placed. Safe to call
+// from any thread.
+FlValue* gst_gl_texture_get_stats(GstGLTexture* texture);
+
+// Called on the main thread when gst_gl_texture_start_pipeline_async()
+// finishes; |error| is nullptr on success.
+typedef void (*GstGLTextureStartCallback)(GstGLTexture* texture,
+                                          const GError* error,
+                                          gpointer user_data);
+
+// Builds the pipeline and starts it, blocking until the state change is
+// done. For a view, adds its branch to the source's pipeline and returns
+// FALSE if that fails; a view of a stopped source starts idle.
+gboolean gst_gl_texture_start_pipeline(GstGLTexture* texture);
+
+// Builds the pipeline if needed and brings it to |state| on a worker
+// thread, so gst_init(), plugin loading and opening the device do not block
+// the caller. GST_STATE_READY or GST_STATE_PAUSED preloads the pipeline;
+// a later call with GST_STATE_PLAYING then only has to start streaming.
+// GST_STATE_PLAYING also undoes gst_gl_texture_set_paused().
+// Recording and still capture are unavailable until |callback| runs. A view
+// is attached to its source and |callback| runs right away. Main thread
+// only.
+void gst_gl_texture_start_pipeline_async(GstGLTexture* texture,
+                                         GstState state,
+                                         GstGLTextureStartCallback callback,
+                                         gpointer user_data);
+
+// Moves a running pipeline to PAUSED, or back to PLAYING. A paused live
+// source stops delivering frames, so nothing is decoded, converted or
+// uploaded while the texture keeps its last frame, caps and GL storage;
+// resuming needs no renegotiation. With views, a paused texture only drops
+// its own frames at a valve and the pipeline keeps PLAYING until the
+// source and all its views are paused. Returns FALSE if there is no
+// pipeline or it is still starting. Main thread only.
+gboolean gst_gl_texture_set_paused(GstGLTexture* texture, gboolean paused);
+
+// State the pipeline was last brought to, GST_STATE_NULL if there is none.
+// Main thread only.
+GstState gst_gl_texture_get_pipeline_state(GstGLTexture* texture);
+
+// Caps currently negotiated into the texture's appsink, or nullptr if
+// there are none yet. Free with gst_caps_unref(). Main thread only.
+GstCaps* gst_gl_texture_get_caps(GstGLTexture* texture);
+
+// Stops and releases the pipeline. While an asynchronous start is in
+// progress the pipeline is stopped as soon as it finishes instead. For a
+// view, removes its branch from the source's pipeline.
+void gst_gl_texture_stop_pipeline(GstGLTexture* texture);
+
+G_END_DECLS
+
+#endif  // FL_TEXTURE_REPRO_GST_GL_TEXTURE_H_
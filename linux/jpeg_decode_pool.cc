@@ -0,0 +1,621 @@
+#include "jpeg_decode_pool.h"
+
+#include <gst/video/video.h>
+
+// One jpegdec driven through a pair of unparented pads: |feed| pushes into
+// its sink pad and |collect| receives what it outputs. Pushing a buffer
+// returns once the decoder has output the frame or dropped it, so a worker
+// thread knows exactly which frame a result belongs to.
+typedef struct {
+  GstElement* decoder;
+  GstPad* feed;
+  GstPad* collect;
+  GstPad* pool_src;   // The pool's src pad, for negotiation; not owned
+  GstBuffer* output;  // Set by collect_chain during a push
+  GstCaps* caps;      // Output caps last seen on collect
+  gboolean started;   // stream-start sent
+} JpegDecodeWorker;
+
+// A frame handed to a worker. Jobs are queued in arrival order and pushed
+// downstream in that order.
+typedef struct {
+  JpegDecodeWorker* worker;
+  GstBuffer* input;
+  GstBuffer* output;
+  GstCaps* caps;
+  GstFlowReturn result;
+  gboolean done;  // Guarded by the pool's job_mutex
+} JpegDecodeJob;
+
+struct _JpegDecodePool {
+  GstElement parent_instance;
+
+  GstPad* sinkpad;
+  GstPad* srcpad;
+  guint n_workers;  // Property, applied on NULL -> READY
+
+  // Created on NULL -> READY. |jobs| belongs to the streaming thread; each
+  // worker has at most one job in flight, the one at its position in the
+  // round-robin.
+  JpegDecodeWorker* workers;
+  guint started_workers;
+  GThreadPool* thread_pool;
+  GQueue jobs;
+  guint next_worker;
+  GMutex job_mutex;
+  GCond job_cond;
+
+  // Placement of the decoder threads; placements is nullptr if they are
+  // not placed
+  ThreadPolicy thread_policy;
+  ThreadPlacements* placements;
+
+  GstCaps* output_caps;      // Caps last pushed downstream
+  GstEvent* pending_segment;  // Held until the output caps are known
+  GstClockTime frame_duration;
+  gint flushing;  // Atomic
+};
+
+enum {
+  PROP_0,
+  PROP_WORKERS,
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
+    "sink", GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS("image/jpeg"));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE(
+    "src", GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS("video/x-raw"));
+
+G_DEFINE_TYPE(JpegDecodePool, jpeg_decode_pool, GST_TYPE_ELEMENT)
+
+// Output of the worker's decoder; one buffer per frame for JPEG.
+static GstFlowReturn collect_chain(GstPad* pad,
+                                   GstObject* parent,
+                                   GstBuffer* buffer) {
+  JpegDecodeWorker* worker =
+      static_cast<JpegDecodeWorker*>(gst_pad_get_element_private(pad));
+  gst_clear_buffer(&worker->output);
+  worker->output = buffer;
+  return GST_FLOW_OK;
+}
+
+static gboolean collect_event(GstPad* pad, GstObject* parent, GstEvent* event) {
+  JpegDecodeWorker* worker =
+      static_cast<JpegDecodeWorker*>(gst_pad_get_element_private(pad));
+  if (GST_EVENT_TYPE(event) == GST_EVENT_CAPS) {
+    GstCaps* caps;
+    gst_event_parse_caps(event, &caps);
+    gst_caps_replace(&worker->caps, caps);
+  }
+  gst_event_unref(event);
+  return TRUE;
+}
+
+// The decoders negotiate their output format with what is downstream of
+// the pool.
+static gboolean collect_query(GstPad* pad, GstObject* parent, GstQuery* query) {
+  JpegDecodeWorker* worker =
+      static_cast<JpegDecodeWorker*>(gst_pad_get_element_private(pad));
+  switch (GST_QUERY_TYPE(query)) {
+    case GST_QUERY_CAPS:
+    case GST_QUERY_ACCEPT_CAPS:
+      return gst_pad_peer_query(worker->pool_src, query);
+    default:
+      return FALSE;
+  }
+}
+
+// Runs on a pool thread.
+static void jpeg_decode_pool_run_job(gpointer data, gpointer user_data) {
+  JpegDecodePool* self = JPEG_DECODE_POOL(user_data);
+  JpegDecodeJob* job = static_cast<JpegDecodeJob*>(data);
+  JpegDecodeWorker* worker = job->worker;
+
+  // The pool is exclusive, so its threads stay ours until it is freed.
+  if (self->placements != nullptr &&
+      !thread_placements_has_thread(self->placements)) {
+    ThreadPlacement placement;
+    thread_placements_place(self->placements, &self->thread_policy, "decode",
+                            self, &placement);
+  }
+
+  GstFlowReturn result = gst_pad_push(worker->feed, job->input);
+  job->input = nullptr;
+
+  g_mutex_lock(&self->job_mutex);
+  job->result = result;
+  job->output = worker->output;
+  worker->output = nullptr;
+  job->caps = worker->caps != nullptr ? gst_caps_ref(worker->caps) : nullptr;
+  job->done = TRUE;
+  g_cond_broadcast(&self->job_cond);
+  g_mutex_unlock(&self->job_mutex);
+}
+
+static void jpeg_decode_job_free(JpegDecodeJob* job) {
+  gst_clear_buffer(&job->input);
+  gst_clear_buffer(&job->output);
+  gst_clear_caps(&job->caps);
+  g_free(job);
+}
+
+// Waits for the oldest job and takes it off the queue.
+static JpegDecodeJob* jpeg_decode_pool_pop_job(JpegDecodePool* self) {
+  JpegDecodeJob* job =
+      static_cast<JpegDecodeJob*>(g_queue_pop_head(&self->jobs));
+  g_mutex_lock(&self->job_mutex);
+  while (!job->done) {
+    g_cond_wait(&self->job_cond, &self->job_mutex);
+  }
+  g_mutex_unlock(&self->job_mutex);
+  return job;
+}
+
+// Pushes the oldest frame downstream, with new caps and the held segment
+// first if needed.
+static GstFlowReturn jpeg_decode_pool_push_oldest(JpegDecodePool* self) {
+  JpegDecodeJob* job = jpeg_decode_pool_pop_job(self);
+  GstFlowReturn result = job->result;
+
+  if (result == GST_FLOW_NOT_NEGOTIATED || result <= GST_FLOW_ERROR) {
+    GST_ELEMENT_ERROR(self, STREAM, DECODE, ("JPEG decoding failed"),
+                      ("decoder returned %s", gst_flow_get_name(result)));
+  } else if (job->output != nullptr && job->caps != nullptr) {
+    if (self->output_caps == nullptr ||
+        !gst_caps_is_equal(self->output_caps, job->caps)) {
+      gst_caps_replace(&self->output_caps, job->caps);
+      gst_pad_push_event(self->srcpad, gst_event_new_caps(job->caps));
+    }
+    if (self->pending_segment != nullptr) {
+      gst_pad_push_event(self->srcpad, self->pending_segment);
+      self->pending_segment = nullptr;
+    }
+    result = gst_pad_push(self->srcpad, job->output);
+    job->output = nullptr;
+  } else {
+    // The decoder dropped a corrupt frame; keep going like jpegdec does.
+    result = GST_FLOW_OK;
+  }
+
+  jpeg_decode_job_free(job);
+  return result;
+}
+
+// Whether the oldest job has been decoded.
+static gboolean jpeg_decode_pool_oldest_done(JpegDecodePool* self) {
+  JpegDecodeJob* job =
+      static_cast<JpegDecodeJob*>(g_queue_peek_head(&self->jobs));
+  if (job == nullptr) {
+    return FALSE;
+  }
+  g_mutex_lock(&self->job_mutex);
+  gboolean done = job->done;
+  g_mutex_unlock(&self->job_mutex);
+  return done;
+}
+
+// Pushes every frame still in flight downstream, or drops them.
+static GstFlowReturn jpeg_decode_pool_drain(JpegDecodePool* self,
+                                            gboolean push) {
+  GstFlowReturn result = GST_FLOW_OK;
+  while (!g_queue_is_empty(&self->jobs)) {
+    if (push && result == GST_FLOW_OK) {
+      result = jpeg_decode_pool_push_oldest(self);
+    } else {
+      jpeg_decode_job_free(jpeg_decode_pool_pop_job(self));
+    }
+  }
+  return result;
+}
+
+static GstFlowReturn jpeg_decode_pool_chain(GstPad* pad,
+                                            GstObject* parent,
+                                            GstBuffer* buffer) {
+  JpegDecodePool* self = JPEG_DECODE_POOL(parent);
+
+  if (g_atomic_int_get(&self->flushing)) {
+    gst_buffer_unref(buffer);
+    return GST_FLOW_FLUSHING;
+  }
+
+  // Send out what is decoded already. If the ring is full, the next worker
+  // still holds the oldest frame, so wait for that one.
+  while (jpeg_decode_pool_oldest_done(self) ||
+         g_queue_get_length(&self->jobs) == self->started_workers) {
+    GstFlowReturn result = jpeg_decode_pool_push_oldest(self);
+    if (result != GST_FLOW_OK) {
+      gst_buffer_unref(buffer);
+      return result;
+    }
+  }
+
+  JpegDecodeJob* job = g_new0(JpegDecodeJob, 1);
+  job->worker = &self->workers[self->next_worker];
+  job->input = buffer;
+  self->next_worker = (self->next_worker + 1) % self->started_workers;
+  g_queue_push_tail(&self->jobs, job);
+  g_thread_pool_push(self->thread_pool, job, nullptr);
+  return GST_FLOW_OK;
+}
+
+// Hands new input caps to every decoder. The queue is drained first, so no
+// worker is pushing meanwhile. Every buffer is one whole frame, so the
+// decoders are told the input is parsed and decode each push right away.
+static gboolean jpeg_decode_pool_set_caps(JpegDecodePool* self,
+                                          GstCaps* caps) {
+  g_autoptr(GstCaps) parsed = gst_caps_copy(caps);
+  gst_caps_set_simple(parsed, "parsed", G_TYPE_BOOLEAN, TRUE, nullptr);
+  g_autofree gchar* stream_id =
+      gst_pad_create_stream_id(self->srcpad, GST_ELEMENT(self), nullptr);
+  GstSegment segment;
+  gst_segment_init(&segment, GST_FORMAT_TIME);
+
+  for (guint i = 0; i < self->started_workers; i++) {
+    JpegDecodeWorker* worker = &self->workers[i];
+    if (!worker->started) {
+      gst_pad_push_event(worker->feed, gst_event_new_stream_start(stream_id));
+      gst_pad_push_event(worker->feed, gst_event_new_segment(&segment));
+      worker->started = TRUE;
+    }
+    if (!gst_pad_push_event(worker->feed, gst_event_new_caps(parsed))) {
+      return FALSE;
+    }
+  }
+
+  GstStructure* structure = gst_caps_get_structure(caps, 0);
+  gint num, den;
+  self->frame_duration =
+      gst_structure_get_fraction(structure, "framerate", &num, &den) &&
+              num > 0
+          ? gst_util_uint64_scale_int(GST_SECOND, den, num)
+          : GST_CLOCK_TIME_NONE;
+  return TRUE;
+}
+
+static gboolean jpeg_decode_pool_sink_event(GstPad* pad,
+                                            GstObject* parent,
+                                            GstEvent* event) {
+  JpegDecodePool* self = JPEG_DECODE_POOL(parent);
+
+  switch (GST_EVENT_TYPE(event)) {
+    case GST_EVENT_CAPS: {
+      jpeg_decode_pool_drain(self, TRUE);
+      GstCaps* caps;
+      gst_event_parse_caps(event, &caps);
+      gboolean accepted = jpeg_decode_pool_set_caps(self, caps);
+      gst_event_unref(event);
+      return accepted;
+    }
+    case GST_EVENT_SEGMENT:
+      // Output caps come from the decoders, so they can only follow the
+      // first frame; the segment has to wait for them.
+      if (self->output_caps == nullptr) {
+        gst_event_replace(&self->pending_segment, event);
+        gst_event_unref(event);
+        return TRUE;
+      }
+      break;
+    case GST_EVENT_EOS:
+      jpeg_decode_pool_drain(self, TRUE);
+      break;
+    case GST_EVENT_FLUSH_START:
+      g_atomic_int_set(&self->flushing, 1);
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      jpeg_decode_pool_drain(self, FALSE);
+      g_atomic_int_set(&self->flushing, 0);
+      break;
+    default:
+      break;
+  }
+  return gst_pad_event_default(pad, parent, event);
+}
+
+static gboolean jpeg_decode_pool_sink_query(GstPad* pad,
+                                            GstObject* parent,
+                                            GstQuery* query) {
+  if (GST_QUERY_TYPE(query) == GST_QUERY_CAPS) {
+    GstCaps* filter;
+    gst_query_parse_caps(query, &filter);
+    GstCaps* caps = gst_pad_get_pad_template_caps(pad);
+    if (filter != nullptr) {
+      GstCaps* filtered =
+          gst_caps_intersect_full(filter, caps, GST_CAPS_INTERSECT_FIRST);
+      gst_caps_unref(caps);
+      caps = filtered;
+    }
+    gst_query_set_caps_result(query, caps);
+    gst_caps_unref(caps);
+    return TRUE;
+  }
+  return gst_pad_query_default(pad, parent, query);
+}
+
+static gboolean jpeg_decode_pool_src_query(GstPad* pad,
+                                           GstObject* parent,
+                                           GstQuery* query) {
+  JpegDecodePool* self = JPEG_DECODE_POOL(parent);
+
+  switch (GST_QUERY_TYPE(query)) {
+    case GST_QUERY_CAPS: {
+      // Upstream only knows JPEG; what comes out is whatever jpegdec can
+      // produce.
+      GstCaps* filter;
+      gst_query_parse_caps(query, &filter);
+      GstCaps* caps = gst_pad_get_pad_template_caps(pad);
+      if (filter != nullptr) {
+        GstCaps* filtered =
+            gst_caps_intersect_full(filter, caps, GST_CAPS_INTERSECT_FIRST);
+        gst_caps_unref(caps);
+        caps = filtered;
+      }
+      gst_query_set_caps_result(query, caps);
+      gst_caps_unref(caps);
+      return TRUE;
+    }
+    case GST_QUERY_LATENCY: {
+      if (!gst_pad_peer_query(self->sinkpad, query)) {
+        return FALSE;
+      }
+      // A frame can wait behind one frame on every other worker.
+      if (GST_CLOCK_TIME_IS_VALID(self->frame_duration) &&
+          self->started_workers > 1) {
+        gboolean live;
+        GstClockTime min, max;
+        gst_query_parse_latency(query, &live, &min, &max);
+        GstClockTime added =
+            self->frame_duration * (self->started_workers - 1);
+        gst_query_set_latency(query, live, min + added,
+                              GST_CLOCK_TIME_IS_VALID(max) ? max + added
+                                                           : max);
+      }
+      return TRUE;
+    }
+    default:
+      return gst_pad_query_default(pad, parent, query);
+  }
+}
+
+static gboolean jpeg_decode_pool_start(JpegDecodePool* self) {
+  self->workers = g_new0(JpegDecodeWorker, self->n_workers);
+  for (guint i = 0; i < self->n_workers; i++) {
+    JpegDecodeWorker* worker = &self->workers[i];
+    worker->decoder = gst_element_factory_make("jpegdec", nullptr);
+    if (worker->decoder == nullptr) {
+      return FALSE;
+    }
+    gst_object_ref_sink(worker->decoder);
+    self->started_workers = i + 1;
+
+    worker->feed = gst_pad_new("feed", GST_PAD_SRC);
+    worker->collect = gst_pad_new("collect", GST_PAD_SINK);
+    gst_pad_set_element_private(worker->collect, worker);
+    worker->pool_src = self->srcpad;
+    gst_pad_set_chain_function(worker->collect, collect_chain);
+    gst_pad_set_event_function(worker->collect, collect_event);
+    gst_pad_set_query_function(worker->collect, collect_query);
+
+    g_autoptr(GstPad) decoder_sink =
+        gst_element_get_static_pad(worker->decoder, "sink");
+    g_autoptr(GstPad) decoder_src =
+        gst_element_get_static_pad(worker->decoder, "src");
+    gst_pad_set_active(worker->feed, TRUE);
+    gst_pad_set_active(worker->collect, TRUE);
+    if (gst_pad_link(worker->feed, decoder_sink) != GST_PAD_LINK_OK ||
+        gst_pad_link(decoder_src, worker->collect) != GST_PAD_LINK_OK ||
+        gst_element_set_state(worker->decoder, GST_STATE_PLAYING) ==
+            GST_STATE_CHANGE_FAILURE) {
+      return FALSE;
+    }
+  }
+
+  // Exclusive threads, so a placed thread never runs GLib's other work
+  // while it belongs to the pool.
+  self->thread_pool = g_thread_pool_new(jpeg_decode_pool_run_job, self,
+                                        self->n_workers, TRUE, nullptr);
+  self->next_worker = 0;
+  return self->thread_pool != nullptr;
+}
+
+static void jpeg_decode_pool_stop(JpegDecodePool* self) {
+  jpeg_decode_pool_drain(self, FALSE);
+  // GLib hands the threads of a freed pool on to other work, so they are
+  // put back while they still idle in ours.
+  if (self->placements != nullptr) {
+    thread_placements_restore_owner(self->placements, self);
+  }
+  if (self->thread_pool != nullptr) {
+    g_thread_pool_free(self->thread_pool, FALSE, TRUE);
+    self->thread_pool = nullptr;
+  }
+  for (guint i = 0; i < self->started_workers; i++) {
+    JpegDecodeWorker* worker = &self->workers[i];
+    gst_element_set_state(worker->decoder, GST_STATE_NULL);
+    gst_clear_object(&worker->decoder);
+    if (worker->feed != nullptr) {
+      gst_pad_set_active(worker->feed, FALSE);
+      gst_clear_object(&worker->feed);
+    }
+    if (worker->collect != nullptr) {
+      gst_pad_set_active(worker->collect, FALSE);
+      gst_clear_object(&worker->collect);
+    }
+    gst_clear_buffer(&worker->output);
+    gst_clear_caps(&worker->caps);
+  }
+  g_clear_pointer(&self->workers, g_free);
+  self->started_workers = 0;
+}
+
+static GstStateChangeReturn jpeg_decode_pool_change_state(
+    GstElement* element,
+    GstStateChange transition) {
+  JpegDecodePool* self = JPEG_DECODE_POOL(element);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_NULL_TO_READY:
+      if (!jpeg_decode_pool_start(self)) {
+        GST_ELEMENT_ERROR(self, CORE, MISSING_PLUGIN,
+                          ("Could not start the JPEG decoders"), (nullptr));
+        jpeg_decode_pool_stop(self);
+        return GST_STATE_CHANGE_FAILURE;
+      }
+      break;
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      g_atomic_int_set(&self->flushing, 0);
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      // Lets a chain call in progress return so the pads can deactivate.
+      g_atomic_int_set(&self->flushing, 1);
+      break;
+    default:
+      break;
+  }
+
+  GstStateChangeReturn result =
+      GST_ELEMENT_CLASS(jpeg_decode_pool_parent_class)
+          ->change_state(element, transition);
+  if (result == GST_STATE_CHANGE_FAILURE) {
+    return result;
+  }
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      jpeg_decode_pool_drain(self, FALSE);
+      gst_caps_replace(&self->output_caps, nullptr);
+      gst_event_replace(&self->pending_segment, nullptr);
+      for (guint i = 0; i < self->started_workers; i++) {
+        self->workers[i].started = FALSE;
+      }
+      break;
+    case GST_STATE_CHANGE_READY_TO_NULL:
+      jpeg_decode_pool_stop(self);
+      break;
+    default:
+      break;
+  }
+  return result;
+}
+
+static void jpeg_decode_pool_set_property(GObject* object,
+                                          guint prop_id,
+                                          const GValue* value,
+                                          GParamSpec* pspec) {
+  JpegDecodePool* self = JPEG_DECODE_POOL(object);
+  switch (prop_id) {
+    case PROP_WORKERS:
+      self->n_workers = g_value_get_uint(value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+      break;
+  }
+}
+
+static void jpeg_decode_pool_get_property(GObject* object,
+                                          guint prop_id,
+                                          GValue* value,
+                                          GParamSpec* pspec) {
+  JpegDecodePool* self = JPEG_DECODE_POOL(object);
+  switch (prop_id) {
+    case PROP_WORKERS:
+      g_value_set_uint(value, self->n_workers);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+      break;
+  }
+}
+
+static void jpeg_decode_pool_finalize(GObject* object) {
+  JpegDecodePool* self = JPEG_DECODE_POOL(object);
+
+  jpeg_decode_pool_stop(self);
+  g_clear_pointer(&self->placements, thread_placements_unref);
+  gst_caps_replace(&self->output_caps, nullptr);
+  gst_event_replace(&self->pending_segment, nullptr);
+  g_mutex_clear(&self->job_mutex);
+  g_cond_clear(&self->job_cond);
+
+  G_OBJECT_CLASS(jpeg_decode_pool_parent_class)->finalize(object);
+}
+
+static void jpeg_decode_pool_class_init(JpegDecodePoolClass* klass) {
+  GObjectClass* object_class = G_OBJECT_CLASS(klass);
+  GstElementClass* element_class = GST_ELEMENT_CLASS(klass);
+
+  object_class->set_property = jpeg_decode_pool_set_property;
+  object_class->get_property = jpeg_decode_pool_get_property;
+  object_class->finalize = jpeg_decode_pool_finalize;
+  element_class->change_state = jpeg_decode_pool_change_state;
+
+  g_object_class_install_property(
+      object_class, PROP_WORKERS,
+      g_param_spec_uint("workers", "Workers", "Number of decoder threads", 1,
+                        JPEG_DECODE_POOL_MAX_WORKERS,
+                        jpeg_decode_pool_default_workers(),
+                        static_cast<GParamFlags>(G_PARAM_READWRITE |
+                                                 G_PARAM_STATIC_STRINGS)));
+
+  gst_element_class_add_static_pad_template(element_class, &sink_template);
+  gst_element_class_add_static_pad_template(element_class, &src_template);
+  gst_element_class_set_static_metadata(
+      element_class, "JPEG decoder pool", "Codec/Decoder/Image",
+      "Decodes JPEG frames on several jpegdec instances in parallel",
+      "fl_texture_repro");
+}
+
+static void jpeg_decode_pool_init(JpegDecodePool* self) {
+  self->sinkpad = gst_pad_new_from_static_template(&sink_template, "sink");
+  gst_pad_set_chain_function(self->sinkpad, jpeg_decode_pool_chain);
+  gst_pad_set_event_function(self->sinkpad, jpeg_decode_pool_sink_event);
+  gst_pad_set_query_function(self->sinkpad, jpeg_decode_pool_sink_query);
+  gst_element_add_pad(GST_ELEMENT(self), self->sinkpad);
+
+  self->srcpad = gst_pad_new_from_static_template(&src_template, "src");
+  gst_pad_set_query_function(self->srcpad, jpeg_decode_pool_src_query);
+  gst_element_add_pad(GST_ELEMENT(self), self->srcpad);
+
+  self->n_workers = jpeg_decode_pool_default_workers();
+  self->workers = nullptr;
+  self->started_workers = 0;
+  self->thread_pool = nullptr;
+  g_queue_init(&self->jobs);
+  self->next_worker = 0;
+  g_mutex_init(&self->job_mutex);
+  g_cond_init(&self->job_cond);
+  thread_policy_init(&self->thread_policy);
+  self->placements = nullptr;
+  self->output_caps = nullptr;
+  self->pending_segment = nullptr;
+  self->frame_duration = GST_CLOCK_TIME_NONE;
+  self->flushing = 1;
+}
+
+guint jpeg_decode_pool_default_workers() {
+  return CLAMP(g_get_num_processors(), 1, 4);
+}
+
+gboolean jpeg_decode_pool_register() {
+  static gsize registered = 0;
+  if (g_once_init_enter(&registered)) {
+    g_autoptr(GstElementFactory) jpegdec = gst_element_factory_find("jpegdec");
+    gboolean ok = jpegdec != nullptr &&
+                  gst_element_register(nullptr, "fltexturejpegpool",
+                                       GST_RANK_NONE,
+                                       jpeg_decode_pool_get_type());
+    g_once_init_leave(&registered, ok ? 2 : 1);
+  }
+  return registered == 2;
+}
+
+void jpeg_decode_pool_set_thread_policy(JpegDecodePool* self,
+                                        const ThreadPolicy* policy,
+                                        ThreadPlacements* placements) {
+  g_clear_pointer(&self->placements, thread_placements_unref);
+  if (!thread_policy_is_default(policy)) {
+    self->thread_policy = *policy;
+    self->placements = thread_placements_ref(placements);
+  }
+}
@@ -0,0 +1,43 @@
+#ifndef FL_TEXTURE_REPRO_JPEG_DECODE_POOL_H_
+#define FL_TEXTURE_REPRO_JPEG_DECODE_POOL_H_
+
+#include <gst/gst.h>
+
+#include "thread_policy.h"
+
+G_BEGIN_DECLS
+
+// "fltexturejpegpool": a drop-in for jpegdec that decodes on several
+// threads. Each worker owns a jpegdec; frames go to the workers round-robin
+// and decoded frames are pushed downstream in the order they arrived, so
+// timestamps stay monotonic. Finished frames go out whenever the next frame
+// comes in, and a worker only takes a new frame once its previous one has
+// been pushed, which bounds the added latency to one frame per worker.
+//
+// Properties:
+//   workers  number of decoder threads, 1 to JPEG_DECODE_POOL_MAX_WORKERS
+G_DECLARE_FINAL_TYPE(JpegDecodePool,
+                     jpeg_decode_pool,
+                     JPEG,
+                     DECODE_POOL,
+                     GstElement)
+
+#define JPEG_DECODE_POOL_MAX_WORKERS 8
+
+// Makes "fltexturejpegpool" available to gst_parse_launch(). Safe to call
+// more than once. Returns FALSE if jpegdec is not installed.
+gboolean jpeg_decode_pool_register();
+
+// Worker count used when the property is not set: one per core, up to 4.
+guint jpeg_decode_pool_default_workers();
+
+// Has each decoder thread apply |policy| to itself before its first frame
+// and list itself in |placements| as "decode". The threads are put back as
+// they were when the pool goes back to NULL. Call while in NULL.
+void jpeg_decode_pool_set_thread_policy(JpegDecodePool* pool,
+                                        const ThreadPolicy* policy,
+                                        ThreadPlacements* placements);
+
+G_END_DECLS
+
+#endif  // FL_TEXTURE_REPRO_JPEG_DECODE_POOL_H_
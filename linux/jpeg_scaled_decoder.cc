@@ -0,0 +1,518 @@
+#include "jpeg_scaled_decoder.h"
+
+#include <gst/video/video.h>
+#include <setjmp.h>
+#include <stdio.h>
+
+#include <cstring>
+
+// jpeglib.h uses FILE without including stdio.h itself.
+#include <jpeglib.h>
+
+// libjpeg 7 split the per-component IDCT size in two; libjpeg-turbo keeps
+// the 6b layout unless built for the newer API.
+#if JPEG_LIB_VERSION >= 70
+#define JPEG_COMP_SCALED_WIDTH(comp) ((comp)->DCT_h_scaled_size)
+#define JPEG_COMP_SCALED_HEIGHT(comp) ((comp)->DCT_v_scaled_size)
+#else
+#define JPEG_COMP_SCALED_WIDTH(comp) ((comp)->DCT_scaled_size)
+#define JPEG_COMP_SCALED_HEIGHT(comp) ((comp)->DCT_scaled_size)
+#endif
+
+// Most rows jpeg_read_raw_data() produces for one component in a call.
+#define JPEG_SCALED_DECODER_MAX_ROWS (MAX_SAMP_FACTOR * DCTSIZE)
+
+// libjpeg reports fatal errors by calling error_exit, which must not return.
+typedef struct {
+  struct jpeg_error_mgr mgr;
+  jmp_buf jump;
+  gchar message[JMSG_LENGTH_MAX];
+} JpegScaledDecoderError;
+
+struct _JpegScaledDecoder {
+  GstElement parent_instance;
+
+  GstPad* sinkpad;
+  GstPad* srcpad;
+  gint target_width;   // Atomic, set from any thread
+  gint target_height;  // Atomic
+
+  struct jpeg_decompress_struct cinfo;
+  JpegScaledDecoderError error;
+
+  // The frame being decoded. Kept here rather than on the stack so the
+  // error path after a longjmp can release it.
+  GstBuffer* output;
+  GstVideoFrame frame;
+  gboolean frame_mapped;
+  // Padded rows jpeg_read_raw_data() decodes into, one area per component.
+  guint8* scratch[3];
+  gsize scratch_size[3];
+
+  GstVideoInfo info;       // Output format last pushed downstream
+  gboolean caps_sent;
+  gint fps_n;              // From the input caps
+  gint fps_d;
+  GstEvent* pending_segment;  // Held until the output caps are known
+};
+
+enum {
+  PROP_0,
+  PROP_TARGET_WIDTH,
+  PROP_TARGET_HEIGHT,
+};
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
+    "sink", GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS("image/jpeg"));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE(
+    "src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE("{I420,Y42B,Y444,GRAY8,RGBx}")));
+
+G_DEFINE_TYPE(JpegScaledDecoder, jpeg_scaled_decoder, GST_TYPE_ELEMENT)
+
+static void jpeg_scaled_decoder_error_exit(j_common_ptr cinfo) {
+  JpegScaledDecoderError* error =
+      reinterpret_cast<JpegScaledDecoderError*>(cinfo->err);
+  cinfo->err->format_message(cinfo, error->message);
+  longjmp(error->jump, 1);
+}
+
+// Corrupt-data warnings would otherwise go to stderr on every bad frame.
+static void jpeg_scaled_decoder_output_message(j_common_ptr cinfo) {}
+
+guint jpeg_scaled_decoder_scale(guint width,
+                                guint height,
+                                guint target_width,
+                                guint target_height) {
+  guint num = 1;
+  while (num < 8 && ((width * num + 7) / 8 < target_width ||
+                     (height * num + 7) / 8 < target_height)) {
+    num *= 2;
+  }
+  return num;
+}
+
+// Picks the raw output format matching the component sizes libjpeg will
+// decode at, or GST_VIDEO_FORMAT_UNKNOWN if there is none. For subsampled
+// chroma libjpeg prefers a larger IDCT over upsampling, so e.g. a 4:2:0
+// JPEG decoded at 1/2 comes out as 4:4:4.
+static GstVideoFormat jpeg_scaled_decoder_raw_format(
+    j_decompress_ptr cinfo) {
+  if (cinfo->num_components == 1 &&
+      cinfo->jpeg_color_space == JCS_GRAYSCALE) {
+    return GST_VIDEO_FORMAT_GRAY8;
+  }
+  if (cinfo->num_components != 3 || cinfo->jpeg_color_space != JCS_YCbCr) {
+    return GST_VIDEO_FORMAT_UNKNOWN;
+  }
+
+  JDIMENSION width = cinfo->comp_info[0].downsampled_width;
+  JDIMENSION height = cinfo->comp_info[0].downsampled_height;
+  JDIMENSION chroma_width = cinfo->comp_info[1].downsampled_width;
+  JDIMENSION chroma_height = cinfo->comp_info[1].downsampled_height;
+  if (cinfo->comp_info[2].downsampled_width != chroma_width ||
+      cinfo->comp_info[2].downsampled_height != chroma_height ||
+      width != cinfo->output_width || height != cinfo->output_height) {
+    return GST_VIDEO_FORMAT_UNKNOWN;
+  }
+  if (chroma_width == width && chroma_height == height) {
+    return GST_VIDEO_FORMAT_Y444;
+  }
+  if (chroma_width == (width + 1) / 2 && chroma_height == height) {
+    return GST_VIDEO_FORMAT_Y42B;
+  }
+  if (chroma_width == (width + 1) / 2 && chroma_height == (height + 1) / 2) {
+    return GST_VIDEO_FORMAT_I420;
+  }
+  return GST_VIDEO_FORMAT_UNKNOWN;
+}
+
+// Pushes new caps (and the held segment) if the output format changed.
+static gboolean jpeg_scaled_decoder_update_caps(JpegScaledDecoder* self,
+                                                GstVideoFormat format,
+                                                guint width,
+                                                guint height) {
+  GstVideoInfo info;
+  gst_video_info_set_format(&info, format, width, height);
+  GST_VIDEO_INFO_FPS_N(&info) = self->fps_n;
+  GST_VIDEO_INFO_FPS_D(&info) = self->fps_d;
+  if (GST_VIDEO_INFO_IS_YUV(&info)) {
+    // JFIF: full-range BT.601.
+    info.colorimetry.range = GST_VIDEO_COLOR_RANGE_0_255;
+    info.colorimetry.matrix = GST_VIDEO_COLOR_MATRIX_BT601;
+    info.colorimetry.transfer = GST_VIDEO_TRANSFER_UNKNOWN;
+    info.colorimetry.primaries = GST_VIDEO_COLOR_PRIMARIES_UNKNOWN;
+  }
+  if (self->caps_sent && gst_video_info_is_equal(&info, &self->info)) {
+    return TRUE;
+  }
+
+  GstCaps* caps = gst_video_info_to_caps(&info);
+  gboolean accepted =
+      gst_pad_push_event(self->srcpad, gst_event_new_caps(caps));
+  gst_caps_unref(caps);
+  if (!accepted) {
+    return FALSE;
+  }
+  self->info = info;
+  self->caps_sent = TRUE;
+  if (self->pending_segment != nullptr) {
+    gst_pad_push_event(self->srcpad, self->pending_segment);
+    self->pending_segment = nullptr;
+  }
+  return TRUE;
+}
+
+// Decodes the planes without color conversion. Each call of
+// jpeg_read_raw_data() yields one iMCU row padded to whole blocks, which
+// can be wider than the frame's stride, so the rows go through scratch and
+// only the visible part is copied.
+static void jpeg_scaled_decoder_read_raw(JpegScaledDecoder* self) {
+  j_decompress_ptr cinfo = &self->cinfo;
+  JSAMPROW rows[3][JPEG_SCALED_DECODER_MAX_ROWS];
+  JSAMPARRAY planes[3];
+  guint row_count[3];
+  guint row_width[3];
+
+  for (int c = 0; c < cinfo->num_components; c++) {
+    jpeg_component_info* comp = &cinfo->comp_info[c];
+    row_count[c] = comp->v_samp_factor * JPEG_COMP_SCALED_HEIGHT(comp);
+    row_width[c] = comp->width_in_blocks * JPEG_COMP_SCALED_WIDTH(comp);
+    gsize size = static_cast<gsize>(row_width[c]) * row_count[c];
+    if (self->scratch_size[c] < size) {
+      self->scratch[c] =
+          static_cast<guint8*>(g_realloc(self->scratch[c], size));
+      self->scratch_size[c] = size;
+    }
+    for (guint r = 0; r < row_count[c]; r++) {
+      rows[c][r] = self->scratch[c] + r * row_width[c];
+    }
+    planes[c] = rows[c];
+  }
+
+  for (guint imcu_row = 0; cinfo->output_scanline < cinfo->output_height;
+       imcu_row++) {
+    // The luma rows of one iMCU row, which is what libjpeg asks for.
+    jpeg_read_raw_data(cinfo, planes, row_count[0]);
+    for (int c = 0; c < cinfo->num_components; c++) {
+      guint8* dst =
+          static_cast<guint8*>(GST_VIDEO_FRAME_COMP_DATA(&self->frame, c));
+      gint stride = GST_VIDEO_FRAME_COMP_STRIDE(&self->frame, c);
+      guint width = GST_VIDEO_FRAME_COMP_WIDTH(&self->frame, c);
+      guint height = GST_VIDEO_FRAME_COMP_HEIGHT(&self->frame, c);
+      for (guint r = 0; r < row_count[c]; r++) {
+        guint y = imcu_row * row_count[c] + r;
+        if (y >= height) {
+          break;
+        }
+        memcpy(dst + y * stride, rows[c][r], width);
+      }
+    }
+  }
+}
+
+// Decodes RGBx a scanline at a time, for layouts with no raw format.
+static void jpeg_scaled_decoder_read_scanlines(JpegScaledDecoder* self) {
+  j_decompress_ptr cinfo = &self->cinfo;
+  guint8* dst =
+      static_cast<guint8*>(GST_VIDEO_FRAME_PLANE_DATA(&self->frame, 0));
+  gint stride = GST_VIDEO_FRAME_PLANE_STRIDE(&self->frame, 0);
+  while (cinfo->output_scanline < cinfo->output_height) {
+    JSAMPROW row = dst + cinfo->output_scanline * stride;
+    jpeg_read_scanlines(cinfo, &row, 1);
+  }
+}
+
+// Returns the decoded frame in |output|, or leaves it nullptr if the frame
+// was dropped.
+static GstFlowReturn jpeg_scaled_decoder_decode(JpegScaledDecoder* self,
+                                                guint8* data,
+                                                gsize size,
+                                                GstBuffer** output) {
+  j_decompress_ptr cinfo = &self->cinfo;
+
+  if (setjmp(self->error.jump) != 0) {
+    jpeg_abort_decompress(cinfo);
+    if (self->frame_mapped) {
+      gst_video_frame_unmap(&self->frame);
+      self->frame_mapped = FALSE;
+    }
+    gst_clear_buffer(&self->output);
+    // Cameras send the odd broken frame; drop it like jpegdec does.
+    GST_ELEMENT_WARNING(self, STREAM, DECODE, ("Dropped a corrupt JPEG frame"),
+                        ("%s", self->error.message));
+    return GST_FLOW_OK;
+  }
+
+  jpeg_mem_src(cinfo, data, size);
+  jpeg_read_header(cinfo, TRUE);
+  cinfo->scale_num = jpeg_scaled_decoder_scale(
+      cinfo->image_width, cinfo->image_height,
+      g_atomic_int_get(&self->target_width),
+      g_atomic_int_get(&self->target_height));
+  cinfo->scale_denom = 8;
+  cinfo->raw_data_out = TRUE;
+  cinfo->out_color_space = cinfo->jpeg_color_space;
+  jpeg_calc_output_dimensions(cinfo);
+  GstVideoFormat format = jpeg_scaled_decoder_raw_format(cinfo);
+  if (format == GST_VIDEO_FORMAT_UNKNOWN) {
+    format = GST_VIDEO_FORMAT_RGBx;
+    cinfo->raw_data_out = FALSE;
+    cinfo->out_color_space = JCS_EXT_RGBX;
+  }
+  jpeg_start_decompress(cinfo);
+
+  if (!jpeg_scaled_decoder_update_caps(self, format, cinfo->output_width,
+                                       cinfo->output_height)) {
+    jpeg_abort_decompress(cinfo);
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+
+  self->output = gst_buffer_new_allocate(nullptr, self->info.size, nullptr);
+  if (!gst_video_frame_map(&self->frame, &self->info, self->output,
+                           GST_MAP_WRITE)) {
+    jpeg_abort_decompress(cinfo);
+    gst_clear_buffer(&self->output);
+    return GST_FLOW_ERROR;
+  }
+  self->frame_mapped = TRUE;
+
+  if (cinfo->raw_data_out) {
+    jpeg_scaled_decoder_read_raw(self);
+  } else {
+    jpeg_scaled_decoder_read_scanlines(self);
+  }
+  jpeg_finish_decompress(cinfo);
+
+  gst_video_frame_unmap(&self->frame);
+  self->frame_mapped = FALSE;
+  *output = self->output;
+  self->output = nullptr;
+  return GST_FLOW_OK;
+}
+
+static GstFlowReturn jpeg_scaled_decoder_chain(GstPad* pad,
+                                               GstObject* parent,
+                                               GstBuffer* buffer) {
+  JpegScaledDecoder* self = JPEG_SCALED_DECODER(parent);
+
+  GstMapInfo map;
+  if (!gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+    gst_buffer_unref(buffer);
+    GST_ELEMENT_ERROR(self, RESOURCE, READ, ("Could not map JPEG frame"),
+                      (nullptr));
+    return GST_FLOW_ERROR;
+  }
+  GstBuffer* output = nullptr;
+  GstFlowReturn result =
+      jpeg_scaled_decoder_decode(self, map.data, map.size, &output);
+  gst_buffer_unmap(buffer, &map);
+
+  if (output == nullptr) {
+    gst_buffer_unref(buffer);
+    return result;
+  }
+  gst_buffer_copy_into(output, buffer, GST_BUFFER_COPY_TIMESTAMPS, 0, -1);
+  gst_buffer_unref(buffer);
+  return gst_pad_push(self->srcpad, output);
+}
+
+static gboolean jpeg_scaled_decoder_sink_event(GstPad* pad,
+                                               GstObject* parent,
+                                               GstEvent* event) {
+  JpegScaledDecoder* self = JPEG_SCALED_DECODER(parent);
+
+  switch (GST_EVENT_TYPE(event)) {
+    case GST_EVENT_CAPS: {
+      // The output caps depend on the first frame; only the framerate is
+      // taken from here.
+      GstCaps* caps;
+      gst_event_parse_caps(event, &caps);
+      GstStructure* structure = gst_caps_get_structure(caps, 0);
+      if (!gst_structure_get_fraction(structure, "framerate", &self->fps_n,
+                                      &self->fps_d)) {
+        self->fps_n = 0;
+        self->fps_d = 1;
+      }
+      gst_event_unref(event);
+      return TRUE;
+    }
+    case GST_EVENT_SEGMENT:
+      if (!self->caps_sent) {
+        gst_event_replace(&self->pending_segment, event);
+        gst_event_unref(event);
+        return TRUE;
+      }
+      break;
+    default:
+      break;
+  }
+  return gst_pad_event_default(pad, parent, event);
+}
+
+// Answers a CAPS query with the pad template, narrowed by the filter.
+static gboolean jpeg_scaled_decoder_template_caps(GstPad* pad,
+                                                  GstQuery* query) {
+  GstCaps* filter;
+  gst_query_parse_caps(query, &filter);
+  GstCaps* caps = gst_pad_get_pad_template_caps(pad);
+  if (filter != nullptr) {
+    GstCaps* filtered =
+        gst_caps_intersect_full(filter, caps, GST_CAPS_INTERSECT_FIRST);
+    gst_caps_unref(caps);
+    caps = filtered;
+  }
+  gst_query_set_caps_result(query, caps);
+  gst_caps_unref(caps);
+  return TRUE;
+}
+
+static gboolean jpeg_scaled_decoder_query(GstPad* pad,
+                                          GstObject* parent,
+                                          GstQuery* query) {
+  if (GST_QUERY_TYPE(query) == GST_QUERY_CAPS) {
+    return jpeg_scaled_decoder_template_caps(pad, query);
+  }
+  return gst_pad_query_default(pad, parent, query);
+}
+
+static GstStateChangeReturn jpeg_scaled_decoder_change_state(
+    GstElement* element,
+    GstStateChange transition) {
+  JpegScaledDecoder* self = JPEG_SCALED_DECODER(element);
+
+  GstStateChangeReturn result =
+      GST_ELEMENT_CLASS(jpeg_scaled_decoder_parent_class)
+          ->change_state(element, transition);
+  if (result == GST_STATE_CHANGE_FAILURE) {
+    return result;
+  }
+
+  if (transition == GST_STATE_CHANGE_PAUSED_TO_READY) {
+    self->caps_sent = FALSE;
+    gst_event_replace(&self->pending_segment, nullptr);
+  }
+  return result;
+}
+
+static void jpeg_scaled_decoder_set_property(GObject* object,
+                                             guint prop_id,
+                                             const GValue* value,
+                                             GParamSpec* pspec) {
+  JpegScaledDecoder* self = JPEG_SCALED_DECODER(object);
+  switch (prop_id) {
+    case PROP_TARGET_WIDTH:
+      g_atomic_int_set(&self->target_width, g_value_get_int(value));
+      break;
+    case PROP_TARGET_HEIGHT:
+      g_atomic_int_set(&self->target_height, g_value_get_int(value));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+      break;
+  }
+}
+
+static void jpeg_scaled_decoder_get_property(GObject* object,
+                                             guint prop_id,
+                                             GValue* value,
+                                             GParamSpec* pspec) {
+  JpegScaledDecoder* self = JPEG_SCALED_DECODER(object);
+  switch (prop_id) {
+    case PROP_TARGET_WIDTH:
+      g_value_set_int(value, g_atomic_int_get(&self->target_width));
+      break;
+    case PROP_TARGET_HEIGHT:
+      g_value_set_int(value, g_atomic_int_get(&self->target_height));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+      break;
+  }
+}
+
+static void jpeg_scaled_decoder_finalize(GObject* object) {
+  JpegScaledDecoder* self = JPEG_SCALED_DECODER(object);
+
+  jpeg_destroy_decompress(&self->cinfo);
+  for (int c = 0; c < 3; c++) {
+    g_free(self->scratch[c]);
+  }
+  gst_event_replace(&self->pending_segment, nullptr);
+
+  G_OBJECT_CLASS(jpeg_scaled_decoder_parent_class)->finalize(object);
+}
+
+static void jpeg_scaled_decoder_class_init(JpegScaledDecoderClass* klass) {
+  GObjectClass* object_class = G_OBJECT_CLASS(klass);
+  GstElementClass* element_class = GST_ELEMENT_CLASS(klass);
+
+  object_class->set_property = jpeg_scaled_decoder_set_property;
+  object_class->get_property = jpeg_scaled_decoder_get_property;
+  object_class->finalize = jpeg_scaled_decoder_finalize;
+  element_class->change_state = jpeg_scaled_decoder_change_state;
+
+  GParamFlags flags =
+      static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property(
+      object_class, PROP_TARGET_WIDTH,
+      g_param_spec_int("target-width", "Target width",
+                       "Smallest output width wanted, 0 for full size", 0,
+                       G_MAXINT, 0, flags));
+  g_object_class_install_property(
+      object_class, PROP_TARGET_HEIGHT,
+      g_param_spec_int("target-height", "Target height",
+                       "Smallest output height wanted, 0 for full size", 0,
+                       G_MAXINT, 0, flags));
+
+  gst_element_class_add_static_pad_template(element_class, &sink_template);
+  gst_element_class_add_static_pad_template(element_class, &src_template);
+  gst_element_class_set_static_metadata(
+      element_class, "Scaled JPEG decoder", "Codec/Decoder/Image",
+      "Decodes JPEG at 1/8, 1/4, 1/2 or full size with libjpeg's scaled IDCT",
+      "fl_texture_repro");
+}
+
+static void jpeg_scaled_decoder_init(JpegScaledDecoder* self) {
+  self->sinkpad = gst_pad_new_from_static_template(&sink_template, "sink");
+  gst_pad_set_chain_function(self->sinkpad, jpeg_scaled_decoder_chain);
+  gst_pad_set_event_function(self->sinkpad, jpeg_scaled_decoder_sink_event);
+  gst_pad_set_query_function(self->sinkpad, jpeg_scaled_decoder_query);
+  gst_element_add_pad(GST_ELEMENT(self), self->sinkpad);
+
+  self->srcpad = gst_pad_new_from_static_template(&src_template, "src");
+  gst_pad_set_query_function(self->srcpad, jpeg_scaled_decoder_query);
+  gst_element_add_pad(GST_ELEMENT(self), self->srcpad);
+
+  self->target_width = 0;
+  self->target_height = 0;
+  self->cinfo.err = jpeg_std_error(&self->error.mgr);
+  self->error.mgr.error_exit = jpeg_scaled_decoder_error_exit;
+  self->error.mgr.output_message = jpeg_scaled_decoder_output_message;
+  jpeg_create_decompress(&self->cinfo);
+  self->output = nullptr;
+  self->frame_mapped = FALSE;
+  for (int c = 0; c < 3; c++) {
+    self->scratch[c] = nullptr;
+    self->scratch_size[c] = 0;
+  }
+  gst_video_info_init(&self->info);
+  self->caps_sent = FALSE;
+  self->fps_n = 0;
+  self->fps_d = 1;
+  self->pending_segment = nullptr;
+}
+
+gboolean jpeg_scaled_decoder_register() {
+  static gsize registered = 0;
+  if (g_once_init_enter(&registered)) {
+    gboolean ok = gst_element_register(nullptr, "fltexturejpegscaledec",
+                                       GST_RANK_NONE,
+                                       jpeg_scaled_decoder_get_type());
+    g_once_init_leave(&registered, ok ? 2 : 1);
+  }
+  return registered == 2;
+}
@@ -0,0 +1,40 @@
+#ifndef FL_TEXTURE_REPRO_JPEG_SCALED_DECODER_H_
+#define FL_TEXTURE_REPRO_JPEG_SCALED_DECODER_H_
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+// "fltexturejpegscaledec": a JPEG decoder that lets libjpeg-turbo's scaled
+// IDCT do most of the downscaling. Each frame is decoded at 1/8, 1/4, 1/2
+// or full size, whichever is the smallest still covering the target size,
+// so a 1920x1080 frame for a 640x480 preview is decoded at 960x540 and
+// videoscale only has the rest to do. The target can change while playing;
+// the output caps follow with the next frame.
+//
+// Output is the JPEG's own planar YUV (I420, Y42B or Y444, full range) or
+// GRAY8, like jpegdec; other layouts are decoded to RGBx.
+//
+// Properties:
+//   target-width   smallest output width wanted, 0 for full size
+//   target-height  smallest output height wanted, 0 for full size
+G_DECLARE_FINAL_TYPE(JpegScaledDecoder,
+                     jpeg_scaled_decoder,
+                     JPEG,
+                     SCALED_DECODER,
+                     GstElement)
+
+// Makes "fltexturejpegscaledec" available to gst_parse_launch(). Safe to
+// call more than once.
+gboolean jpeg_scaled_decoder_register();
+
+// The numerator over 8 jpeg_scaled_decoder uses for an image of |width| x
+// |height| and the given target: 1, 2, 4 or 8.
+guint jpeg_scaled_decoder_scale(guint width,
+                                guint height,
+                                guint target_width,
+                                guint target_height);
+
+G_END_DECLS
+
+#endif  // FL_TEXTURE_REPRO_JPEG_SCALED_DECODER_H_
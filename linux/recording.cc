@@ -0,0 +1,339 @@
+#include "recording.h"
+
+// Buffers the branch queue holds before dropping the oldest: about a
+// quarter of a second of decoded 1080p, a second of JPEG.
+#define RECORDING_RAW_QUEUE_BUFFERS 8
+#define RECORDING_JPEG_QUEUE_BUFFERS 30
+
+// Shared between the main thread, the streaming thread feeding the tee and
+// the branch's own queue thread, so it is reference counted
+// (g_atomic_rc_box). Probes on the branch's own pads hold no reference: they
+// cannot fire once recording_finish() has shut the branch down. Fields
+// without a note are set on start and only read afterwards.
+struct _Recording {
+  GstElement* pipeline;
+  GstElement* tee;
+  GstPad* tee_pad;  // Request pad feeding the branch
+  GstElement* bin;
+  gboolean passthrough;
+  gchar* path;
+
+  gint failed;    // Atomic
+  gint stopping;  // Atomic
+  gint unlinked;  // Atomic
+  gulong idle_probe_id;
+
+  GMutex mutex;  // Guards error_message and eos
+  GCond cond;
+  gchar* error_message;
+  gboolean eos;
+
+  // Context of the thread that started the recording. recording_finish()
+  // is always dispatched there, never run inline on a streaming thread.
+  GMainContext* context;
+  gint finished;  // Atomic, set by the one recording_finish() that runs
+
+  // Main thread only
+  GSource* timeout_source;
+  RecordingDoneCallback callback;
+  gpointer callback_data;
+};
+
+static void recording_clear(gpointer data) {
+  Recording* self = static_cast<Recording*>(data);
+  gst_object_unref(self->bin);
+  gst_object_unref(self->tee_pad);
+  gst_object_unref(self->tee);
+  gst_object_unref(self->pipeline);
+  g_free(self->path);
+  g_free(self->error_message);
+  g_main_context_unref(self->context);
+  g_mutex_clear(&self->mutex);
+  g_cond_clear(&self->cond);
+}
+
+static Recording* recording_ref(Recording* self) {
+  return static_cast<Recording*>(g_atomic_rc_box_acquire(self));
+}
+
+static void recording_unref(gpointer data) {
+  g_atomic_rc_box_release_full(data, recording_clear);
+}
+
+// Elements between the queue and the filesink for |codec|, or nullptr.
+static const gchar* encoder_description(const gchar* codec,
+                                        gboolean passthrough) {
+  if (g_strcmp0(codec, "h264") == 0) {
+    return "videoconvert ! "
+           "x264enc tune=zerolatency speed-preset=ultrafast ! "
+           "h264parse ! mp4mux";
+  } else if (g_strcmp0(codec, "vp8") == 0) {
+    return "videoconvert ! vp8enc deadline=1 cpu-used=8 ! webmmux";
+  } else if (g_strcmp0(codec, "mjpeg") == 0) {
+    return passthrough ? "jpegparse ! avimux"
+                       : "videoconvert ! jpegenc ! avimux";
+  }
+  return nullptr;
+}
+
+// Runs on the thread pushing into the branch. Buffers are dropped once the
+// branch has failed, so the tee sees GST_FLOW_OK rather than the error.
+// JPEG buffers come straight from the camera's small buffer pool and are
+// copied so frames waiting in the queue cannot starve it.
+static GstPadProbeReturn branch_buffer_probe(GstPad* pad,
+                                             GstPadProbeInfo* info,
+                                             gpointer user_data) {
+  Recording* self = static_cast<Recording*>(user_data);
+  if (g_atomic_int_get(&self->failed)) {
+    return GST_PAD_PROBE_DROP;
+  }
+  if (self->passthrough) {
+    GstBuffer* buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    GST_PAD_PROBE_INFO_DATA(info) = gst_buffer_copy_deep(buffer);
+    gst_buffer_unref(buffer);
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+static void recording_finish(Recording* self);
+
+static gboolean recording_finish_cb(gpointer user_data) {
+  recording_finish(static_cast<Recording*>(user_data));
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean recording_timeout_cb(gpointer user_data) {
+  Recording* self = static_cast<Recording*>(user_data);
+  g_clear_pointer(&self->timeout_source, g_source_unref);
+  g_warning("Recording to %s did not drain in time", self->path);
+  recording_finish(self);
+  return G_SOURCE_REMOVE;
+}
+
+// Schedules recording_finish() on the starting thread's context from any
+// thread. Unlike g_main_context_invoke() this never runs it right away,
+// which would happen on a streaming thread whenever nothing is iterating
+// the context, and have the branch shut itself down from its own thread.
+static void recording_queue_finish(Recording* self) {
+  GSource* source = g_idle_source_new();
+  g_source_set_priority(source, G_PRIORITY_DEFAULT);
+  g_source_set_callback(source, recording_finish_cb, recording_ref(self),
+                        recording_unref);
+  g_source_attach(source, self->context);
+  g_source_unref(source);
+}
+
+// Runs on the branch's queue thread when EOS reaches the filesink, after the
+// muxer has written everything out.
+static GstPadProbeReturn filesink_eos_probe(GstPad* pad,
+                                           GstPadProbeInfo* info,
+                                           gpointer user_data) {
+  Recording* self = static_cast<Recording*>(user_data);
+  if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) == GST_EVENT_EOS) {
+    g_mutex_lock(&self->mutex);
+    self->eos = TRUE;
+    g_cond_signal(&self->cond);
+    g_mutex_unlock(&self->mutex);
+    recording_queue_finish(self);
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+// Runs once no buffer is passing the tee pad, on whichever thread that is.
+static GstPadProbeReturn tee_pad_idle_probe(GstPad* pad,
+                                            GstPadProbeInfo* info,
+                                            gpointer user_data) {
+  Recording* self = static_cast<Recording*>(user_data);
+  if (!g_atomic_int_compare_and_exchange(&self->unlinked, 0, 1)) {
+    return GST_PAD_PROBE_REMOVE;
+  }
+
+  g_autoptr(GstPad) sink_pad = gst_element_get_static_pad(self->bin, "sink");
+  gst_pad_unlink(pad, sink_pad);
+  if (g_atomic_int_get(&self->failed)) {
+    recording_queue_finish(self);
+  } else {
+    gst_pad_send_event(sink_pad, gst_event_new_eos());
+  }
+  return GST_PAD_PROBE_REMOVE;
+}
+
+Recording* recording_start(GstElement* pipeline,
+                           GstElement* raw_tee,
+                           GstElement* jpeg_tee,
+                           const gchar* path,
+                           const gchar* codec,
+                           GError** error) {
+  gboolean passthrough =
+      g_strcmp0(codec, "mjpeg") == 0 && jpeg_tee != nullptr;
+  const gchar* encoder = encoder_description(codec, passthrough);
+  if (encoder == nullptr) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                "Unknown codec \"%s\"", codec);
+    return nullptr;
+  }
+
+  g_autofree gchar* description = g_strdup_printf(
+      "queue leaky=downstream max-size-buffers=%d max-size-bytes=0 "
+      "max-size-time=0 ! %s ! filesink name=filesink async=false",
+      passthrough ? RECORDING_JPEG_QUEUE_BUFFERS : RECORDING_RAW_QUEUE_BUFFERS,
+      encoder);
+  GstElement* bin = gst_parse_bin_from_description(description, TRUE, error);
+  if (bin == nullptr) {
+    return nullptr;
+  }
+
+  Recording* self = g_atomic_rc_box_new0(Recording);
+  self->pipeline = GST_ELEMENT(gst_object_ref(pipeline));
+  self->tee = GST_ELEMENT(gst_object_ref(passthrough ? jpeg_tee : raw_tee));
+  self->bin = GST_ELEMENT(gst_object_ref_sink(bin));
+  self->passthrough = passthrough;
+  self->path = g_strdup(path);
+  self->context = g_main_context_ref_thread_default();
+  g_mutex_init(&self->mutex);
+  g_cond_init(&self->cond);
+
+  g_autoptr(GstElement) filesink =
+      gst_bin_get_by_name(GST_BIN(self->bin), "filesink");
+  g_object_set(filesink, "location", path, nullptr);
+  g_autoptr(GstPad) filesink_pad =
+      gst_element_get_static_pad(filesink, "sink");
+  gst_pad_add_probe(filesink_pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+                    filesink_eos_probe, self, nullptr);
+
+  g_autoptr(GstPad) sink_pad = gst_element_get_static_pad(self->bin, "sink");
+  gst_pad_add_probe(sink_pad, GST_PAD_PROBE_TYPE_BUFFER, branch_buffer_probe,
+                    self, nullptr);
+
+  // Bring the branch up before linking so the file is open and every
+  // element is ready by the time the first buffer arrives.
+  gst_bin_add(GST_BIN(self->pipeline), self->bin);
+  self->tee_pad = gst_element_request_pad_simple(self->tee, "src_%u");
+  if (!gst_element_sync_state_with_parent(self->bin) ||
+      gst_pad_link(self->tee_pad, sink_pad) != GST_PAD_LINK_OK) {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                "Failed to start recording to %s", path);
+    gst_element_set_state(self->bin, GST_STATE_NULL);
+    gst_bin_remove(GST_BIN(self->pipeline), self->bin);
+    gst_element_release_request_pad(self->tee, self->tee_pad);
+    g_atomic_int_set(&self->finished, 1);
+    recording_unref(self);
+    return nullptr;
+  }
+
+  // Keep the branch PLAYING while the preview is paused, so a recording
+  // stopped meanwhile can still drain: the sink would otherwise wait for
+  // PLAYING before handling EOS.
+  gst_element_set_locked_state(self->bin, TRUE);
+
+  g_print("Recording %s to %s%s\n", codec, path,
+          passthrough ? " (JPEG passthrough)" : "");
+  return self;
+}
+
+gboolean recording_handle_message(Recording* self, GstMessage* message) {
+  if (!gst_object_has_as_ancestor(GST_MESSAGE_SRC(message),
+                                  GST_OBJECT(self->bin))) {
+    return FALSE;
+  }
+
+  if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_ERROR) {
+    g_autoptr(GError) error = nullptr;
+    gst_message_parse_error(message, &error, nullptr);
+    g_warning("Recording to %s failed: %s", self->path, error->message);
+
+    g_mutex_lock(&self->mutex);
+    if (self->error_message == nullptr) {
+      self->error_message = g_strdup(error->message);
+    }
+    g_atomic_int_set(&self->failed, 1);
+    g_cond_signal(&self->cond);
+    g_mutex_unlock(&self->mutex);
+
+    // No EOS is coming any more.
+    if (g_atomic_int_get(&self->stopping)) {
+      recording_queue_finish(self);
+    }
+  }
+  return TRUE;
+}
+
+// Removes the branch and reports the result. Only the first call does
+// anything; later ones come from the EOS probe or timeout racing it.
+static void recording_finish(Recording* self) {
+  if (!g_atomic_int_compare_and_exchange(&self->finished, 0, 1)) {
+    return;
+  }
+  if (self->timeout_source != nullptr) {
+    g_source_destroy(self->timeout_source);
+    g_clear_pointer(&self->timeout_source, g_source_unref);
+  }
+
+  // Never went idle, e.g. because the streaming thread is stuck.
+  if (self->idle_probe_id != 0 && !g_atomic_int_get(&self->unlinked)) {
+    gst_pad_remove_probe(self->tee_pad, self->idle_probe_id);
+  }
+
+  // Closing the filesink flushes the file.
+  gst_element_set_state(self->bin, GST_STATE_NULL);
+  gst_bin_remove(GST_BIN(self->pipeline), self->bin);
+  gst_element_release_request_pad(self->tee, self->tee_pad);
+
+  g_mutex_lock(&self->mutex);
+  g_autoptr(GError) error = nullptr;
+  if (self->error_message != nullptr) {
+    error = g_error_new(G_IO_ERROR, G_IO_ERROR_FAILED, "%s",
+                        self->error_message);
+  } else if (!self->eos) {
+    error = g_error_new(G_IO_ERROR, G_IO_ERROR_TIMED_OUT,
+                        "Recording was not finalized, %s may be truncated",
+                        self->path);
+  }
+  g_mutex_unlock(&self->mutex);
+
+  g_print("Recording to %s stopped\n", self->path);
+  if (self->callback != nullptr) {
+    self->callback(self->path, error, self->callback_data);
+  }
+
+  // The reference handed to recording_stop()
+  recording_unref(self);
+}
+
+// Blocks the tee pad so the branch can be unlinked between buffers; the
+// probe then sends EOS. Returns immediately if the pad is idle already.
+static void recording_detach(Recording* self) {
+  g_atomic_int_set(&self->stopping, 1);
+  self->idle_probe_id =
+      gst_pad_add_probe(self->tee_pad, GST_PAD_PROBE_TYPE_IDLE,
+                        tee_pad_idle_probe, recording_ref(self),
+                        recording_unref);
+}
+
+void recording_stop(Recording* self,
+                    RecordingDoneCallback callback,
+                    gpointer user_data) {
+  self->callback = callback;
+  self->callback_data = user_data;
+  self->timeout_source = g_timeout_source_new(RECORDING_STOP_TIMEOUT_MS);
+  g_source_set_callback(self->timeout_source, recording_timeout_cb, self,
+                        nullptr);
+  g_source_attach(self->timeout_source, self->context);
+  recording_detach(self);
+}
+
+void recording_stop_sync(Recording* self) {
+  recording_detach(self);
+
+  gint64 end_time =
+      g_get_monotonic_time() + RECORDING_STOP_TIMEOUT_MS * G_TIME_SPAN_MILLISECOND;
+  g_mutex_lock(&self->mutex);
+  while (!self->eos && !g_atomic_int_get(&self->failed)) {
+    if (!g_cond_wait_until(&self->cond, &self->mutex, end_time)) {
+      break;
+    }
+  }
+  g_mutex_unlock(&self->mutex);
+
+  recording_finish(self);
+}
@@ -0,0 +1,61 @@
+#ifndef FL_TEXTURE_REPRO_RECORDING_H_
+#define FL_TEXTURE_REPRO_RECORDING_H_
+
+#include <gio/gio.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+// A branch hanging off a tee in a running pipeline that encodes and muxes
+// into a file. The branch starts with a leaky queue, so the tee never waits
+// for the encoder or the disk, and a failing branch drops its buffers
+// instead of returning an error into the preview.
+//
+// Codecs:
+//   "h264"  x264 in MP4
+//   "vp8"   VP8 in WebM
+//   "mjpeg" JPEG in AVI; the camera's JPEG frames are muxed as they are
+//           when a compressed tee is available, otherwise frames are
+//           re-encoded with jpegenc
+typedef struct _Recording Recording;
+
+// Called once the file is finalized, from the thread-default main context
+// of the thread that called recording_start(); that context must be
+// iterated for the callback to run. |error| is nullptr on success.
+typedef void (*RecordingDoneCallback)(const gchar* path,
+                                      const GError* error,
+                                      gpointer user_data);
+
+// Adds a branch writing |codec| to |path| to |pipeline|, fed from
+// |raw_tee| (decoded frames) or, for "mjpeg" passthrough, |jpeg_tee|
+// (nullptr if the source is not MJPEG). Main thread only. Returns nullptr
+// and sets |error| if the branch cannot be built or the file not opened.
+Recording* recording_start(GstElement* pipeline,
+                           GstElement* raw_tee,
+                           GstElement* jpeg_tee,
+                           const gchar* path,
+                           const gchar* codec,
+                           GError** error);
+
+// Checks whether |message| came from the branch. Errors mark the recording
+// as failed so it stops taking buffers. Call from the bus sync handler;
+// returns TRUE if the message belongs to the branch.
+gboolean recording_handle_message(Recording* recording, GstMessage* message);
+
+// Detaches the branch and sends it EOS so the muxer can write its index,
+// then removes it and calls |callback|. Takes ownership of |recording|.
+// Main thread only.
+void recording_stop(Recording* recording,
+                    RecordingDoneCallback callback,
+                    gpointer user_data);
+
+// Like recording_stop(), but waits up to RECORDING_STOP_TIMEOUT_MS for the
+// file to be finalized before returning. For tearing the pipeline down.
+void recording_stop_sync(Recording* recording);
+
+// Longest wait for the branch to drain after EOS
+#define RECORDING_STOP_TIMEOUT_MS 3000
+
+G_END_DECLS
+
+#endif  // FL_TEXTURE_REPRO_RECORDING_H_
@@ -0,0 +1,137 @@
+#include "still_capture.h"
+
+#include <gst/video/video.h>
+
+// Longest gst_video_convert_sample() may take to encode a raw frame
+#define STILL_CAPTURE_ENCODE_TIMEOUT (5 * GST_SECOND)
+
+// Task data; the GTask completes on the main thread.
+typedef struct {
+  StillCaptureCallback callback;
+  gpointer user_data;
+  gchar* path;
+  GstSample* sample;  // Set by the probe
+  gint fired;         // Atomic: the probe took a buffer
+} StillCaptureRequest;
+
+static void still_capture_request_free(gpointer data) {
+  StillCaptureRequest* request = static_cast<StillCaptureRequest*>(data);
+  g_free(request->path);
+  if (request->sample != nullptr) {
+    gst_sample_unref(request->sample);
+  }
+  g_free(request);
+}
+
+// Destroy notify of the probe, which owns a task reference.
+static void still_capture_probe_done(gpointer data) {
+  GTask* task = G_TASK(data);
+  StillCaptureRequest* request =
+      static_cast<StillCaptureRequest*>(g_task_get_task_data(task));
+  // The pad went away before a buffer arrived.
+  if (!g_atomic_int_get(&request->fired)) {
+    g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_CLOSED,
+                            "Pipeline stopped before a frame arrived");
+  }
+  g_object_unref(task);
+}
+
+// Encodes the captured sample if needed and writes the file. Runs on a
+// worker thread.
+static void still_capture_thread(GTask* task,
+                                 gpointer source_object,
+                                 gpointer task_data,
+                                 GCancellable* cancellable) {
+  StillCaptureRequest* request = static_cast<StillCaptureRequest*>(task_data);
+  GstSample* sample = request->sample;
+
+  g_autoptr(GstSample) jpeg_sample = nullptr;
+  GstStructure* structure =
+      gst_caps_get_structure(gst_sample_get_caps(sample), 0);
+  if (gst_structure_has_name(structure, "image/jpeg")) {
+    jpeg_sample = gst_sample_ref(sample);
+  } else {
+    g_autoptr(GstCaps) caps = gst_caps_new_empty_simple("image/jpeg");
+    GError* error = nullptr;
+    jpeg_sample = gst_video_convert_sample(sample, caps,
+                                           STILL_CAPTURE_ENCODE_TIMEOUT,
+                                           &error);
+    if (jpeg_sample == nullptr) {
+      g_task_return_error(task, error);
+      return;
+    }
+  }
+
+  GstBuffer* buffer = gst_sample_get_buffer(jpeg_sample);
+  GstMapInfo map;
+  if (!gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+    g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                            "Failed to map the captured frame");
+    return;
+  }
+  GBytes* jpeg = g_bytes_new(map.data, map.size);
+  gst_buffer_unmap(buffer, &map);
+
+  GError* error = nullptr;
+  if (request->path != nullptr &&
+      !g_file_set_contents(
+          request->path,
+          static_cast<const gchar*>(g_bytes_get_data(jpeg, nullptr)),
+          g_bytes_get_size(jpeg), &error)) {
+    g_bytes_unref(jpeg);
+    g_task_return_error(task, error);
+    return;
+  }
+
+  g_task_return_pointer(task, jpeg,
+                        reinterpret_cast<GDestroyNotify>(g_bytes_unref));
+}
+
+// Runs on the streaming thread for the first buffer entering the tee. Only
+// takes a reference; the work happens on a worker.
+static GstPadProbeReturn still_capture_probe(GstPad* pad,
+                                             GstPadProbeInfo* info,
+                                             gpointer user_data) {
+  GTask* task = G_TASK(user_data);
+  StillCaptureRequest* request =
+      static_cast<StillCaptureRequest*>(g_task_get_task_data(task));
+  if (!g_atomic_int_compare_and_exchange(&request->fired, 0, 1)) {
+    return GST_PAD_PROBE_REMOVE;
+  }
+
+  g_autoptr(GstCaps) caps = gst_pad_get_current_caps(pad);
+  request->sample = gst_sample_new(GST_PAD_PROBE_INFO_BUFFER(info), caps,
+                                   nullptr, nullptr);
+  g_task_run_in_thread(task, still_capture_thread);
+  return GST_PAD_PROBE_REMOVE;
+}
+
+static void still_capture_ready(GObject* object,
+                                GAsyncResult* result,
+                                gpointer user_data) {
+  GTask* task = G_TASK(result);
+  StillCaptureRequest* request =
+      static_cast<StillCaptureRequest*>(g_task_get_task_data(task));
+
+  g_autoptr(GError) error = nullptr;
+  g_autoptr(GBytes) jpeg =
+      static_cast<GBytes*>(g_task_propagate_pointer(task, &error));
+  request->callback(jpeg, error, request->user_data);
+}
+
+void still_capture_next(GstElement* tee,
+                        const gchar* path,
+                        StillCaptureCallback callback,
+                        gpointer user_data) {
+  StillCaptureRequest* request = g_new0(StillCaptureRequest, 1);
+  request->callback = callback;
+  request->user_data = user_data;
+  request->path = g_strdup(path);
+
+  GTask* task = g_task_new(nullptr, nullptr, still_capture_ready, nullptr);
+  g_task_set_task_data(task, request, still_capture_request_free);
+
+  g_autoptr(GstPad) pad = gst_element_get_static_pad(tee, "sink");
+  gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, still_capture_probe, task,
+                    still_capture_probe_done);
+}
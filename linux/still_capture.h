@@ -0,0 +1,27 @@
+#ifndef FL_TEXTURE_REPRO_STILL_CAPTURE_H_
+#define FL_TEXTURE_REPRO_STILL_CAPTURE_H_
+
+#include <gio/gio.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+// Called on the main thread with the captured frame as JPEG, or with
+// |error| set and |jpeg| nullptr.
+typedef void (*StillCaptureCallback)(GBytes* jpeg,
+                                     const GError* error,
+                                     gpointer user_data);
+
+// Grabs the next buffer entering |tee|, which must carry image/jpeg or raw
+// video, without holding up the streaming thread: JPEG is copied as it is,
+// raw frames are encoded on a worker. If |path| is not nullptr the JPEG is
+// also written there before |callback| runs. Fails with G_IO_ERROR_CLOSED
+// if the pipeline is torn down first. Main thread only.
+void still_capture_next(GstElement* tee,
+                        const gchar* path,
+                        StillCaptureCallback callback,
+                        gpointer user_data);
+
+G_END_DECLS
+
+#endif  // FL_TEXTURE_REPRO_STILL_CAPTURE_H_
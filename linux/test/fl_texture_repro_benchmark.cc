@@ -0,0 +1,307 @@
+// Headless benchmark for the capture -> upload path.
+//
+// Drives the real on_new_sample / populate code with videotestsrc on a
+// surfaceless EGL context, so it runs without a camera, a display or a GPU:
+//
+//   LIBGL_ALWAYS_SOFTWARE=1 ./fl_texture_repro_benchmark --duration=3
+//
+// Sources are paced at 30 fps like the camera, so fps below 30 means the path
+// cannot keep up; CPU time per frame and the latency percentiles are the
+// numbers to compare between runs. Each configuration prints one JSON object
+// per line on stdout; progress and warnings go to stderr.
+
+// epoxy must come before anything that may pull in the system GL headers.
+#include <epoxy/egl.h>
+#include <epoxy/gl.h>
+
+#include <gst/gst.h>
+#include <sys/resource.h>
+
+#include <cstring>
+
+#include "gst_gl_texture.h"
+
+typedef struct {
+  const gchar* name;
+  GstGLTextureUploadMode upload_mode;
+  GstGLTexturePixelFormat pixel_format;
+  guint pbo_ring_depth;
+  guint texture_ring_depth;
+  gboolean fused_convert;
+  gboolean partial_updates;
+} BenchmarkMode;
+
+static const BenchmarkMode kModes[] = {
+    {"copy/rgba", GST_GL_TEXTURE_UPLOAD_COPY, GST_GL_TEXTURE_FORMAT_RGBA, 0, 0,
+     FALSE, FALSE},
+    {"copy/rgba/fused", GST_GL_TEXTURE_UPLOAD_COPY, GST_GL_TEXTURE_FORMAT_RGBA,
+     0, 0, TRUE, FALSE},
+    // The ball pattern is a mostly static background, like a fixed camera.
+    {"copy/rgba/partial", GST_GL_TEXTURE_UPLOAD_COPY,
+     GST_GL_TEXTURE_FORMAT_RGBA, 0, 0, FALSE, TRUE},
+    {"zero-copy/rgba", GST_GL_TEXTURE_UPLOAD_ZERO_COPY,
+     GST_GL_TEXTURE_FORMAT_RGBA, 0, 0, FALSE, FALSE},
+    {"zero-copy/rgba/pbo2", GST_GL_TEXTURE_UPLOAD_ZERO_COPY,
+     GST_GL_TEXTURE_FORMAT_RGBA, 2, 0, FALSE, FALSE},
+    {"zero-copy/rgba/ring3", GST_GL_TEXTURE_UPLOAD_ZERO_COPY,
+     GST_GL_TEXTURE_FORMAT_RGBA, 0, 3, FALSE, FALSE},
+    {"zero-copy/nv12", GST_GL_TEXTURE_UPLOAD_ZERO_COPY,
+     GST_GL_TEXTURE_FORMAT_NV12, 0, 0, FALSE, FALSE},
+    {"zero-copy/i420", GST_GL_TEXTURE_UPLOAD_ZERO_COPY,
+     GST_GL_TEXTURE_FORMAT_I420, 0, 0, FALSE, FALSE},
+};
+
+// Source resolutions; YUY2 is what USB cameras deliver uncompressed.
+static const struct {
+  gint width;
+  gint height;
+} kResolutions[] = {{640, 480}, {1280, 720}, {1920, 1080}};
+
+static gint duration_s = 3;
+static gchar* filter = nullptr;
+
+static GOptionEntry entries[] = {
+    {"duration", 'd', 0, G_OPTION_ARG_INT, &duration_s,
+     "Seconds to run each configuration (default 3)", "SECONDS"},
+    {"filter", 'f', 0, G_OPTION_ARG_STRING, &filter,
+     "Only run configurations whose name contains this", "TEXT"},
+    {nullptr}};
+
+// Frame hand-off from the streaming thread, standing in for the plugin's
+// main-loop dispatch.
+typedef struct {
+  GMutex mutex;
+  GCond cond;
+  gboolean frame_ready;
+} FrameSignal;
+
+static void frame_available_cb(GstGLTexture* texture, gpointer user_data) {
+  FrameSignal* signal = static_cast<FrameSignal*>(user_data);
+  g_mutex_lock(&signal->mutex);
+  signal->frame_ready = TRUE;
+  g_cond_signal(&signal->cond);
+  g_mutex_unlock(&signal->mutex);
+}
+
+// Creates a GL context with no window system. Prefers Mesa's surfaceless
+// platform, then the default display with a small pbuffer.
+static gboolean make_headless_context(EGLDisplay* out_display,
+                                      EGLContext* out_context) {
+  EGLDisplay display = EGL_NO_DISPLAY;
+  if (epoxy_has_egl_extension(EGL_NO_DISPLAY, "EGL_MESA_platform_surfaceless")) {
+    display = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA,
+                                       EGL_DEFAULT_DISPLAY, nullptr);
+  }
+  if (display == EGL_NO_DISPLAY) {
+    display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  }
+  if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+    g_printerr("No EGL display available\n");
+    return FALSE;
+  }
+
+  if (!eglBindAPI(EGL_OPENGL_API)) {
+    g_printerr("EGL has no desktop GL support\n");
+    return FALSE;
+  }
+
+  const EGLint config_attribs[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                                   EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                                   EGL_NONE};
+  EGLConfig config = nullptr;
+  EGLint num_configs = 0;
+  if (!eglChooseConfig(display, config_attribs, &config, 1, &num_configs) ||
+      num_configs == 0) {
+    g_printerr("No suitable EGL config\n");
+    return FALSE;
+  }
+
+  EGLContext context =
+      eglCreateContext(display, config, EGL_NO_CONTEXT, nullptr);
+  if (context == EGL_NO_CONTEXT) {
+    g_printerr("Failed to create EGL context\n");
+    return FALSE;
+  }
+
+  EGLSurface surface = EGL_NO_SURFACE;
+  if (!epoxy_has_egl_extension(display, "EGL_KHR_surfaceless_context")) {
+    const EGLint pbuffer_attribs[] = {EGL_WIDTH, 16, EGL_HEIGHT, 16, EGL_NONE};
+    surface = eglCreatePbufferSurface(display, config, pbuffer_attribs);
+  }
+  if (!eglMakeCurrent(display, surface, surface, context)) {
+    g_printerr("Failed to make EGL context current\n");
+    return FALSE;
+  }
+
+  g_printerr("GL: %s, %s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+  *out_display = display;
+  *out_context = context;
+  return TRUE;
+}
+
+static gint64 cpu_time_us() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * G_USEC_PER_SEC +
+         usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+static int64_t stat_int(FlValue* stats, const gchar* key) {
+  FlValue* value = fl_value_lookup_string(stats, key);
+  return value != nullptr ? fl_value_get_int(value) : 0;
+}
+
+static void append_histogram(GString* out,
+                             FlValue* stats,
+                             const gchar* key,
+                             const gchar* json_key) {
+  FlValue* histogram = fl_value_lookup_string(stats, key);
+  g_string_append_printf(out, ",\"%s\":{", json_key);
+  const gchar* fields[] = {"mean", "p50", "p90", "p99", "max"};
+  for (guint i = 0; i < G_N_ELEMENTS(fields); i++) {
+    FlValue* value = histogram != nullptr
+                         ? fl_value_lookup_string(histogram, fields[i])
+                         : nullptr;
+    g_string_append_printf(out, "%s\"%s\":%.1f", i > 0 ? "," : "", fields[i],
+                           value != nullptr ? fl_value_get_float(value) : 0.0);
+  }
+  g_string_append_c(out, '}');
+}
+
+static gboolean run_configuration(gint width,
+                                  gint height,
+                                  const BenchmarkMode* mode) {
+  g_autofree gchar* name =
+      g_strdup_printf("%dx%d/%s", width, height, mode->name);
+  if (filter != nullptr && strstr(name, filter) == nullptr) {
+    return TRUE;
+  }
+
+  g_autofree gchar* source = g_strdup_printf(
+      "videotestsrc pattern=ball ! "
+      "video/x-raw,format=YUY2,width=%d,height=%d,framerate=30/1",
+      width, height);
+
+  GstGLTextureOptions options;
+  gst_gl_texture_options_init(&options);
+  options.source = source;
+  options.upload_mode = mode->upload_mode;
+  options.pixel_format = mode->pixel_format;
+  options.pbo_ring_depth = mode->pbo_ring_depth;
+  options.texture_ring_depth = mode->texture_ring_depth;
+  options.fused_convert = mode->fused_convert;
+  options.partial_updates = mode->partial_updates;
+
+  FrameSignal signal;
+  g_mutex_init(&signal.mutex);
+  g_cond_init(&signal.cond);
+  signal.frame_ready = FALSE;
+
+  g_autoptr(GstGLTexture) texture = gst_gl_texture_new(&options);
+  gst_gl_texture_set_frame_callback(texture, frame_available_cb, &signal);
+  if (!gst_gl_texture_start_pipeline(texture)) {
+    g_printerr("%s: failed to start pipeline\n", name);
+    g_mutex_clear(&signal.mutex);
+    g_cond_clear(&signal.cond);
+    return FALSE;
+  }
+
+  FlTextureGLClass* texture_class = FL_TEXTURE_GL_GET_CLASS(texture);
+  gint64 start = g_get_monotonic_time();
+  gint64 end = start + duration_s * G_USEC_PER_SEC;
+  gint64 cpu_start = cpu_time_us();
+  gint64 frames = 0;
+  gboolean ok = TRUE;
+
+  while (g_get_monotonic_time() < end) {
+    g_mutex_lock(&signal.mutex);
+    while (!signal.frame_ready) {
+      if (!g_cond_wait_until(&signal.cond, &signal.mutex, end)) {
+        break;
+      }
+    }
+    gboolean frame_ready = signal.frame_ready;
+    signal.frame_ready = FALSE;
+    g_mutex_unlock(&signal.mutex);
+
+    if (!frame_ready || !gst_gl_texture_take_frame_pending(texture)) {
+      continue;
+    }
+
+    uint32_t target = 0, texture_name = 0, texture_width = 0,
+             texture_height = 0;
+    g_autoptr(GError) error = nullptr;
+    if (!texture_class->populate(FL_TEXTURE_GL(texture), &target,
+                                 &texture_name, &texture_width,
+                                 &texture_height, &error)) {
+      g_printerr("%s: populate failed%s%s\n", name, error != nullptr ? ": " : "",
+                 error != nullptr ? error->message : "");
+      ok = FALSE;
+      break;
+    }
+    // Wait for the upload the way Flutter's compositor eventually would.
+    glFinish();
+    frames++;
+  }
+
+  gint64 elapsed = g_get_monotonic_time() - start;
+  gint64 cpu = cpu_time_us() - cpu_start;
+  gst_gl_texture_stop_pipeline(texture);
+  gst_gl_texture_set_frame_callback(texture, nullptr, nullptr);
+
+  g_autoptr(FlValue) stats = gst_gl_texture_get_stats(texture);
+  gint64 bytes_copied = stat_int(stats, "bytesCopied");
+
+  g_autoptr(GString) out = g_string_new(nullptr);
+  g_string_append_printf(
+      out,
+      "{\"name\":\"%s\",\"ok\":%s,\"frames\":%" G_GINT64_FORMAT
+      ",\"fps\":%.2f,\"cpu_us_per_frame\":%.1f"
+      ",\"bytes_copied_per_frame\":%.0f,\"frames_received\":%" G_GINT64_FORMAT
+      ",\"frames_dropped\":%" G_GINT64_FORMAT,
+      name, ok ? "true" : "false", frames,
+      elapsed > 0 ? frames * 1e6 / elapsed : 0.0,
+      frames > 0 ? static_cast<double>(cpu) / frames : 0.0,
+      frames > 0 ? static_cast<double>(bytes_copied) / frames : 0.0,
+      stat_int(stats, "framesReceived"), stat_int(stats, "framesDropped"));
+  append_histogram(out, stats, "uploadTimeUs", "upload_us");
+  append_histogram(out, stats, "captureLatencyUs", "capture_latency_us");
+  g_string_append_c(out, '}');
+  g_print("%s\n", out->str);
+
+  g_mutex_clear(&signal.mutex);
+  g_cond_clear(&signal.cond);
+  return ok && frames > 0;
+}
+
+int main(int argc, char** argv) {
+  g_autoptr(GError) error = nullptr;
+  g_autoptr(GOptionContext) option_context =
+      g_option_context_new("- benchmark the capture -> upload path");
+  g_option_context_add_main_entries(option_context, entries, nullptr);
+  g_option_context_add_group(option_context, gst_init_get_option_group());
+  if (!g_option_context_parse(option_context, &argc, &argv, &error)) {
+    g_printerr("%s\n", error->message);
+    return 2;
+  }
+
+  EGLDisplay display = EGL_NO_DISPLAY;
+  EGLContext context = EGL_NO_CONTEXT;
+  if (!make_headless_context(&display, &context)) {
+    return 1;
+  }
+
+  gboolean ok = TRUE;
+  for (guint r = 0; r < G_N_ELEMENTS(kResolutions); r++) {
+    for (guint m = 0; m < G_N_ELEMENTS(kModes); m++) {
+      ok &= run_configuration(kResolutions[r].width, kResolutions[r].height,
+                              &kModes[m]);
+    }
+  }
+
+  eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglDestroyContext(display, context);
+  eglTerminate(display);
+  g_free(filter);
+  return ok ? 0 : 1;
+}
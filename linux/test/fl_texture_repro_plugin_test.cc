@@ -1,6 +1,25 @@
 #include <gtest/gtest.h>
+#include <gst/app/gstappsink.h>
 #include <gst/gst.h>
 
+#include <glib/gstdio.h>
+
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "frame_tap.h"
+#include "frame_trace.h"
+#include "gst_gl_texture.h"
+#include "jpeg_decode_pool.h"
+#include "jpeg_scaled_decoder.h"
+#include "recording.h"
+#include "still_capture.h"
+#include "texture_stats.h"
+#include "thread_policy.h"
+#include "tile_diff.h"
+#include "yuv_cpu_converter.h"
+
 // Test GStreamer initialization
 TEST(FlTextureReproPluginTest, GStreamerInitialization) {
   // GStreamer should initialize without error
@@ -68,3 +87,688 @@ TEST(FlTextureReproPluginTest, PipelineStateChanges) {
 
   gst_object_unref(pipeline);
 }
+
+// Test latency histogram percentiles stay within one bucket of the truth
+TEST(FlTextureReproPluginTest, StatsHistogramPercentiles) {
+  TextureStats stats;
+  texture_stats_reset(&stats);
+
+  for (int64_t us = 1; us <= 1000; us++) {
+    texture_stats_histogram_record(&stats.upload_time, us);
+  }
+
+  TextureStatsHistogramSnapshot snapshot;
+  texture_stats_histogram_snapshot(&stats.upload_time, &snapshot);
+
+  EXPECT_EQ(snapshot.count, 1000u);
+  EXPECT_DOUBLE_EQ(snapshot.mean_us, 500.5);
+  // Buckets are a quarter of a power of two wide, so +-12.5%.
+  EXPECT_NEAR(snapshot.p50_us, 500, 500 * 0.125);
+  EXPECT_NEAR(snapshot.p99_us, 990, 990 * 0.125);
+  EXPECT_GE(snapshot.max_us, 1000);
+  EXPECT_LE(snapshot.p50_us, snapshot.p90_us);
+  EXPECT_LE(snapshot.p90_us, snapshot.p99_us);
+  EXPECT_LE(snapshot.p99_us, snapshot.max_us);
+}
+
+// Test the fused scale + convert stage against known colors
+TEST(FlTextureReproPluginTest, CpuConverterScalesAndConverts) {
+  gst_init(nullptr, nullptr);
+
+  // Full-range BT.601 I420: left half white, right half pure red.
+  GstVideoInfo info;
+  gst_video_info_set_format(&info, GST_VIDEO_FORMAT_I420, 128, 64);
+  GST_VIDEO_INFO_COLORIMETRY(&info).range = GST_VIDEO_COLOR_RANGE_0_255;
+  GST_VIDEO_INFO_COLORIMETRY(&info).matrix = GST_VIDEO_COLOR_MATRIX_BT601;
+  GstBuffer* buffer = gst_buffer_new_allocate(nullptr, info.size, nullptr);
+
+  GstVideoFrame frame;
+  ASSERT_TRUE(gst_video_frame_map(&frame, &info, buffer, GST_MAP_READWRITE));
+  for (guint c = 0; c < 3; c++) {
+    guint8* data = static_cast<guint8*>(GST_VIDEO_FRAME_COMP_DATA(&frame, c));
+    gint width = GST_VIDEO_FRAME_COMP_WIDTH(&frame, c);
+    for (gint y = 0; y < GST_VIDEO_FRAME_COMP_HEIGHT(&frame, c); y++) {
+      guint8* row = data + y * GST_VIDEO_FRAME_COMP_STRIDE(&frame, c);
+      const guint8 white[] = {255, 128, 128};
+      const guint8 red[] = {76, 85, 255};
+      memset(row, white[c], width / 2);
+      memset(row + width / 2, red[c], width - width / 2);
+    }
+  }
+
+  // Downscale by 2 to an odd width so the scalar tail runs too.
+  const gint width = 61, height = 32;
+  guint8 rgba[width * height * 4];
+  YuvCpuConverter* converter = yuv_cpu_converter_new();
+  EXPECT_TRUE(yuv_cpu_converter_convert(converter, &frame, rgba, width * 4,
+                                        width, height));
+  yuv_cpu_converter_free(converter);
+  gst_video_frame_unmap(&frame);
+  gst_buffer_unref(buffer);
+
+  for (gint y = 0; y < height; y++) {
+    const guint8* left = rgba + y * width * 4;
+    const guint8* right = left + (width - 1) * 4;
+    EXPECT_NEAR(left[0], 255, 2);
+    EXPECT_NEAR(left[1], 255, 2);
+    EXPECT_NEAR(left[2], 255, 2);
+    EXPECT_EQ(left[3], 255);
+    EXPECT_NEAR(right[0], 255, 3);
+    EXPECT_NEAR(right[1], 0, 3);
+    EXPECT_NEAR(right[2], 0, 3);
+  }
+}
+
+// Test that only changed tiles are reported and copied into the reference
+TEST(FlTextureReproPluginTest, TileDiffFindsChangedTiles) {
+  // 3 x 2 tiles, the last column and row only partly covered.
+  const guint width = TILE_DIFF_SIZE * 2 + 10, height = TILE_DIFF_SIZE + 5;
+  std::vector<guint8> frame(width * height * 4, 100);
+  std::vector<guint8> reference = frame;
+  guint8 dirty[6];
+
+  EXPECT_EQ(tile_diff_update(frame.data(), reference.data(), width, height, 0,
+                             dirty),
+            0u);
+
+  // Bottom-right pixel changes a little, a pixel in tile (1, 0) a lot.
+  frame[((height - 1) * width + width - 1) * 4] = 103;
+  frame[(10 * width + TILE_DIFF_SIZE + 3) * 4 + 1] = 200;
+
+  EXPECT_EQ(tile_diff_update(frame.data(), reference.data(), width, height, 5,
+                             dirty),
+            1u);
+  EXPECT_EQ(dirty[1], 1);
+  EXPECT_EQ(dirty[5], 0);
+
+  // Below the threshold the reference keeps the old value, so an exact
+  // comparison still finds the drift.
+  EXPECT_EQ(tile_diff_update(frame.data(), reference.data(), width, height, 0,
+                             dirty),
+            1u);
+  EXPECT_EQ(dirty[5], 1);
+  EXPECT_EQ(reference, frame);
+}
+
+// Test the frame tap conversion and the message layout
+TEST(FlTextureReproPluginTest, FrameTapConvertsToGray) {
+  gst_init(nullptr, nullptr);
+
+  GstVideoInfo info;
+  gst_video_info_set_format(&info, GST_VIDEO_FORMAT_RGBA, 64, 32);
+  GstBuffer* buffer = gst_buffer_new_allocate(nullptr, info.size, nullptr);
+  gst_buffer_memset(buffer, 0, 255, info.size);
+  GST_BUFFER_PTS(buffer) = 5 * GST_MSECOND;
+  GstCaps* caps = gst_video_info_to_caps(&info);
+  GstSample* sample = gst_sample_new(buffer, caps, nullptr, nullptr);
+  gst_caps_unref(caps);
+  gst_buffer_unref(buffer);
+
+  FrameTapConverter* converter = frame_tap_converter_new();
+  FrameTapConfig config = {0, 32, 16, GST_VIDEO_FORMAT_GRAY8};
+  g_autoptr(FlValue) gray =
+      frame_tap_converter_process(converter, &config, sample);
+  ASSERT_NE(gray, nullptr);
+  EXPECT_EQ(fl_value_get_int(fl_value_lookup_string(gray, "width")), 32);
+  EXPECT_EQ(fl_value_get_int(fl_value_lookup_string(gray, "height")), 16);
+  EXPECT_STREQ(fl_value_get_string(fl_value_lookup_string(gray, "format")),
+               "gray");
+  EXPECT_EQ(fl_value_get_int(fl_value_lookup_string(gray, "ptsUs")), 5000);
+  FlValue* bytes = fl_value_lookup_string(gray, "bytes");
+  FlValue* strides = fl_value_lookup_string(gray, "strides");
+  ASSERT_EQ(fl_value_get_length(strides), 1u);
+  gint stride = fl_value_get_int(fl_value_get_list_value(strides, 0));
+  ASSERT_GE(fl_value_get_length(bytes), (size_t)(stride * 16));
+  // White is 235 or 255 depending on the default range for GRAY8.
+  EXPECT_GE(fl_value_get_uint8_list(bytes)[stride * 8 + 16], 230);
+
+  // Same format and size: passed through unchanged.
+  config = {0, 0, 0, GST_VIDEO_FORMAT_RGBA};
+  g_autoptr(FlValue) rgba =
+      frame_tap_converter_process(converter, &config, sample);
+  ASSERT_NE(rgba, nullptr);
+  EXPECT_EQ(fl_value_get_length(fl_value_lookup_string(rgba, "bytes")),
+            info.size);
+
+  frame_tap_converter_free(converter);
+  gst_sample_unref(sample);
+}
+
+// Test that a recording branch joins a running pipeline and finalizes its
+// file without stopping it
+TEST(FlTextureReproPluginTest, RecordingBranchWritesFile) {
+  gst_init(nullptr, nullptr);
+
+  GstElement* pipeline = gst_parse_launch(
+      "videotestsrc is-live=true ! video/x-raw,width=160,height=120 ! "
+      "tee name=rawtee ! fakesink",
+      nullptr);
+  ASSERT_NE(pipeline, nullptr);
+  GstElement* tee = gst_bin_get_by_name(GST_BIN(pipeline), "rawtee");
+  gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+  g_autofree gchar* path =
+      g_build_filename(g_get_tmp_dir(), "fl_texture_repro_test.avi", nullptr);
+  g_autoptr(GError) error = nullptr;
+  Recording* recording =
+      recording_start(pipeline, tee, nullptr, path, "mjpeg", &error);
+  ASSERT_NE(recording, nullptr) << error->message;
+
+  g_autoptr(GMainLoop) loop = g_main_loop_new(nullptr, FALSE);
+  g_timeout_add(
+      300,
+      [](gpointer data) -> gboolean {
+        g_main_loop_quit(static_cast<GMainLoop*>(data));
+        return G_SOURCE_REMOVE;
+      },
+      loop);
+  g_main_loop_run(loop);
+
+  gboolean done = FALSE;
+  recording_stop(
+      recording,
+      [](const gchar* path, const GError* error, gpointer data) {
+        EXPECT_EQ(error, nullptr);
+        *static_cast<gboolean*>(data) = TRUE;
+      },
+      &done);
+  while (!done) {
+    g_main_context_iteration(nullptr, TRUE);
+  }
+
+  GStatBuf stat;
+  ASSERT_EQ(g_stat(path, &stat), 0);
+  EXPECT_GT(stat.st_size, 0);
+
+  GstState state;
+  gst_element_get_state(pipeline, &state, nullptr, 0);
+  EXPECT_EQ(state, GST_STATE_PLAYING);
+
+  g_remove(path);
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  gst_object_unref(tee);
+  gst_object_unref(pipeline);
+}
+
+// Counts the non-overlapping occurrences of |needle| in |haystack|.
+static guint count_occurrences(const gchar* haystack, const gchar* needle) {
+  guint count = 0;
+  for (const gchar* p = strstr(haystack, needle); p != nullptr;
+       p = strstr(p + strlen(needle), needle)) {
+    count++;
+  }
+  return count;
+}
+
+// Test that spans from several threads end up in the dump, that the ring
+// keeps only the newest ones, and that nothing is recorded while disabled
+TEST(FlTextureReproPluginTest, FrameTraceDumpsSpans) {
+  FrameTrace* trace = frame_trace_new(16);
+  EXPECT_EQ(frame_trace_begin(trace), 0);
+  EXPECT_EQ(frame_trace_begin(nullptr), 0);
+
+  frame_trace_set_enabled(trace, TRUE);
+  auto record = [trace](gint64 arg) {
+    for (int i = 0; i < 5; i++) {
+      frame_trace_end(trace, "copy", frame_trace_begin(trace), arg);
+    }
+  };
+  std::thread first(record, 1);
+  std::thread second(record, 2);
+  first.join();
+  second.join();
+
+  g_autofree gchar* path =
+      g_build_filename(g_get_tmp_dir(), "fl_texture_repro_trace.json", nullptr);
+  g_autoptr(GError) error = nullptr;
+  EXPECT_EQ(frame_trace_dump(trace, path, &error), 10);
+  g_autofree gchar* json = nullptr;
+  ASSERT_TRUE(g_file_get_contents(path, &json, nullptr, nullptr));
+  EXPECT_TRUE(g_str_has_prefix(json, "{\"traceEvents\":["));
+  EXPECT_EQ(count_occurrences(json, "\"ph\":\"X\""), 10u);
+  EXPECT_EQ(count_occurrences(json, "\"args\":{\"texture\":2}"), 5u);
+  EXPECT_EQ(count_occurrences(json, "\"thread_name\""), 2u);
+
+  // Wraps around, keeping the newest 16
+  record(3);
+  record(3);
+  record(3);
+  EXPECT_EQ(frame_trace_dump(trace, path, &error), 16);
+
+  frame_trace_set_enabled(trace, FALSE);
+  EXPECT_EQ(frame_trace_begin(trace), 0);
+  // Starting again clears the ring
+  frame_trace_set_enabled(trace, TRUE);
+  EXPECT_EQ(frame_trace_dump(trace, path, &error), 0);
+
+  g_remove(path);
+  frame_trace_free(trace);
+}
+
+// Test that a raw still is encoded to JPEG off the streaming thread
+TEST(FlTextureReproPluginTest, StillCaptureEncodesJpeg) {
+  gst_init(nullptr, nullptr);
+
+  GstElement* pipeline = gst_parse_launch(
+      "videotestsrc is-live=true ! video/x-raw,width=320,height=240 ! "
+      "tee name=rawtee ! fakesink",
+      nullptr);
+  ASSERT_NE(pipeline, nullptr);
+  GstElement* tee = gst_bin_get_by_name(GST_BIN(pipeline), "rawtee");
+  gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+  GBytes* jpeg = nullptr;
+  gboolean done = FALSE;
+  struct Result {
+    GBytes** jpeg;
+    gboolean* done;
+  } result = {&jpeg, &done};
+  still_capture_next(
+      tee, nullptr,
+      [](GBytes* jpeg, const GError* error, gpointer data) {
+        Result* result = static_cast<Result*>(data);
+        EXPECT_EQ(error, nullptr);
+        if (jpeg != nullptr) {
+          *result->jpeg = g_bytes_ref(jpeg);
+        }
+        *result->done = TRUE;
+      },
+      &result);
+  while (!done) {
+    g_main_context_iteration(nullptr, TRUE);
+  }
+
+  ASSERT_NE(jpeg, nullptr);
+  gsize size = 0;
+  const guint8* data = static_cast<const guint8*>(g_bytes_get_data(jpeg, &size));
+  ASSERT_GT(size, 2u);
+  EXPECT_EQ(data[0], 0xff);
+  EXPECT_EQ(data[1], 0xd8);
+  g_bytes_unref(jpeg);
+
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  gst_object_unref(tee);
+  gst_object_unref(pipeline);
+}
+
+// Test that the decode pool decodes every frame and keeps them in order
+TEST(FlTextureReproPluginTest, JpegDecodePoolKeepsOrder) {
+  gst_init(nullptr, nullptr);
+  ASSERT_TRUE(jpeg_decode_pool_register());
+
+  GstElement* pipeline = gst_parse_launch(
+      "videotestsrc num-buffers=30 ! video/x-raw,width=320,height=240 ! "
+      "jpegenc ! fltexturejpegpool workers=3 ! appsink name=sink sync=false",
+      nullptr);
+  ASSERT_NE(pipeline, nullptr);
+  GstElement* sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+  gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+  guint frames = 0;
+  GstClockTime last = GST_CLOCK_TIME_NONE;
+  GstSample* sample;
+  while ((sample = gst_app_sink_pull_sample(GST_APP_SINK(sink))) != nullptr) {
+    GstBuffer* buffer = gst_sample_get_buffer(sample);
+    GstStructure* s = gst_caps_get_structure(gst_sample_get_caps(sample), 0);
+    EXPECT_TRUE(gst_structure_has_name(s, "video/x-raw"));
+    if (GST_CLOCK_TIME_IS_VALID(last)) {
+      EXPECT_GT(GST_BUFFER_PTS(buffer), last);
+    }
+    last = GST_BUFFER_PTS(buffer);
+    frames++;
+    gst_sample_unref(sample);
+  }
+  EXPECT_EQ(frames, 30u);
+
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  gst_object_unref(sink);
+  gst_object_unref(pipeline);
+}
+
+// Test that a camera texture created before gst_init(), as the plugin does,
+// still gets the decode pool. Under ctest every test runs in its own
+// process, so GStreamer is not initialized here yet.
+TEST(FlTextureReproPluginTest, DecodePoolRegistersAfterLateInit) {
+  GstGLTextureOptions options;
+  gst_gl_texture_options_init(&options);
+  options.device = "/dev/fl-texture-repro-missing";
+  options.decode_workers = 2;
+  GstGLTexture* texture = gst_gl_texture_new(&options);
+
+  // There is no camera, but the pipeline description is built first.
+  gst_gl_texture_start_pipeline(texture);
+  ASSERT_TRUE(gst_is_initialized());
+  g_autoptr(GstElementFactory) jpegdec = gst_element_factory_find("jpegdec");
+  if (jpegdec == nullptr) {
+    g_object_unref(texture);
+    GTEST_SKIP() << "jpegdec not installed";
+  }
+  g_autoptr(GstElementFactory) pool =
+      gst_element_factory_find("fltexturejpegpool");
+  EXPECT_NE(pool, nullptr);
+  g_object_unref(texture);
+}
+
+// Test the same for the scaled decoder
+TEST(FlTextureReproPluginTest, ScaledDecoderRegistersAfterLateInit) {
+  GstGLTextureOptions options;
+  gst_gl_texture_options_init(&options);
+  options.device = "/dev/fl-texture-repro-missing";
+  options.scaled_decode = TRUE;
+  GstGLTexture* texture = gst_gl_texture_new(&options);
+
+  gst_gl_texture_start_pipeline(texture);
+  ASSERT_TRUE(gst_is_initialized());
+  g_autoptr(GstElementFactory) decoder =
+      gst_element_factory_find("fltexturejpegscaledec");
+  EXPECT_NE(decoder, nullptr);
+  g_object_unref(texture);
+}
+
+// Test that the scaled decoder decodes at the smallest size covering the
+// target and follows a new target while playing
+TEST(FlTextureReproPluginTest, JpegScaledDecoderFollowsTarget) {
+  EXPECT_EQ(jpeg_scaled_decoder_scale(1920, 1080, 640, 480), 4u);
+  EXPECT_EQ(jpeg_scaled_decoder_scale(1920, 1080, 240, 135), 1u);
+  EXPECT_EQ(jpeg_scaled_decoder_scale(1920, 1080, 0, 0), 1u);
+  EXPECT_EQ(jpeg_scaled_decoder_scale(1920, 1080, 1920, 1080), 8u);
+
+  gst_init(nullptr, nullptr);
+  ASSERT_TRUE(jpeg_scaled_decoder_register());
+
+  GstElement* pipeline = gst_parse_launch(
+      "videotestsrc num-buffers=10 ! video/x-raw,width=320,height=240 ! "
+      "jpegenc ! fltexturejpegscaledec name=dec target-width=80 "
+      "target-height=60 ! appsink name=sink sync=false max-buffers=1",
+      nullptr);
+  ASSERT_NE(pipeline, nullptr);
+  GstElement* decoder = gst_bin_get_by_name(GST_BIN(pipeline), "dec");
+  GstElement* sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+  gst_element_set_state(pipeline, GST_STATE_PLAYING);
+
+  GstVideoInfo info;
+  GstSample* sample = gst_app_sink_pull_sample(GST_APP_SINK(sink));
+  ASSERT_NE(sample, nullptr);
+  ASSERT_TRUE(gst_video_info_from_caps(&info, gst_sample_get_caps(sample)));
+  EXPECT_EQ(GST_VIDEO_INFO_WIDTH(&info), 80);
+  EXPECT_EQ(GST_VIDEO_INFO_HEIGHT(&info), 60);
+  gst_sample_unref(sample);
+
+  g_object_set(decoder, "target-width", 0, "target-height", 0, nullptr);
+  GstSample* last = nullptr;
+  while ((sample = gst_app_sink_pull_sample(GST_APP_SINK(sink))) != nullptr) {
+    g_clear_pointer(&last, gst_sample_unref);
+    last = sample;
+  }
+  ASSERT_NE(last, nullptr);
+  ASSERT_TRUE(gst_video_info_from_caps(&info, gst_sample_get_caps(last)));
+  EXPECT_EQ(GST_VIDEO_INFO_WIDTH(&info), 320);
+  EXPECT_EQ(GST_VIDEO_INFO_HEIGHT(&info), 240);
+  gst_sample_unref(last);
+
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  gst_object_unref(decoder);
+  gst_object_unref(sink);
+  gst_object_unref(pipeline);
+}
+
+// Test that an asynchronous start can stop at READY and continue to PLAYING
+TEST(FlTextureReproPluginTest, AsyncStartPreloadsThenPlays) {
+  GstGLTextureOptions options;
+  gst_gl_texture_options_init(&options);
+  options.source = "videotestsrc is-live=true";
+  GstGLTexture* texture = gst_gl_texture_new(&options);
+
+  auto started = [](GstGLTexture* texture, const GError* error,
+                    gpointer data) {
+    EXPECT_EQ(error, nullptr);
+    *static_cast<GstState*>(data) = gst_gl_texture_get_pipeline_state(texture);
+  };
+
+  GstState state = GST_STATE_VOID_PENDING;
+  gst_gl_texture_start_pipeline_async(texture, GST_STATE_READY, started,
+                                      &state);
+  while (state == GST_STATE_VOID_PENDING) {
+    g_main_context_iteration(nullptr, TRUE);
+  }
+  EXPECT_EQ(state, GST_STATE_READY);
+
+  state = GST_STATE_VOID_PENDING;
+  gst_gl_texture_start_pipeline_async(texture, GST_STATE_PLAYING, started,
+                                      &state);
+  while (state == GST_STATE_VOID_PENDING) {
+    g_main_context_iteration(nullptr, TRUE);
+  }
+  EXPECT_EQ(state, GST_STATE_PLAYING);
+
+  gst_gl_texture_stop_pipeline(texture);
+  EXPECT_EQ(gst_gl_texture_get_pipeline_state(texture), GST_STATE_NULL);
+  g_object_unref(texture);
+}
+
+// Returns the "framesReceived" counter of |texture|.
+static int64_t frames_received(GstGLTexture* texture) {
+  g_autoptr(FlValue) stats = gst_gl_texture_get_stats(texture);
+  return fl_value_get_int(fl_value_lookup_string(stats, "framesReceived"));
+}
+
+// Test that a paused texture stops receiving frames and resumes in place
+TEST(FlTextureReproPluginTest, PauseStopsFrames) {
+  GstGLTextureOptions options;
+  gst_gl_texture_options_init(&options);
+  options.source = "videotestsrc is-live=true";
+  GstGLTexture* texture = gst_gl_texture_new(&options);
+  ASSERT_TRUE(gst_gl_texture_start_pipeline(texture));
+
+  g_usleep(200 * 1000);
+  EXPECT_GT(frames_received(texture), 0);
+
+  ASSERT_TRUE(gst_gl_texture_set_paused(texture, TRUE));
+  EXPECT_EQ(gst_gl_texture_get_pipeline_state(texture), GST_STATE_PAUSED);
+  int64_t paused_frames = frames_received(texture);
+  g_usleep(200 * 1000);
+  // At most one frame that was already on its way.
+  EXPECT_LE(frames_received(texture), paused_frames + 1);
+
+  ASSERT_TRUE(gst_gl_texture_set_paused(texture, FALSE));
+  g_usleep(200 * 1000);
+  EXPECT_GT(frames_received(texture), paused_frames + 1);
+
+  gst_gl_texture_stop_pipeline(texture);
+  EXPECT_FALSE(gst_gl_texture_set_paused(texture, TRUE));
+  g_object_unref(texture);
+}
+
+// Test that playing a paused texture opens its valve again instead of
+// leaving the pipeline PLAYING with every frame dropped
+TEST(FlTextureReproPluginTest, PlayResumesPausedTexture) {
+  GstGLTextureOptions options;
+  gst_gl_texture_options_init(&options);
+  options.source = "videotestsrc is-live=true";
+  GstGLTexture* texture = gst_gl_texture_new(&options);
+  ASSERT_TRUE(gst_gl_texture_start_pipeline(texture));
+  ASSERT_TRUE(gst_gl_texture_set_paused(texture, TRUE));
+
+  auto started = [](GstGLTexture* texture, const GError* error,
+                    gpointer data) {
+    EXPECT_EQ(error, nullptr);
+    *static_cast<GstState*>(data) = gst_gl_texture_get_pipeline_state(texture);
+  };
+
+  GstState state = GST_STATE_VOID_PENDING;
+  gst_gl_texture_start_pipeline_async(texture, GST_STATE_PLAYING, started,
+                                      &state);
+  while (state == GST_STATE_VOID_PENDING) {
+    g_main_context_iteration(nullptr, TRUE);
+  }
+  EXPECT_EQ(state, GST_STATE_PLAYING);
+
+  int64_t played_frames = frames_received(texture);
+  g_usleep(200 * 1000);
+  EXPECT_GT(frames_received(texture), played_frames + 1);
+
+  gst_gl_texture_stop_pipeline(texture);
+  g_object_unref(texture);
+}
+
+// Test that views share the source's pipeline and that pausing only stops
+// the paused texture until all of them are paused
+TEST(FlTextureReproPluginTest, ViewsShareOneSource) {
+  GstGLTextureOptions options;
+  gst_gl_texture_options_init(&options);
+  options.source = "videotestsrc is-live=true";
+  GstGLTexture* source = gst_gl_texture_new(&options);
+  ASSERT_TRUE(gst_gl_texture_start_pipeline(source));
+  GstGLTexture* view = gst_gl_texture_new_view(source, &options);
+  gst_gl_texture_set_output_size(view, 160, 120);
+  ASSERT_TRUE(gst_gl_texture_start_pipeline(view));
+
+  g_usleep(200 * 1000);
+  EXPECT_GT(frames_received(source), 0);
+  EXPECT_GT(frames_received(view), 0);
+
+  // A paused view drops its frames while the source keeps streaming.
+  ASSERT_TRUE(gst_gl_texture_set_paused(view, TRUE));
+  EXPECT_EQ(gst_gl_texture_get_pipeline_state(source), GST_STATE_PLAYING);
+  int64_t view_frames = frames_received(view);
+  int64_t source_frames = frames_received(source);
+  g_usleep(200 * 1000);
+  EXPECT_LE(frames_received(view), view_frames + 1);
+  EXPECT_GT(frames_received(source), source_frames + 1);
+
+  // With everything paused the pipeline pauses; a view alone resumes it.
+  ASSERT_TRUE(gst_gl_texture_set_paused(source, TRUE));
+  EXPECT_EQ(gst_gl_texture_get_pipeline_state(source), GST_STATE_PAUSED);
+  ASSERT_TRUE(gst_gl_texture_set_paused(view, FALSE));
+  EXPECT_EQ(gst_gl_texture_get_pipeline_state(source), GST_STATE_PLAYING);
+  view_frames = frames_received(view);
+  source_frames = frames_received(source);
+  g_usleep(200 * 1000);
+  EXPECT_GT(frames_received(view), view_frames + 1);
+  EXPECT_LE(frames_received(source), source_frames + 1);
+
+  gst_gl_texture_stop_pipeline(view);
+  EXPECT_EQ(gst_gl_texture_get_pipeline_state(view), GST_STATE_NULL);
+  g_object_unref(view);
+  gst_gl_texture_stop_pipeline(source);
+  g_object_unref(source);
+}
+
+// Test CPU list parsing and formatting
+TEST(FlTextureReproPluginTest, ThreadPolicyParsesCpuLists) {
+  cpu_set_t cpus;
+  ASSERT_TRUE(thread_policy_parse_cpus("2-5, 7,0", &cpus));
+  g_autofree gchar* list = thread_policy_format_cpus(&cpus);
+  EXPECT_STREQ(list, "0,2-5,7");
+
+  EXPECT_FALSE(thread_policy_parse_cpus("", &cpus));
+  EXPECT_FALSE(thread_policy_parse_cpus("5-2", &cpus));
+  EXPECT_FALSE(thread_policy_parse_cpus("1,", &cpus));
+  EXPECT_FALSE(thread_policy_parse_cpus("-1", &cpus));
+  EXPECT_FALSE(thread_policy_parse_cpus("100000", &cpus));
+}
+
+// Test that the streaming threads and the converter's workers pick up the
+// policy, that the stats report where each landed and that the streaming
+// threads are put back as they leave
+TEST(FlTextureReproPluginTest, StreamThreadsFollowPolicy) {
+  // The first CPU this process may run on, so a restricted cpuset passes.
+  cpu_set_t allowed;
+  ASSERT_EQ(sched_getaffinity(0, sizeof(allowed), &allowed), 0);
+  gint cpu = 0;
+  while (!CPU_ISSET(cpu, &allowed)) {
+    cpu++;
+  }
+  g_autofree gchar* cpus = g_strdup_printf("%d", cpu);
+
+  GstGLTextureOptions options;
+  gst_gl_texture_options_init(&options);
+  options.source = "videotestsrc is-live=true ! queue";
+  options.thread_cpus = cpus;
+  options.thread_nice = 1;  // Lowering priority needs no privileges
+  options.fused_convert = TRUE;
+  GstGLTexture* texture = gst_gl_texture_new(&options);
+  ASSERT_TRUE(gst_gl_texture_start_pipeline(texture));
+  g_usleep(200 * 1000);
+
+  g_autoptr(FlValue) stats = gst_gl_texture_get_stats(texture);
+  // The source's thread and the queue's.
+  EXPECT_GE(fl_value_get_int(
+                fl_value_lookup_string(stats, "streamThreadsPlaced")),
+            2);
+  EXPECT_EQ(fl_value_get_int(
+                fl_value_lookup_string(stats, "streamThreadsRefused")),
+            0);
+  FlValue* threads = fl_value_lookup_string(stats, "placedThreads");
+  size_t n_stream = 0, n_convert = 0;
+  for (size_t i = 0; i < fl_value_get_length(threads); i++) {
+    FlValue* thread = fl_value_get_list_value(threads, i);
+    const gchar* role =
+        fl_value_get_string(fl_value_lookup_string(thread, "role"));
+    n_stream += g_strcmp0(role, "stream") == 0;
+    n_convert += g_strcmp0(role, "convert") == 0;
+    EXPECT_STREQ(fl_value_get_string(fl_value_lookup_string(thread, "cpus")),
+                 cpus);
+    EXPECT_STREQ(
+        fl_value_get_string(fl_value_lookup_string(thread, "policy")),
+        "other");
+    EXPECT_EQ(fl_value_get_int(fl_value_lookup_string(thread, "nice")), 1);
+    EXPECT_FALSE(fl_value_get_bool(fl_value_lookup_string(thread, "refused")));
+  }
+  EXPECT_GE(n_stream, 2u);
+  if (g_get_num_processors() > 1) {
+    EXPECT_GE(n_convert, 1u);
+  }
+
+  // Only the converter's workers stay placed once the pipeline is down.
+  gst_gl_texture_stop_pipeline(texture);
+  g_autoptr(FlValue) stopped = gst_gl_texture_get_stats(texture);
+  threads = fl_value_lookup_string(stopped, "placedThreads");
+  EXPECT_EQ(fl_value_get_length(threads), n_convert);
+  g_object_unref(texture);
+}
+
+// Width and height of the caps |texture| negotiated, 0x0 if none yet.
+static void negotiated_size(GstGLTexture* texture, gint* width, gint* height) {
+  *width = 0;
+  *height = 0;
+  GstCaps* caps = gst_gl_texture_get_caps(texture);
+  if (caps != nullptr) {
+    GstStructure* structure = gst_caps_get_structure(caps, 0);
+    gst_structure_get_int(structure, "width", width);
+    gst_structure_get_int(structure, "height", height);
+    gst_caps_unref(caps);
+  }
+}
+
+// Test that a new output size renegotiates the running pipeline
+TEST(FlTextureReproPluginTest, OutputSizeRenegotiates) {
+  GstGLTextureOptions options;
+  gst_gl_texture_options_init(&options);
+  options.source = "videotestsrc is-live=true";
+  GstGLTexture* texture = gst_gl_texture_new(&options);
+  gst_gl_texture_set_output_size(texture, 320, 240);
+  ASSERT_TRUE(gst_gl_texture_start_pipeline(texture));
+
+  gint width = 0;
+  gint height = 0;
+  for (int i = 0; i < 100 && width != 320; i++) {
+    g_usleep(20 * 1000);
+    negotiated_size(texture, &width, &height);
+  }
+  EXPECT_EQ(width, 320);
+  EXPECT_EQ(height, 240);
+
+  // Odd sizes are rounded down to keep chroma planes whole.
+  gst_gl_texture_set_output_size(texture, 161, 121);
+  EXPECT_EQ(gst_gl_texture_get_pipeline_state(texture), GST_STATE_PLAYING);
+  for (int i = 0; i < 100 && width != 160; i++) {
+    g_usleep(20 * 1000);
+    negotiated_size(texture, &width, &height);
+  }
+  EXPECT_EQ(width, 160);
+  EXPECT_EQ(height, 120);
+
+  gst_gl_texture_stop_pipeline(texture);
+  g_object_unref(texture);
+}
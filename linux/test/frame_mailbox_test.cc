@@ -0,0 +1,88 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+
+#include "frame_mailbox.h"
+
+// Test the single-threaded hand-off rules
+TEST(FrameMailboxTest, LatestFrameWins) {
+  FrameMailbox mailbox;
+  frame_mailbox_init(&mailbox);
+  int slots[FRAME_MAILBOX_SLOTS] = {};
+
+  // Nothing published yet
+  EXPECT_FALSE(frame_mailbox_has_new_frame(&mailbox));
+  EXPECT_FALSE(frame_mailbox_acquire(&mailbox));
+
+  slots[frame_mailbox_back(&mailbox)] = 1;
+  EXPECT_FALSE(frame_mailbox_publish(&mailbox));
+  slots[frame_mailbox_back(&mailbox)] = 2;
+  // Frame 1 was never acquired, so it is dropped
+  EXPECT_TRUE(frame_mailbox_publish(&mailbox));
+
+  EXPECT_TRUE(frame_mailbox_has_new_frame(&mailbox));
+  EXPECT_TRUE(frame_mailbox_acquire(&mailbox));
+  EXPECT_EQ(slots[frame_mailbox_front(&mailbox)], 2);
+
+  // The front slot is kept until something new arrives
+  EXPECT_FALSE(frame_mailbox_acquire(&mailbox));
+  EXPECT_EQ(slots[frame_mailbox_front(&mailbox)], 2);
+
+  // The three roles always name different slots
+  EXPECT_NE(frame_mailbox_back(&mailbox), frame_mailbox_front(&mailbox));
+}
+
+// Stress the mailbox from two threads: the consumer must only ever see
+// complete frames, in increasing order, and every frame must be either
+// consumed or reported dropped.
+TEST(FrameMailboxTest, ConcurrentProducerConsumer) {
+  constexpr int kFrames = 200000;
+  constexpr int kPayload = 64;
+
+  FrameMailbox mailbox;
+  frame_mailbox_init(&mailbox);
+  int slots[FRAME_MAILBOX_SLOTS][kPayload] = {};
+
+  std::atomic<bool> done(false);
+  int dropped = 0;
+
+  std::thread producer([&]() {
+    for (int frame = 1; frame <= kFrames; frame++) {
+      int* slot = slots[frame_mailbox_back(&mailbox)];
+      for (int i = 0; i < kPayload; i++) {
+        slot[i] = frame;
+      }
+      if (frame_mailbox_publish(&mailbox)) {
+        dropped++;
+      }
+    }
+    done.store(true, std::memory_order_release);
+  });
+
+  int consumed = 0;
+  int last = 0;
+  bool torn = false;
+  bool reordered = false;
+  while (true) {
+    // Read |done| first so a final publish is not missed.
+    bool finished = done.load(std::memory_order_acquire);
+    if (frame_mailbox_acquire(&mailbox)) {
+      const int* slot = slots[frame_mailbox_front(&mailbox)];
+      for (int i = 1; i < kPayload; i++) {
+        torn |= slot[i] != slot[0];
+      }
+      reordered |= slot[0] <= last;
+      last = slot[0];
+      consumed++;
+    } else if (finished) {
+      break;
+    }
+  }
+  producer.join();
+
+  EXPECT_FALSE(torn);
+  EXPECT_FALSE(reordered);
+  EXPECT_EQ(last, kFrames);
+  EXPECT_EQ(consumed + dropped, kFrames);
+}
@@ -0,0 +1,355 @@
+// epoxy must come before anything that may pull in the system GL headers.
+#include <epoxy/egl.h>
+#include <epoxy/gl.h>
+
+#include <gtest/gtest.h>
+#include <gst/gst.h>
+
+#include "gl_state_guard.h"
+#include "gst_gl_texture.h"
+
+// The bindings the plugin touches, as Flutter would see them.
+typedef struct {
+  GLint active_texture;
+  GLint texture_unit0;
+  GLint texture_unit1;
+  GLint unpack_alignment;
+  GLint unpack_row_length;
+  GLint pixel_unpack_buffer;
+} GlSnapshot;
+
+static GlSnapshot take_snapshot() {
+  GlSnapshot snapshot;
+  glGetIntegerv(GL_ACTIVE_TEXTURE, &snapshot.active_texture);
+  glActiveTexture(GL_TEXTURE0);
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &snapshot.texture_unit0);
+  glActiveTexture(GL_TEXTURE1);
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &snapshot.texture_unit1);
+  glActiveTexture(snapshot.active_texture);
+  glGetIntegerv(GL_UNPACK_ALIGNMENT, &snapshot.unpack_alignment);
+  glGetIntegerv(GL_UNPACK_ROW_LENGTH, &snapshot.unpack_row_length);
+  glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &snapshot.pixel_unpack_buffer);
+  return snapshot;
+}
+
+static void expect_snapshot_eq(const GlSnapshot& a, const GlSnapshot& b) {
+  EXPECT_EQ(a.active_texture, b.active_texture);
+  EXPECT_EQ(a.texture_unit0, b.texture_unit0);
+  EXPECT_EQ(a.texture_unit1, b.texture_unit1);
+  EXPECT_EQ(a.unpack_alignment, b.unpack_alignment);
+  EXPECT_EQ(a.unpack_row_length, b.unpack_row_length);
+  EXPECT_EQ(a.pixel_unpack_buffer, b.pixel_unpack_buffer);
+}
+
+// Runs each test on a surfaceless EGL context, which Mesa provides with
+// llvmpipe (LIBGL_ALWAYS_SOFTWARE=1), and puts state there that differs from
+// the defaults, the way Skia leaves it between draws.
+class GlStateGuardTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    if (epoxy_has_egl_extension(EGL_NO_DISPLAY,
+                                "EGL_MESA_platform_surfaceless")) {
+      display_ = eglGetPlatformDisplayEXT(EGL_PLATFORM_SURFACELESS_MESA,
+                                          EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    if (display_ == EGL_NO_DISPLAY ||
+        !eglInitialize(display_, nullptr, nullptr) ||
+        !epoxy_has_egl_extension(display_, "EGL_KHR_surfaceless_context") ||
+        !eglBindAPI(EGL_OPENGL_API)) {
+      GTEST_SKIP() << "No surfaceless EGL display";
+    }
+    const EGLint config_attribs[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                                     EGL_NONE};
+    EGLConfig config = nullptr;
+    EGLint num_configs = 0;
+    if (!eglChooseConfig(display_, config_attribs, &config, 1,
+                         &num_configs) ||
+        num_configs == 0) {
+      GTEST_SKIP() << "No desktop GL config";
+    }
+    context_ = eglCreateContext(display_, config, EGL_NO_CONTEXT, nullptr);
+    if (context_ == EGL_NO_CONTEXT ||
+        !eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, context_)) {
+      GTEST_SKIP() << "Cannot make a GL context current";
+    }
+    if (epoxy_gl_version() < 32) {
+      GTEST_SKIP() << "GL 3.2 needed for PBO uploads";
+    }
+
+    glGenTextures(2, skia_textures_);
+    glGenBuffers(1, &skia_buffer_);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, skia_textures_[0]);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, skia_textures_[1]);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 7);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, skia_buffer_);
+  }
+
+  void TearDown() override {
+    if (context_ != EGL_NO_CONTEXT) {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      glDeleteBuffers(1, &skia_buffer_);
+      glDeleteTextures(2, skia_textures_);
+      eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                     EGL_NO_CONTEXT);
+      eglDestroyContext(display_, context_);
+    }
+    if (display_ != EGL_NO_DISPLAY) {
+      eglTerminate(display_);
+    }
+  }
+
+  EGLDisplay display_ = EGL_NO_DISPLAY;
+  EGLContext context_ = EGL_NO_CONTEXT;
+  GLuint skia_textures_[2] = {};
+  GLuint skia_buffer_ = 0;
+};
+
+// Test that every item changed in the scope is put back, the texture binding
+// on the unit it was changed on
+TEST_F(GlStateGuardTest, RestoresChangedState) {
+  GlSnapshot before = take_snapshot();
+
+  GLuint texture;
+  glGenTextures(1, &texture);
+  GlStateGuard guard;
+  gl_state_guard_init(&guard);
+  gl_state_guard_begin(&guard, TRUE);
+  gl_state_guard_active_texture(&guard, GL_TEXTURE0);
+  gl_state_guard_bind_texture(&guard, texture);
+  gl_state_guard_bind_texture(&guard, texture);
+  gl_state_guard_pixel_store(&guard, GL_UNPACK_ALIGNMENT, 4);
+  gl_state_guard_pixel_store(&guard, GL_UNPACK_ROW_LENGTH, 0);
+  gl_state_guard_bind_unpack_buffer(&guard, 0);
+  gl_state_guard_end(&guard);
+
+  expect_snapshot_eq(before, take_snapshot());
+  glDeleteTextures(1, &texture);
+}
+
+// Test that a binding to a texture deleted in the scope is not restored
+TEST_F(GlStateGuardTest, ForgetsDeletedTexture) {
+  GLuint texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+
+  GlStateGuard guard;
+  gl_state_guard_init(&guard);
+  gl_state_guard_begin(&guard, TRUE);
+  gl_state_guard_bind_texture(&guard, skia_textures_[1]);
+  glDeleteTextures(1, &texture);
+  gl_state_guard_texture_deleted(&guard, texture);
+  gl_state_guard_end(&guard);
+
+  GLint binding = -1;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &binding);
+  EXPECT_EQ(binding, 0);
+}
+
+// Test that a pass puts back what it changed even in a disabled guard,
+// as it finds it each time when the renderer changes state in between
+TEST_F(GlStateGuardTest, PassRestoresWithGuardDisabled) {
+  GLuint framebuffers[2];
+  glGenFramebuffers(2, framebuffers);
+
+  GlStateGuard guard;
+  gl_state_guard_init(&guard);
+  for (int i = 0; i < 2; i++) {
+    // The renderer's own state differs on every frame.
+    GLuint renderer_framebuffer = i == 0 ? 0 : framebuffers[1];
+    glBindFramebuffer(GL_FRAMEBUFFER, renderer_framebuffer);
+    glViewport(i, 2, 3, 4 + i);
+    if (i == 0) {
+      glEnable(GL_BLEND);
+    } else {
+      glDisable(GL_BLEND);
+      glActiveTexture(GL_TEXTURE0);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+
+    GlSnapshot before = take_snapshot();
+    gl_state_guard_begin(&guard, FALSE);
+    gl_state_guard_begin_pass(&guard);
+    gl_state_guard_active_texture(&guard, GL_TEXTURE1);
+    gl_state_guard_bind_texture(&guard, skia_textures_[0]);
+    gl_state_guard_pixel_store(&guard, GL_UNPACK_ALIGNMENT, 1);
+    gl_state_guard_bind_framebuffer(&guard, framebuffers[0]);
+    gl_state_guard_set_capability(&guard, GL_BLEND, i == 0 ? FALSE : TRUE);
+    gl_state_guard_viewport(&guard, 0, 0, 16, 16);
+    gl_state_guard_end_pass(&guard);
+    gl_state_guard_end(&guard);
+
+    expect_snapshot_eq(before, take_snapshot());
+    GLint binding = -1;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &binding);
+    EXPECT_EQ(binding, static_cast<GLint>(renderer_framebuffer));
+    EXPECT_EQ(glIsEnabled(GL_BLEND), i == 0 ? GL_TRUE : GL_FALSE);
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    EXPECT_EQ(viewport[0], i);
+    EXPECT_EQ(viewport[3], 4 + i);
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glDisable(GL_BLEND);
+  glDeleteFramebuffers(2, framebuffers);
+}
+
+// Test that populate puts back the state the renderer left on each frame,
+// not what it found on the one before
+TEST_F(GlStateGuardTest, PopulateReadsStateAfresh) {
+  gst_init(nullptr, nullptr);
+  GstGLTextureOptions options;
+  gst_gl_texture_options_init(&options);
+  options.source = "videotestsrc is-live=true";
+  options.pbo_ring_depth = 2;
+  options.restore_gl_state = TRUE;
+  GstGLTexture* texture = gst_gl_texture_new(&options);
+  ASSERT_TRUE(gst_gl_texture_start_pipeline(texture));
+
+  GLuint renderer_buffer;
+  glGenBuffers(1, &renderer_buffer);
+  for (int i = 0; i < 2; i++) {
+    if (i == 1) {
+      // What the renderer does between the two frames
+      glActiveTexture(GL_TEXTURE0);
+      glPixelStorei(GL_UNPACK_ROW_LENGTH, 3);
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, renderer_buffer);
+    }
+    GlSnapshot before = take_snapshot();
+
+    gint64 deadline = g_get_monotonic_time() + 2 * G_USEC_PER_SEC;
+    while (!gst_gl_texture_take_frame_pending(texture) &&
+           g_get_monotonic_time() < deadline) {
+      g_usleep(10 * 1000);
+    }
+    uint32_t target = 0, name = 0, width = 0, height = 0;
+    g_autoptr(GError) error = nullptr;
+    EXPECT_TRUE(FL_TEXTURE_GL_GET_CLASS(texture)->populate(
+        FL_TEXTURE_GL(texture), &target, &name, &width, &height, &error));
+    EXPECT_NE(name, 0u);
+    // The upload went into the texture, not through the renderer's buffer
+    // or with its row length.
+    EXPECT_EQ(glGetError(), static_cast<GLenum>(GL_NO_ERROR));
+
+    expect_snapshot_eq(before, take_snapshot());
+  }
+
+  gst_gl_texture_stop_pipeline(texture);
+  g_object_unref(texture);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, skia_buffer_);
+  glDeleteBuffers(1, &renderer_buffer);
+}
+
+// Waits for a frame from |options|' pipeline and hands it to Flutter.
+static void populate_one_frame(GstGLTextureOptions* options) {
+  gst_init(nullptr, nullptr);
+  options->source = "videotestsrc is-live=true";
+  GstGLTexture* texture = gst_gl_texture_new(options);
+  ASSERT_TRUE(gst_gl_texture_start_pipeline(texture));
+
+  gint64 deadline = g_get_monotonic_time() + 2 * G_USEC_PER_SEC;
+  while (!gst_gl_texture_take_frame_pending(texture) &&
+         g_get_monotonic_time() < deadline) {
+    g_usleep(10 * 1000);
+  }
+
+  uint32_t target = 0, name = 0, width = 0, height = 0;
+  g_autoptr(GError) error = nullptr;
+  EXPECT_TRUE(FL_TEXTURE_GL_GET_CLASS(texture)->populate(
+      FL_TEXTURE_GL(texture), &target, &name, &width, &height, &error));
+  EXPECT_NE(name, 0u);
+
+  gst_gl_texture_stop_pipeline(texture);
+  g_object_unref(texture);
+}
+
+// Test that populate leaves Flutter's state as it found it on the PBO path
+TEST_F(GlStateGuardTest, PopulateRestoresStateWithPbo) {
+  GlSnapshot before = take_snapshot();
+
+  GstGLTextureOptions options;
+  gst_gl_texture_options_init(&options);
+  options.pbo_ring_depth = 2;
+  options.restore_gl_state = TRUE;
+  populate_one_frame(&options);
+
+  expect_snapshot_eq(before, take_snapshot());
+}
+
+// Test the same for copy uploads
+TEST_F(GlStateGuardTest, PopulateRestoresStateWithCopy) {
+  GlSnapshot before = take_snapshot();
+
+  GstGLTextureOptions options;
+  gst_gl_texture_options_init(&options);
+  options.partial_updates = TRUE;
+  options.restore_gl_state = TRUE;
+  populate_one_frame(&options);
+
+  expect_snapshot_eq(before, take_snapshot());
+}
+
+// Test that without the option the texture is left bound, which is the
+// state leak the example reproduces
+TEST_F(GlStateGuardTest, PopulateLeaksBindingByDefault) {
+  // Without the option populate also assumes the default unpack state.
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  GstGLTextureOptions options;
+  gst_gl_texture_options_init(&options);
+  populate_one_frame(&options);
+
+  GLint binding = 0;
+  glGetIntegerv(GL_TEXTURE_BINDING_2D, &binding);
+  EXPECT_NE(binding, static_cast<GLint>(skia_textures_[1]));
+}
+
+// Test that a texture ring hands out its textures in turn, waiting on each
+// one's fence before reuse: with the GPU finished after every frame no
+// fence is still pending, so the ring is never found full
+TEST_F(GlStateGuardTest, TextureRingRotatesThroughFencedTextures) {
+  gst_init(nullptr, nullptr);
+  GstGLTextureOptions options;
+  gst_gl_texture_options_init(&options);
+  options.source = "videotestsrc is-live=true";
+  options.texture_ring_depth = 3;
+  GstGLTexture* texture = gst_gl_texture_new(&options);
+  ASSERT_TRUE(gst_gl_texture_start_pipeline(texture));
+
+  const guint n_frames = 3 * options.texture_ring_depth + 1;
+  uint32_t names[3 * GST_GL_TEXTURE_MAX_TEXTURE_RING + 1] = {};
+  for (guint i = 0; i < n_frames; i++) {
+    gint64 deadline = g_get_monotonic_time() + 2 * G_USEC_PER_SEC;
+    while (!gst_gl_texture_take_frame_pending(texture) &&
+           g_get_monotonic_time() < deadline) {
+      g_usleep(10 * 1000);
+    }
+
+    uint32_t target = 0, width = 0, height = 0;
+    g_autoptr(GError) error = nullptr;
+    ASSERT_TRUE(FL_TEXTURE_GL_GET_CLASS(texture)->populate(
+        FL_TEXTURE_GL(texture), &target, &names[i], &width, &height, &error));
+    ASSERT_NE(names[i], 0u);
+    glFinish();
+  }
+
+  for (guint i = 1; i < n_frames; i++) {
+    EXPECT_NE(names[i], names[i - 1]) << "frame " << i;
+    if (i >= options.texture_ring_depth) {
+      EXPECT_EQ(names[i], names[i - options.texture_ring_depth])
+          << "frame " << i;
+    }
+  }
+  EXPECT_NE(names[0], names[2]);
+
+  g_autoptr(FlValue) stats = gst_gl_texture_get_stats(texture);
+  EXPECT_EQ(fl_value_get_int(fl_value_lookup_string(stats, "textureRingFull")),
+            0);
+
+  gst_gl_texture_stop_pipeline(texture);
+  g_object_unref(texture);
+}
@@ -0,0 +1,110 @@
+#include "texture_stats.h"
+
+// Bucket index for a value: 0-3 are exact, then each power of two from 4 up
+// is split into 4 equal sub-buckets.
+static guint bucket_for_value(uint64_t value) {
+  if (value < 4) {
+    return value;
+  }
+  guint msb = 63 - __builtin_clzll(value);
+  guint sub = (value >> (msb - 2)) & 3;
+  guint bucket = 4 + (msb - 2) * 4 + sub;
+  return MIN(bucket, TEXTURE_STATS_HISTOGRAM_BUCKETS - 1);
+}
+
+static uint64_t bucket_lower_bound(guint bucket) {
+  if (bucket < 4) {
+    return bucket;
+  }
+  guint shift = (bucket - 4) / 4;
+  return static_cast<uint64_t>(4 + (bucket - 4) % 4) << shift;
+}
+
+static uint64_t bucket_upper_bound(guint bucket) {
+  if (bucket < 4) {
+    return bucket;
+  }
+  return bucket_lower_bound(bucket) + (G_GUINT64_CONSTANT(1) << ((bucket - 4) / 4)) -
+         1;
+}
+
+static void histogram_reset(TextureStatsHistogram* histogram) {
+  for (guint i = 0; i < TEXTURE_STATS_HISTOGRAM_BUCKETS; i++) {
+    histogram->buckets[i].store(0, std::memory_order_relaxed);
+  }
+  histogram->count.store(0, std::memory_order_relaxed);
+  histogram->sum_us.store(0, std::memory_order_relaxed);
+}
+
+void texture_stats_reset(TextureStats* stats) {
+  stats->frames_received.store(0, std::memory_order_relaxed);
+  stats->frames_dropped.store(0, std::memory_order_relaxed);
+  stats->frames_uploaded.store(0, std::memory_order_relaxed);
+  stats->populates_without_new_frame.store(0, std::memory_order_relaxed);
+  stats->bytes_copied.store(0, std::memory_order_relaxed);
+  stats->pbo_uploads.store(0, std::memory_order_relaxed);
+  stats->pbo_ring_full.store(0, std::memory_order_relaxed);
+  stats->texture_ring_full.store(0, std::memory_order_relaxed);
+  stats->tiles_uploaded.store(0, std::memory_order_relaxed);
+  stats->tiles_skipped.store(0, std::memory_order_relaxed);
+  stats->tap_frames_delivered.store(0, std::memory_order_relaxed);
+  stats->tap_frames_dropped.store(0, std::memory_order_relaxed);
+  stats->stream_threads_placed.store(0, std::memory_order_relaxed);
+  stats->stream_threads_refused.store(0, std::memory_order_relaxed);
+  histogram_reset(&stats->upload_time);
+  histogram_reset(&stats->capture_latency);
+}
+
+void texture_stats_histogram_record(TextureStatsHistogram* histogram,
+                                    int64_t value_us) {
+  uint64_t value = value_us > 0 ? value_us : 0;
+  texture_stats_add(&histogram->buckets[bucket_for_value(value)], 1);
+  texture_stats_add(&histogram->count, 1);
+  texture_stats_add(&histogram->sum_us, value);
+}
+
+double texture_stats_histogram_percentile(
+    const TextureStatsHistogram* histogram,
+    double percentile) {
+  uint64_t counts[TEXTURE_STATS_HISTOGRAM_BUCKETS];
+  uint64_t total = 0;
+  for (guint i = 0; i < TEXTURE_STATS_HISTOGRAM_BUCKETS; i++) {
+    counts[i] = histogram->buckets[i].load(std::memory_order_relaxed);
+    total += counts[i];
+  }
+  if (total == 0) {
+    return 0.0;
+  }
+
+  // Rank of the sample we are looking for, 1-based.
+  uint64_t rank = static_cast<uint64_t>(percentile / 100.0 * total + 0.5);
+  rank = CLAMP(rank, 1, total);
+
+  uint64_t seen = 0;
+  for (guint i = 0; i < TEXTURE_STATS_HISTOGRAM_BUCKETS; i++) {
+    seen += counts[i];
+    if (seen >= rank) {
+      return (bucket_lower_bound(i) + bucket_upper_bound(i)) / 2.0;
+    }
+  }
+  return bucket_upper_bound(TEXTURE_STATS_HISTOGRAM_BUCKETS - 1);
+}
+
+void texture_stats_histogram_snapshot(const TextureStatsHistogram* histogram,
+                                      TextureStatsHistogramSnapshot* snapshot) {
+  snapshot->count = histogram->count.load(std::memory_order_relaxed);
+  uint64_t sum = histogram->sum_us.load(std::memory_order_relaxed);
+  snapshot->mean_us =
+      snapshot->count > 0 ? static_cast<double>(sum) / snapshot->count : 0.0;
+  snapshot->p50_us = texture_stats_histogram_percentile(histogram, 50);
+  snapshot->p90_us = texture_stats_histogram_percentile(histogram, 90);
+  snapshot->p99_us = texture_stats_histogram_percentile(histogram, 99);
+
+  snapshot->max_us = 0.0;
+  for (guint i = TEXTURE_STATS_HISTOGRAM_BUCKETS; i > 0; i--) {
+    if (histogram->buckets[i - 1].load(std::memory_order_relaxed) > 0) {
+      snapshot->max_us = bucket_upper_bound(i - 1);
+      break;
+    }
+  }
+}
@@ -0,0 +1,80 @@
+#ifndef FL_TEXTURE_REPRO_TEXTURE_STATS_H_
+#define FL_TEXTURE_REPRO_TEXTURE_STATS_H_
+
+#include <glib.h>
+
+#include <atomic>
+#include <cstdint>
+
+// Per-texture counters. Every update is a single relaxed atomic add, so they
+// are cheap enough to stay enabled in production and can be bumped from the
+// streaming, raster and main threads without locks. Readers take a snapshot
+// that may be a few updates apart between fields.
+
+// Latency histogram with 4 sub-buckets per power of two, covering 0 us to
+// ~131 ms; larger values land in the last bucket.
+#define TEXTURE_STATS_HISTOGRAM_BUCKETS 64
+
+typedef struct {
+  std::atomic<uint64_t> buckets[TEXTURE_STATS_HISTOGRAM_BUCKETS];
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> sum_us;
+} TextureStatsHistogram;
+
+typedef struct {
+  // on_new_sample
+  std::atomic<uint64_t> frames_received;
+  // Frames replaced by a newer one before populate uploaded them
+  std::atomic<uint64_t> frames_dropped;
+  // populate
+  std::atomic<uint64_t> frames_uploaded;
+  std::atomic<uint64_t> populates_without_new_frame;
+  // CPU memcpy of pixel data (copy mode, PBO staging)
+  std::atomic<uint64_t> bytes_copied;
+  // PBO ring
+  std::atomic<uint64_t> pbo_uploads;
+  std::atomic<uint64_t> pbo_ring_full;
+  // Texture ring
+  std::atomic<uint64_t> texture_ring_full;
+  // Partial updates
+  std::atomic<uint64_t> tiles_uploaded;
+  std::atomic<uint64_t> tiles_skipped;
+  // Frame tap
+  std::atomic<uint64_t> tap_frames_delivered;
+  std::atomic<uint64_t> tap_frames_dropped;  // Due, but the last one was busy
+  // Streaming thread placement, counted per thread start
+  std::atomic<uint64_t> stream_threads_placed;
+  std::atomic<uint64_t> stream_threads_refused;  // Policy applied in part
+
+  TextureStatsHistogram upload_time;
+  TextureStatsHistogram capture_latency;  // Capture PTS -> populate
+} TextureStats;
+
+typedef struct {
+  uint64_t count;
+  double mean_us;
+  double p50_us;
+  double p90_us;
+  double p99_us;
+  double max_us;  // Upper bound of the highest non-empty bucket
+} TextureStatsHistogramSnapshot;
+
+void texture_stats_reset(TextureStats* stats);
+
+static inline void texture_stats_add(std::atomic<uint64_t>* counter,
+                                     uint64_t value) {
+  counter->fetch_add(value, std::memory_order_relaxed);
+}
+
+void texture_stats_histogram_record(TextureStatsHistogram* histogram,
+                                    int64_t value_us);
+
+void texture_stats_histogram_snapshot(const TextureStatsHistogram* histogram,
+                                      TextureStatsHistogramSnapshot* snapshot);
+
+// Value of |percentile| (0-100) estimated from the bucket boundaries.
+double texture_stats_histogram_percentile(
+    const TextureStatsHistogram* histogram,
+    double percentile);
+
+#endif  // FL_TEXTURE_REPRO_TEXTURE_STATS_H_
@@ -0,0 +1,286 @@
+#include "thread_policy.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdlib>
+
+// setpriority() with PRIO_PROCESS and a thread ID sets that thread's nice
+// on Linux; glibc only gained gettid() in 2.30.
+static id_t current_tid() {
+  return static_cast<id_t>(syscall(SYS_gettid));
+}
+
+void thread_policy_init(ThreadPolicy* policy) {
+  policy->has_cpus = FALSE;
+  CPU_ZERO(&policy->cpus);
+  policy->nice = 0;
+  policy->rt_priority = 0;
+}
+
+gboolean thread_policy_is_default(const ThreadPolicy* policy) {
+  return !policy->has_cpus && policy->nice == 0 && policy->rt_priority == 0;
+}
+
+// Reads a CPU number at |*p|, advancing past it.
+static gboolean parse_cpu(const gchar** p, gulong* cpu) {
+  if (!g_ascii_isdigit(**p)) {
+    return FALSE;
+  }
+  gchar* end = nullptr;
+  *cpu = strtoul(*p, &end, 10);
+  *p = end;
+  return *cpu < CPU_SETSIZE;
+}
+
+gboolean thread_policy_parse_cpus(const gchar* list, cpu_set_t* cpus) {
+  CPU_ZERO(cpus);
+  if (list == nullptr) {
+    return FALSE;
+  }
+
+  const gchar* p = list;
+  while (TRUE) {
+    while (*p == ' ') {
+      p++;
+    }
+    gulong first = 0;
+    if (!parse_cpu(&p, &first)) {
+      return FALSE;
+    }
+    gulong last = first;
+    if (*p == '-') {
+      p++;
+      if (!parse_cpu(&p, &last) || last < first) {
+        return FALSE;
+      }
+    }
+    for (gulong cpu = first; cpu <= last; cpu++) {
+      CPU_SET(cpu, cpus);
+    }
+    while (*p == ' ') {
+      p++;
+    }
+    if (*p == '\0') {
+      return TRUE;
+    }
+    if (*p != ',') {
+      return FALSE;
+    }
+    p++;
+  }
+}
+
+gchar* thread_policy_format_cpus(const cpu_set_t* cpus) {
+  GString* list = g_string_new(nullptr);
+  gint cpu = 0;
+  while (cpu < CPU_SETSIZE) {
+    if (!CPU_ISSET(cpu, cpus)) {
+      cpu++;
+      continue;
+    }
+    gint last = cpu;
+    while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, cpus)) {
+      last++;
+    }
+    if (list->len > 0) {
+      g_string_append_c(list, ',');
+    }
+    if (last == cpu) {
+      g_string_append_printf(list, "%d", cpu);
+    } else {
+      g_string_append_printf(list, "%d-%d", cpu, last);
+    }
+    cpu = last + 1;
+  }
+  return g_string_free(list, FALSE);
+}
+
+// Reads back what thread |tid| of this process has.
+static void thread_policy_read(id_t tid, ThreadPlacement* placement) {
+  CPU_ZERO(&placement->cpus);
+  sched_getaffinity(tid, sizeof(placement->cpus), &placement->cpus);
+  struct sched_param param = {};
+  placement->policy = sched_getscheduler(tid);
+  if (placement->policy < 0 || sched_getparam(tid, &param) != 0) {
+    placement->policy = SCHED_OTHER;
+  }
+  placement->priority = param.sched_priority;
+  // -1 is a valid nice, so errors only show in errno.
+  errno = 0;
+  gint nice = getpriority(PRIO_PROCESS, tid);
+  placement->nice = errno == 0 ? nice : 0;
+}
+
+// Gives thread |tid| of this process |placement| again. Best effort: going
+// back to a lower nice than the policy set needs CAP_SYS_NICE or
+// RLIMIT_NICE, like setting it did.
+static void thread_policy_write(id_t tid, const ThreadPlacement* placement) {
+  sched_setaffinity(tid, sizeof(placement->cpus), &placement->cpus);
+  struct sched_param param = {};
+  param.sched_priority = placement->priority;
+  sched_setscheduler(tid, placement->policy, &param);
+  setpriority(PRIO_PROCESS, tid, placement->nice);
+}
+
+gboolean thread_policy_apply(const ThreadPolicy* policy,
+                             ThreadPlacement* placement) {
+  gboolean applied = TRUE;
+  id_t tid = current_tid();
+
+  if (policy->has_cpus &&
+      sched_setaffinity(0, sizeof(policy->cpus), &policy->cpus) != 0) {
+    applied = FALSE;
+  }
+  if (policy->nice != 0 &&
+      setpriority(PRIO_PROCESS, tid, CLAMP(policy->nice, -20, 19)) != 0) {
+    applied = FALSE;
+  }
+  if (policy->rt_priority > 0) {
+    struct sched_param param = {};
+    param.sched_priority =
+        CLAMP(policy->rt_priority, sched_get_priority_min(SCHED_FIFO),
+              sched_get_priority_max(SCHED_FIFO));
+    if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0) {
+      applied = FALSE;
+    }
+  }
+
+  thread_policy_read(tid, placement);
+  return applied;
+}
+
+const gchar* thread_policy_name(gint policy) {
+  switch (policy) {
+    case SCHED_FIFO:
+      return "fifo";
+    case SCHED_RR:
+      return "rr";
+    case SCHED_BATCH:
+      return "batch";
+    case SCHED_IDLE:
+      return "idle";
+    default:
+      return "other";
+  }
+}
+
+typedef struct {
+  ThreadPlacementEntry entry;
+  gconstpointer owner;
+  ThreadPlacement previous;
+} ThreadPlacementRecord;
+
+struct _ThreadPlacements {
+  GMutex mutex;
+  GArray* records;  // ThreadPlacementRecord, in placing order
+};
+
+static void thread_placements_clear(gpointer data) {
+  ThreadPlacements* self = static_cast<ThreadPlacements*>(data);
+  g_array_unref(self->records);
+  g_mutex_clear(&self->mutex);
+}
+
+ThreadPlacements* thread_placements_new() {
+  ThreadPlacements* self = g_atomic_rc_box_new0(ThreadPlacements);
+  g_mutex_init(&self->mutex);
+  self->records = g_array_new(FALSE, FALSE, sizeof(ThreadPlacementRecord));
+  return self;
+}
+
+ThreadPlacements* thread_placements_ref(ThreadPlacements* self) {
+  return static_cast<ThreadPlacements*>(g_atomic_rc_box_acquire(self));
+}
+
+void thread_placements_unref(ThreadPlacements* self) {
+  g_atomic_rc_box_release_full(self, thread_placements_clear);
+}
+
+// Index of thread |tid|'s record, or -1. Called with the mutex held.
+static gint thread_placements_find(ThreadPlacements* self, id_t tid) {
+  for (guint i = 0; i < self->records->len; i++) {
+    if (g_array_index(self->records, ThreadPlacementRecord, i).entry.tid ==
+        static_cast<gint>(tid)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+gboolean thread_placements_has_thread(ThreadPlacements* self) {
+  g_mutex_lock(&self->mutex);
+  gboolean placed = thread_placements_find(self, current_tid()) >= 0;
+  g_mutex_unlock(&self->mutex);
+  return placed;
+}
+
+gboolean thread_placements_place(ThreadPlacements* self,
+                                 const ThreadPolicy* policy,
+                                 const gchar* role,
+                                 gconstpointer owner,
+                                 ThreadPlacement* placement) {
+  id_t tid = current_tid();
+  ThreadPlacementRecord record;
+  thread_policy_read(tid, &record.previous);
+  gboolean applied = thread_policy_apply(policy, placement);
+  record.entry.role = role;
+  record.entry.tid = tid;
+  record.entry.refused = !applied;
+  record.entry.placement = *placement;
+  record.owner = owner;
+
+  g_mutex_lock(&self->mutex);
+  gint index = thread_placements_find(self, tid);
+  if (index >= 0) {
+    ThreadPlacementRecord* placed =
+        &g_array_index(self->records, ThreadPlacementRecord, index);
+    placed->entry = record.entry;
+    placed->owner = owner;
+  } else {
+    g_array_append_val(self->records, record);
+  }
+  g_mutex_unlock(&self->mutex);
+  return applied;
+}
+
+void thread_placements_restore_thread(ThreadPlacements* self) {
+  id_t tid = current_tid();
+  g_mutex_lock(&self->mutex);
+  gint index = thread_placements_find(self, tid);
+  if (index >= 0) {
+    thread_policy_write(
+        tid, &g_array_index(self->records, ThreadPlacementRecord, index)
+                  .previous);
+    g_array_remove_index(self->records, index);
+  }
+  g_mutex_unlock(&self->mutex);
+}
+
+void thread_placements_restore_owner(ThreadPlacements* self,
+                                     gconstpointer owner) {
+  g_mutex_lock(&self->mutex);
+  for (guint i = self->records->len; i > 0; i--) {
+    ThreadPlacementRecord* record =
+        &g_array_index(self->records, ThreadPlacementRecord, i - 1);
+    if (record->owner == owner) {
+      thread_policy_write(record->entry.tid, &record->previous);
+      g_array_remove_index(self->records, i - 1);
+    }
+  }
+  g_mutex_unlock(&self->mutex);
+}
+
+GArray* thread_placements_list(ThreadPlacements* self) {
+  GArray* list = g_array_new(FALSE, FALSE, sizeof(ThreadPlacementEntry));
+  g_mutex_lock(&self->mutex);
+  for (guint i = 0; i < self->records->len; i++) {
+    g_array_append_val(
+        list, g_array_index(self->records, ThreadPlacementRecord, i).entry);
+  }
+  g_mutex_unlock(&self->mutex);
+  return list;
+}
@@ -0,0 +1,102 @@
+#ifndef FL_TEXTURE_REPRO_THREAD_POLICY_H_
+#define FL_TEXTURE_REPRO_THREAD_POLICY_H_
+
+#include <glib.h>
+#include <sched.h>
+
+G_BEGIN_DECLS
+
+// CPU set and scheduling for a thread, applied by the thread to itself.
+// GStreamer announces each streaming thread with a stream-status ENTER
+// message posted from that thread, so a bus sync handler can place it
+// before it handles its first buffer.
+typedef struct {
+  gboolean has_cpus;  // FALSE leaves the affinity alone
+  cpu_set_t cpus;
+  gint nice;         // -20..19, 0 leaves it alone
+  gint rt_priority;  // SCHED_FIFO priority 1..99, 0 keeps SCHED_OTHER
+} ThreadPolicy;
+
+// What a thread ended up with, read back from the kernel after applying a
+// policy, which may have been refused in part.
+typedef struct {
+  cpu_set_t cpus;
+  gint policy;  // SCHED_OTHER, SCHED_FIFO, ...
+  gint priority;
+  gint nice;
+} ThreadPlacement;
+
+void thread_policy_init(ThreadPolicy* policy);
+
+// TRUE if |policy| changes nothing.
+gboolean thread_policy_is_default(const ThreadPolicy* policy);
+
+// Parses a CPU list like "2-5,7" into |cpus|. Returns FALSE if |list| is
+// malformed, empty or names a CPU beyond CPU_SETSIZE.
+gboolean thread_policy_parse_cpus(const gchar* list, cpu_set_t* cpus);
+
+// Formats |cpus| as a CPU list like "2-5,7". Free with g_free().
+gchar* thread_policy_format_cpus(const cpu_set_t* cpus);
+
+// Applies |policy| to the calling thread and fills |placement| with what
+// it actually got. Returns FALSE if any part was refused, e.g. SCHED_FIFO
+// or a negative nice without CAP_SYS_NICE or RLIMIT_RTPRIO, or CPUs that
+// are offline or outside the process's cpuset; the other parts still
+// apply.
+gboolean thread_policy_apply(const ThreadPolicy* policy,
+                             ThreadPlacement* placement);
+
+// Short name of a SCHED_* policy: "other", "fifo", "rr", "batch" or
+// "idle".
+const gchar* thread_policy_name(gint policy);
+
+// The threads a policy was applied to, where each one landed and what it
+// had before, so it can be put back before the thread goes on to other
+// work: GStreamer and GLib pool their threads. Reference counted and
+// thread safe; shared by a texture and the worker pools it feeds.
+typedef struct _ThreadPlacements ThreadPlacements;
+
+// A placed thread, as listed by thread_placements_list().
+typedef struct {
+  const gchar* role;  // Static string naming the kind of thread
+  gint tid;
+  gboolean refused;  // Part of the policy was refused
+  ThreadPlacement placement;
+} ThreadPlacementEntry;
+
+ThreadPlacements* thread_placements_new();
+
+ThreadPlacements* thread_placements_ref(ThreadPlacements* placements);
+
+void thread_placements_unref(ThreadPlacements* placements);
+
+// TRUE if the calling thread is placed.
+gboolean thread_placements_has_thread(ThreadPlacements* placements);
+
+// Applies |policy| to the calling thread and records it under |role| and
+// |owner|, which thread_placements_restore_owner() goes by. A thread that
+// is already placed keeps what it had first as the state to go back to.
+// Returns and fills |placement| like thread_policy_apply().
+gboolean thread_placements_place(ThreadPlacements* placements,
+                                 const ThreadPolicy* policy,
+                                 const gchar* role,
+                                 gconstpointer owner,
+                                 ThreadPlacement* placement);
+
+// Puts the calling thread back as it was before it was placed and forgets
+// it. Does nothing if it is not placed.
+void thread_placements_restore_thread(ThreadPlacements* placements);
+
+// Like thread_placements_restore_thread() for every thread placed for
+// |owner|, from any thread. For pools, whose threads are idle by then,
+// before they are handed back to GLib.
+void thread_placements_restore_owner(ThreadPlacements* placements,
+                                     gconstpointer owner);
+
+// The placed threads in the order they were placed. Free with
+// g_array_unref().
+GArray* thread_placements_list(ThreadPlacements* placements);
+
+G_END_DECLS
+
+#endif  // FL_TEXTURE_REPRO_THREAD_POLICY_H_
@@ -0,0 +1,102 @@
+#include "tile_diff.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include <cstring>
+
+// Whether any of the |size| bytes of |a| and |b| differ by more than
+// |threshold|.
+static gboolean row_differs(const guint8* a,
+                            const guint8* b,
+                            gsize size,
+                            guint8 threshold) {
+  gsize i = 0;
+#if defined(__SSE2__)
+  const __m128i limit = _mm_set1_epi8(static_cast<char>(threshold));
+  __m128i max_diff = _mm_setzero_si128();
+  for (; i + 16 <= size; i += 16) {
+    __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+    __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+    __m128i diff = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+    max_diff = _mm_max_epu8(max_diff, diff);
+  }
+  // Bytes still above the threshold after subtracting it are non-zero.
+  __m128i over = _mm_subs_epu8(max_diff, limit);
+  if (_mm_movemask_epi8(_mm_cmpeq_epi8(over, _mm_setzero_si128())) != 0xFFFF) {
+    return TRUE;
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  uint8x16_t max_diff = vdupq_n_u8(0);
+  for (; i + 16 <= size; i += 16) {
+    max_diff = vmaxq_u8(max_diff, vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i)));
+  }
+  if (vmaxvq_u8(max_diff) > threshold) {
+    return TRUE;
+  }
+#endif
+  for (; i < size; i++) {
+    guint8 diff = a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+    if (diff > threshold) {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+guint tile_diff_update(const guint8* frame,
+                       guint8* reference,
+                       guint width,
+                       guint height,
+                       guint8 threshold,
+                       guint8* dirty) {
+  guint columns = tile_diff_columns(width);
+  guint rows = tile_diff_rows(height);
+  gsize stride = width * 4;
+  guint n_dirty = 0;
+
+  for (guint ty = 0; ty < rows; ty++) {
+    guint y0 = ty * TILE_DIFF_SIZE;
+    guint y1 = MIN(y0 + TILE_DIFF_SIZE, height);
+    guint8* row_dirty = dirty + ty * columns;
+    memset(row_dirty, 0, columns);
+
+    // Walk the band row by row so both frames are read sequentially; tiles
+    // already known to be dirty are skipped.
+    guint clean = columns;
+    for (guint y = y0; y < y1 && clean > 0; y++) {
+      const guint8* frame_row = frame + y * stride;
+      const guint8* reference_row = reference + y * stride;
+      for (guint tx = 0; tx < columns; tx++) {
+        if (row_dirty[tx]) {
+          continue;
+        }
+        gsize offset = tx * TILE_DIFF_SIZE * 4;
+        gsize size = MIN(TILE_DIFF_SIZE * 4, stride - offset);
+        if (row_differs(frame_row + offset, reference_row + offset, size,
+                        threshold)) {
+          row_dirty[tx] = 1;
+          clean--;
+        }
+      }
+    }
+
+    for (guint tx = 0; tx < columns; tx++) {
+      if (!row_dirty[tx]) {
+        continue;
+      }
+      n_dirty++;
+      gsize offset = tx * TILE_DIFF_SIZE * 4;
+      gsize size = MIN(TILE_DIFF_SIZE * 4, stride - offset);
+      for (guint y = y0; y < y1; y++) {
+        memcpy(reference + y * stride + offset, frame + y * stride + offset,
+               size);
+      }
+    }
+  }
+  return n_dirty;
+}
@@ -0,0 +1,37 @@
+#ifndef FL_TEXTURE_REPRO_TILE_DIFF_H_
+#define FL_TEXTURE_REPRO_TILE_DIFF_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+// Edge length of the square tiles RGBA frames are compared in, in pixels.
+// Tiles on the right and bottom edges may be smaller.
+#define TILE_DIFF_SIZE 64
+
+// Number of tiles covering a |width| x |height| frame, row-major.
+static inline guint tile_diff_columns(guint width) {
+  return (width + TILE_DIFF_SIZE - 1) / TILE_DIFF_SIZE;
+}
+
+static inline guint tile_diff_rows(guint height) {
+  return (height + TILE_DIFF_SIZE - 1) / TILE_DIFF_SIZE;
+}
+
+// Compares |frame| against |reference|, both tightly packed RGBA of the same
+// size. A tile is dirty when any byte differs by more than |threshold|;
+// dirty[i] is set to 1 for those and 0 for the rest, and dirty tiles are
+// copied into |reference| so it keeps tracking what was last reported.
+// Comparing against that reference rather than the previous frame means
+// changes below the threshold cannot accumulate unnoticed. Returns the
+// number of dirty tiles.
+guint tile_diff_update(const guint8* frame,
+                       guint8* reference,
+                       guint width,
+                       guint height,
+                       guint8 threshold,
+                       guint8* dirty);
+
+G_END_DECLS
+
+#endif  // FL_TEXTURE_REPRO_TILE_DIFF_H_
@@ -0,0 +1,538 @@
+#include "yuv_cpu_converter.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include <cmath>
+
+// Upper bound for bands processed in parallel (worker threads + caller).
+// Output sizes are preview sized, so more threads mostly add wake-up cost.
+#define YUV_CPU_CONVERTER_MAX_BANDS 5
+
+#define YUV_CPU_CONVERTER_COMPONENTS 3
+
+// Fixed-point YUV -> RGB coefficients, 6 fractional bits. Intermediate sums
+// are computed with saturating 16-bit adds, which only clip results that are
+// out of the 0-255 range anyway.
+typedef struct {
+  gint16 y_offset;
+  gint16 y_scale;
+  gint16 r_v;
+  gint16 g_u;
+  gint16 g_v;
+  gint16 b_u;
+} YuvCoefficients;
+
+// One Y, U or V component of the source frame, addressed generically so
+// planar, semi-planar and packed layouts share the sampling code.
+typedef struct {
+  const guint8* data;
+  gint stride;
+  gint pixel_stride;
+  gint width;
+  gint height;
+} YuvComponent;
+
+// Horizontal bilinear taps for one component at the destination width.
+typedef struct {
+  gint32* offsets0;  // Byte offsets of the left tap within a row
+  gint32* offsets1;  // Byte offsets of the right tap
+  guint16* weights;  // Weight of the right tap, 0-256
+} YuvScaleTable;
+
+typedef void (*YuvRowConvertFunc)(const guint8* y,
+                                  const guint8* u,
+                                  const guint8* v,
+                                  guint8* dst,
+                                  gint width,
+                                  const YuvCoefficients* coefficients);
+
+struct _YuvCpuConverter {
+  GThreadPool* pool;
+  guint n_bands;
+  ThreadPolicy thread_policy;
+  ThreadPlacements* placements;  // nullptr: workers are not placed
+  YuvRowConvertFunc convert_row;
+
+  // Geometry the scale tables and row buffers were built for
+  gint src_widths[YUV_CPU_CONVERTER_COMPONENTS];
+  gint dst_width;
+  YuvScaleTable tables[YUV_CPU_CONVERTER_COMPONENTS];
+  guint8* row_buffers[YUV_CPU_CONVERTER_MAX_BANDS];
+
+  // Current job, read by the workers
+  YuvComponent components[YUV_CPU_CONVERTER_COMPONENTS];
+  YuvCoefficients coefficients;
+  guint8* dst;
+  gint dst_stride;
+  gint dst_height;
+
+  GMutex mutex;
+  GCond cond;
+  guint bands_remaining;
+};
+
+static void convert_row_scalar(const guint8* y,
+                               const guint8* u,
+                               const guint8* v,
+                               guint8* dst,
+                               gint width,
+                               const YuvCoefficients* c) {
+  for (gint x = 0; x < width; x++) {
+    gint luma = (y[x] - c->y_offset) * c->y_scale + 32;
+    gint cb = u[x] - 128;
+    gint cr = v[x] - 128;
+    dst[x * 4 + 0] = CLAMP((luma + c->r_v * cr) >> 6, 0, 255);
+    dst[x * 4 + 1] = CLAMP((luma - c->g_u * cb - c->g_v * cr) >> 6, 0, 255);
+    dst[x * 4 + 2] = CLAMP((luma + c->b_u * cb) >> 6, 0, 255);
+    dst[x * 4 + 3] = 255;
+  }
+}
+
+#if defined(__SSE2__)
+// Converts 8 pixels held as 16-bit lanes and returns R, G, B still as 16-bit.
+static inline void yuv_to_rgb_sse2(__m128i y,
+                                   __m128i u,
+                                   __m128i v,
+                                   const YuvCoefficients* c,
+                                   __m128i* r,
+                                   __m128i* g,
+                                   __m128i* b) {
+  __m128i luma = _mm_mullo_epi16(_mm_sub_epi16(y, _mm_set1_epi16(c->y_offset)),
+                                 _mm_set1_epi16(c->y_scale));
+  luma = _mm_adds_epi16(luma, _mm_set1_epi16(32));
+  __m128i cb = _mm_sub_epi16(u, _mm_set1_epi16(128));
+  __m128i cr = _mm_sub_epi16(v, _mm_set1_epi16(128));
+  *r = _mm_srai_epi16(
+      _mm_adds_epi16(luma, _mm_mullo_epi16(cr, _mm_set1_epi16(c->r_v))), 6);
+  *g = _mm_srai_epi16(
+      _mm_subs_epi16(
+          _mm_subs_epi16(luma, _mm_mullo_epi16(cb, _mm_set1_epi16(c->g_u))),
+          _mm_mullo_epi16(cr, _mm_set1_epi16(c->g_v))),
+      6);
+  *b = _mm_srai_epi16(
+      _mm_adds_epi16(luma, _mm_mullo_epi16(cb, _mm_set1_epi16(c->b_u))), 6);
+}
+
+static void convert_row_sse2(const guint8* y,
+                             const guint8* u,
+                             const guint8* v,
+                             guint8* dst,
+                             gint width,
+                             const YuvCoefficients* c) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i alpha = _mm_set1_epi8(-1);
+  gint x = 0;
+  for (; x + 16 <= width; x += 16) {
+    __m128i y8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y + x));
+    __m128i u8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(u + x));
+    __m128i v8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + x));
+
+    __m128i r_lo, g_lo, b_lo, r_hi, g_hi, b_hi;
+    yuv_to_rgb_sse2(_mm_unpacklo_epi8(y8, zero), _mm_unpacklo_epi8(u8, zero),
+                    _mm_unpacklo_epi8(v8, zero), c, &r_lo, &g_lo, &b_lo);
+    yuv_to_rgb_sse2(_mm_unpackhi_epi8(y8, zero), _mm_unpackhi_epi8(u8, zero),
+                    _mm_unpackhi_epi8(v8, zero), c, &r_hi, &g_hi, &b_hi);
+    __m128i r = _mm_packus_epi16(r_lo, r_hi);
+    __m128i g = _mm_packus_epi16(g_lo, g_hi);
+    __m128i b = _mm_packus_epi16(b_lo, b_hi);
+
+    __m128i rg_lo = _mm_unpacklo_epi8(r, g);
+    __m128i rg_hi = _mm_unpackhi_epi8(r, g);
+    __m128i ba_lo = _mm_unpacklo_epi8(b, alpha);
+    __m128i ba_hi = _mm_unpackhi_epi8(b, alpha);
+    __m128i* out = reinterpret_cast<__m128i*>(dst + x * 4);
+    _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(rg_lo, ba_lo));
+    _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rg_lo, ba_lo));
+    _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(rg_hi, ba_hi));
+    _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(rg_hi, ba_hi));
+  }
+  convert_row_scalar(y + x, u + x, v + x, dst + x * 4, width - x, c);
+}
+#endif  // __SSE2__
+
+#if defined(__x86_64__)
+__attribute__((target("avx2"))) static inline void yuv_to_rgb_avx2(
+    __m256i y,
+    __m256i u,
+    __m256i v,
+    const YuvCoefficients* c,
+    __m256i* r,
+    __m256i* g,
+    __m256i* b) {
+  __m256i luma = _mm256_mullo_epi16(
+      _mm256_sub_epi16(y, _mm256_set1_epi16(c->y_offset)),
+      _mm256_set1_epi16(c->y_scale));
+  luma = _mm256_adds_epi16(luma, _mm256_set1_epi16(32));
+  __m256i cb = _mm256_sub_epi16(u, _mm256_set1_epi16(128));
+  __m256i cr = _mm256_sub_epi16(v, _mm256_set1_epi16(128));
+  *r = _mm256_srai_epi16(
+      _mm256_adds_epi16(luma,
+                        _mm256_mullo_epi16(cr, _mm256_set1_epi16(c->r_v))),
+      6);
+  *g = _mm256_srai_epi16(
+      _mm256_subs_epi16(
+          _mm256_subs_epi16(luma,
+                            _mm256_mullo_epi16(cb, _mm256_set1_epi16(c->g_u))),
+          _mm256_mullo_epi16(cr, _mm256_set1_epi16(c->g_v))),
+      6);
+  *b = _mm256_srai_epi16(
+      _mm256_adds_epi16(luma,
+                        _mm256_mullo_epi16(cb, _mm256_set1_epi16(c->b_u))),
+      6);
+}
+
+__attribute__((target("avx2"))) static inline __m256i load_avx2(
+    const guint8* p) {
+  return _mm256_cvtepu8_epi16(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+}
+
+// Packs two vectors of 16 16-bit values into 32 bytes in source order;
+// _mm256_packus_epi16 interleaves the 128-bit lanes.
+__attribute__((target("avx2"))) static inline __m256i pack_avx2(__m256i lo,
+                                                                __m256i hi) {
+  return _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8);
+}
+
+__attribute__((target("avx2"))) static void convert_row_avx2(
+    const guint8* y,
+    const guint8* u,
+    const guint8* v,
+    guint8* dst,
+    gint width,
+    const YuvCoefficients* c) {
+  const __m256i alpha = _mm256_set1_epi8(-1);
+  gint x = 0;
+  for (; x + 32 <= width; x += 32) {
+    __m256i r_lo, g_lo, b_lo, r_hi, g_hi, b_hi;
+    yuv_to_rgb_avx2(load_avx2(y + x), load_avx2(u + x), load_avx2(v + x), c,
+                    &r_lo, &g_lo, &b_lo);
+    yuv_to_rgb_avx2(load_avx2(y + x + 16), load_avx2(u + x + 16),
+                    load_avx2(v + x + 16), c, &r_hi, &g_hi, &b_hi);
+    __m256i r = pack_avx2(r_lo, r_hi);
+    __m256i g = pack_avx2(g_lo, g_hi);
+    __m256i b = pack_avx2(b_lo, b_hi);
+
+    // Unpacks work within 128-bit lanes, so each result holds pixels
+    // n..n+3 in its low lane and n+16..n+19 in its high lane.
+    __m256i rg_lo = _mm256_unpacklo_epi8(r, g);
+    __m256i rg_hi = _mm256_unpackhi_epi8(r, g);
+    __m256i ba_lo = _mm256_unpacklo_epi8(b, alpha);
+    __m256i ba_hi = _mm256_unpackhi_epi8(b, alpha);
+    __m256i p0 = _mm256_unpacklo_epi16(rg_lo, ba_lo);  // 0-3, 16-19
+    __m256i p1 = _mm256_unpackhi_epi16(rg_lo, ba_lo);  // 4-7, 20-23
+    __m256i p2 = _mm256_unpacklo_epi16(rg_hi, ba_hi);  // 8-11, 24-27
+    __m256i p3 = _mm256_unpackhi_epi16(rg_hi, ba_hi);  // 12-15, 28-31
+
+    __m256i* out = reinterpret_cast<__m256i*>(dst + x * 4);
+    _mm256_storeu_si256(out + 0, _mm256_permute2x128_si256(p0, p1, 0x20));
+    _mm256_storeu_si256(out + 1, _mm256_permute2x128_si256(p2, p3, 0x20));
+    _mm256_storeu_si256(out + 2, _mm256_permute2x128_si256(p0, p1, 0x31));
+    _mm256_storeu_si256(out + 3, _mm256_permute2x128_si256(p2, p3, 0x31));
+  }
+  convert_row_sse2(y + x, u + x, v + x, dst + x * 4, width - x, c);
+}
+#endif  // __x86_64__
+
+#if defined(__ARM_NEON)
+static void convert_row_neon(const guint8* y,
+                             const guint8* u,
+                             const guint8* v,
+                             guint8* dst,
+                             gint width,
+                             const YuvCoefficients* c) {
+  const int16x8_t y_offset = vdupq_n_s16(c->y_offset);
+  const int16x8_t chroma_offset = vdupq_n_s16(128);
+  const int16x8_t rounding = vdupq_n_s16(32);
+  gint x = 0;
+  for (; x + 8 <= width; x += 8) {
+    int16x8_t luma = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(y + x)));
+    int16x8_t cb = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(u + x)));
+    int16x8_t cr = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(v + x)));
+    luma = vqaddq_s16(vmulq_n_s16(vsubq_s16(luma, y_offset), c->y_scale),
+                      rounding);
+    cb = vsubq_s16(cb, chroma_offset);
+    cr = vsubq_s16(cr, chroma_offset);
+
+    uint8x8x4_t pixels;
+    pixels.val[0] = vqshrun_n_s16(vqaddq_s16(luma, vmulq_n_s16(cr, c->r_v)), 6);
+    pixels.val[1] = vqshrun_n_s16(
+        vqsubq_s16(vqsubq_s16(luma, vmulq_n_s16(cb, c->g_u)),
+                   vmulq_n_s16(cr, c->g_v)),
+        6);
+    pixels.val[2] = vqshrun_n_s16(vqaddq_s16(luma, vmulq_n_s16(cb, c->b_u)), 6);
+    pixels.val[3] = vdup_n_u8(255);
+    vst4_u8(dst + x * 4, pixels);
+  }
+  convert_row_scalar(y + x, u + x, v + x, dst + x * 4, width - x, c);
+}
+#endif  // __ARM_NEON
+
+static YuvRowConvertFunc select_convert_row() {
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2")) {
+    return convert_row_avx2;
+  }
+#endif
+#if defined(__SSE2__)
+  return convert_row_sse2;
+#elif defined(__ARM_NEON)
+  return convert_row_neon;
+#else
+  return convert_row_scalar;
+#endif
+}
+
+// Coefficients for the frame's matrix and range, as in yuv_gl_converter.
+static void compute_coefficients(const GstVideoInfo* info,
+                                 YuvCoefficients* c) {
+  gdouble kr = 0.299, kb = 0.114;
+  gst_video_color_matrix_get_Kr_Kb(GST_VIDEO_INFO_COLORIMETRY(info).matrix,
+                                   &kr, &kb);
+  gdouble kg = 1.0 - kr - kb;
+  gboolean full_range =
+      GST_VIDEO_INFO_COLORIMETRY(info).range == GST_VIDEO_COLOR_RANGE_0_255;
+  gdouble luma_scale = full_range ? 1.0 : 255.0 / 219.0;
+  gdouble chroma_scale = full_range ? 1.0 : 255.0 / 224.0;
+
+  c->y_offset = full_range ? 0 : 16;
+  c->y_scale = lround(64.0 * luma_scale);
+  c->r_v = lround(64.0 * chroma_scale * 2.0 * (1.0 - kr));
+  c->g_u = lround(64.0 * chroma_scale * 2.0 * kb * (1.0 - kb) / kg);
+  c->g_v = lround(64.0 * chroma_scale * 2.0 * kr * (1.0 - kr) / kg);
+  c->b_u = lround(64.0 * chroma_scale * 2.0 * (1.0 - kb));
+}
+
+static void scale_table_clear(YuvScaleTable* table) {
+  g_clear_pointer(&table->offsets0, g_free);
+  g_clear_pointer(&table->offsets1, g_free);
+  g_clear_pointer(&table->weights, g_free);
+}
+
+// Builds the horizontal taps mapping |dst_width| pixel centres onto a
+// component |src_width| samples wide.
+static void scale_table_build(YuvScaleTable* table,
+                              gint src_width,
+                              gint pixel_stride,
+                              gint dst_width) {
+  scale_table_clear(table);
+  table->offsets0 = g_new(gint32, dst_width);
+  table->offsets1 = g_new(gint32, dst_width);
+  table->weights = g_new(guint16, dst_width);
+
+  gint64 step = (static_cast<gint64>(src_width) << 16) / dst_width;
+  gint64 position = step / 2 - (1 << 15);
+  for (gint x = 0; x < dst_width; x++, position += step) {
+    gint64 clamped = MAX(position, 0);
+    gint x0 = MIN(clamped >> 16, src_width - 1);
+    gint x1 = MIN(x0 + 1, src_width - 1);
+    table->offsets0[x] = x0 * pixel_stride;
+    table->offsets1[x] = x1 * pixel_stride;
+    table->weights[x] = (clamped & 0xFFFF) >> 8;
+  }
+}
+
+// Samples row |dst_y| of |component| into |out|.
+static void scale_row(const YuvComponent* component,
+                      const YuvScaleTable* table,
+                      gint dst_y,
+                      gint dst_height,
+                      gint dst_width,
+                      guint8* out) {
+  gint64 step = (static_cast<gint64>(component->height) << 16) / dst_height;
+  gint64 position = MAX(step / 2 - (1 << 15) + step * dst_y, 0);
+  gint y0 = MIN(position >> 16, component->height - 1);
+  gint y1 = MIN(y0 + 1, component->height - 1);
+  guint wy = (position & 0xFFFF) >> 8;
+
+  const guint8* row0 = component->data + y0 * component->stride;
+  const guint8* row1 = component->data + y1 * component->stride;
+  const gint32* offsets0 = table->offsets0;
+  const gint32* offsets1 = table->offsets1;
+  const guint16* weights = table->weights;
+
+  if (wy == 0) {
+    for (gint x = 0; x < dst_width; x++) {
+      guint wx = weights[x];
+      out[x] = (row0[offsets0[x]] * (256 - wx) + row0[offsets1[x]] * wx + 128) >>
+               8;
+    }
+    return;
+  }
+
+  for (gint x = 0; x < dst_width; x++) {
+    guint wx = weights[x];
+    guint top = row0[offsets0[x]] * (256 - wx) + row0[offsets1[x]] * wx;
+    guint bottom = row1[offsets0[x]] * (256 - wx) + row1[offsets1[x]] * wx;
+    out[x] = (top * (256 - wy) + bottom * wy + (1 << 15)) >> 16;
+  }
+}
+
+static void convert_band(YuvCpuConverter* self, guint band) {
+  gint rows_per_band = (self->dst_height + self->n_bands - 1) / self->n_bands;
+  gint first = band * rows_per_band;
+  gint last = MIN(first + rows_per_band, self->dst_height);
+
+  guint8* y_row = self->row_buffers[band];
+  guint8* u_row = y_row + self->dst_width;
+  guint8* v_row = u_row + self->dst_width;
+  guint8* rows[YUV_CPU_CONVERTER_COMPONENTS] = {y_row, u_row, v_row};
+
+  for (gint y = first; y < last; y++) {
+    for (guint c = 0; c < YUV_CPU_CONVERTER_COMPONENTS; c++) {
+      scale_row(&self->components[c], &self->tables[c], y, self->dst_height,
+                self->dst_width, rows[c]);
+    }
+    self->convert_row(y_row, u_row, v_row, self->dst + y * self->dst_stride,
+                      self->dst_width, &self->coefficients);
+  }
+}
+
+static void worker_func(gpointer data, gpointer user_data) {
+  YuvCpuConverter* self = static_cast<YuvCpuConverter*>(user_data);
+  // The pool is exclusive, so its threads stay ours until it is freed.
+  if (self->placements != nullptr &&
+      !thread_placements_has_thread(self->placements)) {
+    ThreadPlacement placement;
+    thread_placements_place(self->placements, &self->thread_policy, "convert",
+                            self, &placement);
+  }
+  convert_band(self, GPOINTER_TO_UINT(data));
+
+  g_mutex_lock(&self->mutex);
+  if (--self->bands_remaining == 0) {
+    g_cond_signal(&self->cond);
+  }
+  g_mutex_unlock(&self->mutex);
+}
+
+// (Re)builds the scale tables and row buffers when the geometry changes.
+static void ensure_geometry(YuvCpuConverter* self, gint dst_width) {
+  gboolean changed = self->dst_width != dst_width;
+  for (guint c = 0; c < YUV_CPU_CONVERTER_COMPONENTS; c++) {
+    const YuvComponent* component = &self->components[c];
+    if (changed || self->src_widths[c] != component->width) {
+      scale_table_build(&self->tables[c], component->width,
+                        component->pixel_stride, dst_width);
+      self->src_widths[c] = component->width;
+    }
+  }
+
+  if (changed) {
+    for (guint b = 0; b < self->n_bands; b++) {
+      g_free(self->row_buffers[b]);
+      // Y, U and V rows; the SIMD loops never read past |dst_width|.
+      self->row_buffers[b] =
+          static_cast<guint8*>(g_malloc(dst_width * YUV_CPU_CONVERTER_COMPONENTS));
+    }
+    self->dst_width = dst_width;
+  }
+}
+
+YuvCpuConverter* yuv_cpu_converter_new() {
+  YuvCpuConverter* self = g_new0(YuvCpuConverter, 1);
+  self->convert_row = select_convert_row();
+  self->n_bands =
+      CLAMP(g_get_num_processors(), 1, YUV_CPU_CONVERTER_MAX_BANDS);
+  if (self->n_bands > 1) {
+    GError* error = nullptr;
+    self->pool = g_thread_pool_new(worker_func, self, self->n_bands - 1, TRUE,
+                                   &error);
+    if (self->pool == nullptr) {
+      g_warning("YUV converter: no worker threads: %s", error->message);
+      g_error_free(error);
+      self->n_bands = 1;
+    }
+  }
+  g_mutex_init(&self->mutex);
+  g_cond_init(&self->cond);
+  return self;
+}
+
+void yuv_cpu_converter_set_thread_policy(YuvCpuConverter* self,
+                                         const ThreadPolicy* policy,
+                                         ThreadPlacements* placements) {
+  g_clear_pointer(&self->placements, thread_placements_unref);
+  if (self->pool != nullptr && !thread_policy_is_default(policy)) {
+    self->thread_policy = *policy;
+    self->placements = thread_placements_ref(placements);
+  }
+}
+
+void yuv_cpu_converter_free(YuvCpuConverter* self) {
+  // GLib hands the threads of a freed pool on to other work, so they are
+  // put back while they still idle in ours.
+  if (self->placements != nullptr) {
+    thread_placements_restore_owner(self->placements, self);
+    thread_placements_unref(self->placements);
+  }
+  if (self->pool != nullptr) {
+    g_thread_pool_free(self->pool, FALSE, TRUE);
+  }
+  for (guint c = 0; c < YUV_CPU_CONVERTER_COMPONENTS; c++) {
+    scale_table_clear(&self->tables[c]);
+  }
+  for (guint b = 0; b < YUV_CPU_CONVERTER_MAX_BANDS; b++) {
+    g_free(self->row_buffers[b]);
+  }
+  g_mutex_clear(&self->mutex);
+  g_cond_clear(&self->cond);
+  g_free(self);
+}
+
+gboolean yuv_cpu_converter_supports_format(GstVideoFormat format) {
+  const GstVideoFormatInfo* info = gst_video_format_get_info(format);
+  return info != nullptr && GST_VIDEO_FORMAT_INFO_IS_YUV(info) &&
+         GST_VIDEO_FORMAT_INFO_N_COMPONENTS(info) == 3 &&
+         GST_VIDEO_FORMAT_INFO_BITS(info) == 8 &&
+         GST_VIDEO_FORMAT_INFO_DEPTH(info, 0) == 8 &&
+         !GST_VIDEO_FORMAT_INFO_IS_TILED(info) &&
+         GST_VIDEO_FORMAT_INFO_H_SUB(info, 1) <= 1 &&
+         GST_VIDEO_FORMAT_INFO_W_SUB(info, 1) <= 1;
+}
+
+gboolean yuv_cpu_converter_convert(YuvCpuConverter* self,
+                                   const GstVideoFrame* frame,
+                                   guint8* dst,
+                                   gint dst_stride,
+                                   gint dst_width,
+                                   gint dst_height) {
+  if (!yuv_cpu_converter_supports_format(GST_VIDEO_FRAME_FORMAT(frame)) ||
+      dst_width <= 0 || dst_height <= 0) {
+    return FALSE;
+  }
+
+  for (guint c = 0; c < YUV_CPU_CONVERTER_COMPONENTS; c++) {
+    YuvComponent* component = &self->components[c];
+    component->data =
+        static_cast<const guint8*>(GST_VIDEO_FRAME_COMP_DATA(frame, c));
+    component->stride = GST_VIDEO_FRAME_COMP_STRIDE(frame, c);
+    component->pixel_stride = GST_VIDEO_FRAME_COMP_PSTRIDE(frame, c);
+    component->width = GST_VIDEO_FRAME_COMP_WIDTH(frame, c);
+    component->height = GST_VIDEO_FRAME_COMP_HEIGHT(frame, c);
+  }
+  compute_coefficients(&frame->info, &self->coefficients);
+  ensure_geometry(self, dst_width);
+  self->dst = dst;
+  self->dst_stride = dst_stride;
+  self->dst_height = dst_height;
+
+  // Hand all but the first band to the pool and convert that one here.
+  self->bands_remaining = self->n_bands - 1;
+  for (guint b = 1; b < self->n_bands; b++) {
+    g_thread_pool_push(self->pool, GUINT_TO_POINTER(b), nullptr);
+  }
+  convert_band(self, 0);
+
+  g_mutex_lock(&self->mutex);
+  while (self->bands_remaining > 0) {
+    g_cond_wait(&self->cond, &self->mutex);
+  }
+  g_mutex_unlock(&self->mutex);
+  return TRUE;
+}
@@ -0,0 +1,51 @@
+#ifndef FL_TEXTURE_REPRO_YUV_CPU_CONVERTER_H_
+#define FL_TEXTURE_REPRO_YUV_CPU_CONVERTER_H_
+
+#include <glib.h>
+#include <gst/video/video.h>
+
+#include "thread_policy.h"
+
+G_BEGIN_DECLS
+
+// Scales an 8-bit YUV frame and converts it to RGBA in a single pass over
+// the source, replacing videoscale ! videoconvert. Each output row is
+// bilinearly sampled per component into a small row buffer and converted
+// with SSE2/AVX2/NEON; rows are split into bands across a worker pool.
+//
+// A converter serves one caller at a time (the streaming thread).
+typedef struct _YuvCpuConverter YuvCpuConverter;
+
+YuvCpuConverter* yuv_cpu_converter_new();
+
+void yuv_cpu_converter_free(YuvCpuConverter* converter);
+
+// Has each worker thread apply |policy| to itself before its first band
+// and list itself in |placements| as "convert". The workers are put back
+// as they were when the converter is freed. Call before the first
+// conversion.
+void yuv_cpu_converter_set_thread_policy(YuvCpuConverter* converter,
+                                         const ThreadPolicy* policy,
+                                         ThreadPlacements* placements);
+
+// Whether |format| can be converted: planar, semi-planar or packed 4:2:0,
+// 4:2:2 and 4:4:4 YUV with 8 bits per component.
+gboolean yuv_cpu_converter_supports_format(GstVideoFormat format);
+
+// Caps string listing the supported formats, for the appsink caps filter.
+#define YUV_CPU_CONVERTER_CAPS \
+  "video/x-raw,format=(string){I420,YV12,NV12,NV21,Y42B,YUY2,UYVY,Y444}"
+
+// Converts |frame| into |dst|, |dst_width| x |dst_height| RGBA pixels
+// |dst_stride| bytes apart, using the frame's colorimetry (BT.601 when
+// unknown). Returns FALSE if the frame format is not supported.
+gboolean yuv_cpu_converter_convert(YuvCpuConverter* converter,
+                                   const GstVideoFrame* frame,
+                                   guint8* dst,
+                                   gint dst_stride,
+                                   gint dst_width,
+                                   gint dst_height);
+
+G_END_DECLS
+
+#endif  // FL_TEXTURE_REPRO_YUV_CPU_CONVERTER_H_
@@ -0,0 +1,268 @@
+#include "yuv_gl_converter.h"
+
+#define YUV_GL_CONVERTER_MAX_PLANES 3
+
+struct _YuvGlConverter {
+  gboolean initialized;
+  gboolean failed;  // Shader setup failed, never try again
+
+  GLuint program;
+  GLint planes_location[YUV_GL_CONVERTER_MAX_PLANES];
+  GLint interleaved_chroma_location;
+  GLint matrix_location;
+  GLint offset_location;
+  GLuint vertex_array;
+  GLuint framebuffer;
+
+  GLuint plane_textures[YUV_GL_CONVERTER_MAX_PLANES];
+  uint32_t plane_widths[YUV_GL_CONVERTER_MAX_PLANES];
+  uint32_t plane_heights[YUV_GL_CONVERTER_MAX_PLANES];
+};
+
+// Full-screen triangle generated from gl_VertexID, so no vertex buffer is
+// needed.
+static const char* kVertexShader =
+    "out vec2 v_uv;\n"
+    "void main() {\n"
+    "  vec2 pos = vec2(float((gl_VertexID & 1) << 1), float(gl_VertexID & 2));\n"
+    "  v_uv = pos;\n"
+    "  gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);\n"
+    "}\n";
+
+static const char* kFragmentShader =
+    "precision highp float;\n"
+    "in vec2 v_uv;\n"
+    "out vec4 frag_color;\n"
+    "uniform sampler2D y_plane;\n"
+    "uniform sampler2D u_plane;\n"
+    "uniform sampler2D v_plane;\n"
+    "uniform bool interleaved_chroma;\n"
+    "uniform mat3 yuv_to_rgb;\n"
+    "uniform vec3 yuv_offset;\n"
+    "void main() {\n"
+    "  vec3 yuv;\n"
+    "  yuv.x = texture(y_plane, v_uv).r;\n"
+    "  if (interleaved_chroma) {\n"
+    "    yuv.yz = texture(u_plane, v_uv).rg;\n"
+    "  } else {\n"
+    "    yuv.y = texture(u_plane, v_uv).r;\n"
+    "    yuv.z = texture(v_plane, v_uv).r;\n"
+    "  }\n"
+    "  frag_color = vec4(clamp(yuv_to_rgb * (yuv - yuv_offset), 0.0, 1.0), 1.0);\n"
+    "}\n";
+
+static GLuint compile_shader(GLenum type, const char* source) {
+  const char* version =
+      epoxy_is_desktop_gl() ? "#version 150\n" : "#version 300 es\n";
+  const char* sources[] = {version, source};
+
+  GLuint shader = glCreateShader(type);
+  glShaderSource(shader, 2, sources, nullptr);
+  glCompileShader(shader);
+
+  GLint compiled = GL_FALSE;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+  if (!compiled) {
+    char log[512];
+    glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+    g_warning("Failed to compile YUV conversion shader: %s", log);
+    glDeleteShader(shader);
+    return 0;
+  }
+  return shader;
+}
+
+static gboolean yuv_gl_converter_init_gl(YuvGlConverter* self) {
+  GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER, kVertexShader);
+  GLuint fragment_shader = compile_shader(GL_FRAGMENT_SHADER, kFragmentShader);
+  if (vertex_shader == 0 || fragment_shader == 0) {
+    if (vertex_shader != 0) {
+      glDeleteShader(vertex_shader);
+    }
+    if (fragment_shader != 0) {
+      glDeleteShader(fragment_shader);
+    }
+    return FALSE;
+  }
+
+  self->program = glCreateProgram();
+  glAttachShader(self->program, vertex_shader);
+  glAttachShader(self->program, fragment_shader);
+  glLinkProgram(self->program);
+  glDeleteShader(vertex_shader);
+  glDeleteShader(fragment_shader);
+
+  GLint linked = GL_FALSE;
+  glGetProgramiv(self->program, GL_LINK_STATUS, &linked);
+  if (!linked) {
+    char log[512];
+    glGetProgramInfoLog(self->program, sizeof(log), nullptr, log);
+    g_warning("Failed to link YUV conversion program: %s", log);
+    glDeleteProgram(self->program);
+    self->program = 0;
+    return FALSE;
+  }
+
+  self->planes_location[0] = glGetUniformLocation(self->program, "y_plane");
+  self->planes_location[1] = glGetUniformLocation(self->program, "u_plane");
+  self->planes_location[2] = glGetUniformLocation(self->program, "v_plane");
+  self->interleaved_chroma_location =
+      glGetUniformLocation(self->program, "interleaved_chroma");
+  self->matrix_location = glGetUniformLocation(self->program, "yuv_to_rgb");
+  self->offset_location = glGetUniformLocation(self->program, "yuv_offset");
+
+  // Core profiles refuse to draw without a vertex array object bound.
+  glGenVertexArrays(1, &self->vertex_array);
+  glGenFramebuffers(1, &self->framebuffer);
+  glGenTextures(YUV_GL_CONVERTER_MAX_PLANES, self->plane_textures);
+
+  return TRUE;
+}
+
+// Builds the column-major YUV -> RGB matrix and offset for the frame's
+// colorimetry (BT.601 when unknown).
+static void get_color_matrix(const GstVideoInfo* info,
+                             GLfloat matrix[9],
+                             GLfloat offset[3]) {
+  gdouble kr = 0.299, kb = 0.114;
+  gst_video_color_matrix_get_Kr_Kb(GST_VIDEO_INFO_COLORIMETRY(info).matrix,
+                                   &kr, &kb);
+  gdouble kg = 1.0 - kr - kb;
+
+  gboolean full_range =
+      GST_VIDEO_INFO_COLORIMETRY(info).range == GST_VIDEO_COLOR_RANGE_0_255;
+  gdouble luma_scale = full_range ? 1.0 : 255.0 / 219.0;
+  gdouble chroma_scale = full_range ? 1.0 : 255.0 / 224.0;
+
+  offset[0] = full_range ? 0.0f : 16.0f / 255.0f;
+  offset[1] = 128.0f / 255.0f;
+  offset[2] = 128.0f / 255.0f;
+
+  // Column 0: Y
+  matrix[0] = luma_scale;
+  matrix[1] = luma_scale;
+  matrix[2] = luma_scale;
+  // Column 1: Cb
+  matrix[3] = 0.0f;
+  matrix[4] = -2.0 * kb * (1.0 - kb) / kg * chroma_scale;
+  matrix[5] = 2.0 * (1.0 - kb) * chroma_scale;
+  // Column 2: Cr
+  matrix[6] = 2.0 * (1.0 - kr) * chroma_scale;
+  matrix[7] = -2.0 * kr * (1.0 - kr) / kg * chroma_scale;
+  matrix[8] = 0.0f;
+}
+
+// Uploads one plane into plane_textures[plane], allocating storage when the
+// plane size changes. The texture is left bound to the active unit.
+static void upload_plane(YuvGlConverter* self,
+                         GlStateGuard* guard,
+                         GstVideoFrame* frame,
+                         guint plane) {
+  uint32_t width = GST_VIDEO_FRAME_COMP_WIDTH(frame, plane);
+  uint32_t height = GST_VIDEO_FRAME_COMP_HEIGHT(frame, plane);
+  gint pixel_stride = GST_VIDEO_FRAME_COMP_PSTRIDE(frame, plane);
+  GLenum format = pixel_stride == 2 ? GL_RG : GL_RED;
+
+  gl_state_guard_bind_texture(guard, self->plane_textures[plane]);
+  if (self->plane_widths[plane] != width ||
+      self->plane_heights[plane] != height) {
+    glTexImage2D(GL_TEXTURE_2D, 0, pixel_stride == 2 ? GL_RG8 : GL_R8, width,
+                 height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    self->plane_widths[plane] = width;
+    self->plane_heights[plane] = height;
+  }
+
+  gl_state_guard_pixel_store(
+      guard, GL_UNPACK_ROW_LENGTH,
+      GST_VIDEO_FRAME_PLANE_STRIDE(frame, plane) / pixel_stride);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format,
+                  GL_UNSIGNED_BYTE, GST_VIDEO_FRAME_PLANE_DATA(frame, plane));
+}
+
+YuvGlConverter* yuv_gl_converter_new() {
+  return g_new0(YuvGlConverter, 1);
+}
+
+void yuv_gl_converter_free(YuvGlConverter* self) {
+  g_free(self);
+}
+
+gboolean yuv_gl_converter_is_supported() {
+  return epoxy_gl_version() >= (epoxy_is_desktop_gl() ? 32 : 30);
+}
+
+gboolean yuv_gl_converter_convert(YuvGlConverter* self,
+                                  GlStateGuard* guard,
+                                  GstVideoFrame* frame,
+                                  GLuint target) {
+  if (self->failed) {
+    return FALSE;
+  }
+  if (!self->initialized) {
+    if (!yuv_gl_converter_is_supported() || !yuv_gl_converter_init_gl(self)) {
+      g_warning("Planar upload needs GL 3.2 or GLES 3.0 with GLSL support");
+      self->failed = TRUE;
+      return FALSE;
+    }
+    self->initialized = TRUE;
+  }
+
+  GstVideoFormat format = GST_VIDEO_FRAME_FORMAT(frame);
+  if (format != GST_VIDEO_FORMAT_NV12 && format != GST_VIDEO_FORMAT_I420) {
+    return FALSE;
+  }
+  guint n_planes = GST_VIDEO_FRAME_N_PLANES(frame);
+
+  // Unlike the RGBA upload, this pass would break Flutter's own rendering
+  // outright if it leaked its state, so it is put back even when the guard
+  // is disabled.
+  gl_state_guard_begin_pass(guard);
+  gl_state_guard_pixel_store(guard, GL_UNPACK_ALIGNMENT, 1);
+  for (guint plane = 0; plane < n_planes; plane++) {
+    gl_state_guard_active_texture(guard, GL_TEXTURE0 + plane);
+    upload_plane(self, guard, frame, plane);
+  }
+
+  // Attach every time: the target is recreated whenever the frame size
+  // changes and may come back with the same name.
+  gl_state_guard_bind_framebuffer(guard, self->framebuffer);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         target, 0);
+
+  gboolean ok = glCheckFramebufferStatus(GL_FRAMEBUFFER) ==
+                GL_FRAMEBUFFER_COMPLETE;
+  if (ok) {
+    GLfloat matrix[9], offset[3];
+    get_color_matrix(&frame->info, matrix, offset);
+
+    gl_state_guard_set_capability(guard, GL_BLEND, FALSE);
+    gl_state_guard_set_capability(guard, GL_SCISSOR_TEST, FALSE);
+    gl_state_guard_set_capability(guard, GL_DEPTH_TEST, FALSE);
+    gl_state_guard_set_capability(guard, GL_STENCIL_TEST, FALSE);
+    gl_state_guard_set_capability(guard, GL_CULL_FACE, FALSE);
+    gl_state_guard_viewport(guard, 0, 0, GST_VIDEO_FRAME_WIDTH(frame),
+                            GST_VIDEO_FRAME_HEIGHT(frame));
+
+    gl_state_guard_use_program(guard, self->program);
+    for (guint plane = 0; plane < YUV_GL_CONVERTER_MAX_PLANES; plane++) {
+      // NV12 has no third plane; point v_plane at the chroma unit.
+      glUniform1i(self->planes_location[plane], MIN(plane, n_planes - 1));
+    }
+    glUniform1i(self->interleaved_chroma_location,
+                format == GST_VIDEO_FORMAT_NV12);
+    glUniformMatrix3fv(self->matrix_location, 1, GL_FALSE, matrix);
+    glUniform3fv(self->offset_location, 1, offset);
+
+    gl_state_guard_bind_vertex_array(guard, self->vertex_array);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+  } else {
+    g_warning("YUV conversion framebuffer is incomplete");
+  }
+
+  gl_state_guard_end_pass(guard);
+  return ok;
+}
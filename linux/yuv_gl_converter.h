@@ -0,0 +1,39 @@
+#ifndef FL_TEXTURE_REPRO_YUV_GL_CONVERTER_H_
+#define FL_TEXTURE_REPRO_YUV_GL_CONVERTER_H_
+
+#include <epoxy/gl.h>
+#include <glib.h>
+#include <gst/video/video.h>
+
+#include "gl_state_guard.h"
+
+G_BEGIN_DECLS
+
+// Uploads the planes of an NV12 or I420 frame as separate single/two channel
+// textures and converts them to RGBA with a small shader pass rendering into
+// a caller-owned texture. All functions must be called with the GL context
+// the converter was first used with current.
+typedef struct _YuvGlConverter YuvGlConverter;
+
+YuvGlConverter* yuv_gl_converter_new();
+
+// Frees the converter. GL objects are abandoned with their context, like the
+// texture owned by GstGLTexture.
+void yuv_gl_converter_free(YuvGlConverter* converter);
+
+// Whether the current context can run the conversion (GL 3.2 / GLES 3.0).
+gboolean yuv_gl_converter_is_supported();
+
+// Converts |frame| (NV12 or I420) into |target|, a GL_TEXTURE_2D with RGBA
+// storage of the frame size. Every state change goes through |guard| in a
+// pass, so the state touched (framebuffer, program, viewport, vertex array,
+// texture units 0-2, unpack state, enables) is read as it is on entry and
+// put back before returning.
+gboolean yuv_gl_converter_convert(YuvGlConverter* converter,
+                                  GlStateGuard* guard,
+                                  GstVideoFrame* frame,
+                                  GLuint target);
+
+G_END_DECLS
+
+#endif  // FL_TEXTURE_REPRO_YUV_GL_CONVERTER_H_